@@ -108,18 +108,24 @@ def connect(dsn=None, connection_factory=None, cursor_factory=None, **kwargs):
     Using *async*=True an asynchronous connection will be created. *async_* is
     a valid alias (for Python versions where ``async`` is a keyword).
 
+    Using *parallel_hosts*=True, if the dsn specifies more than one host, all
+    of them are tried at the same time and the first one accepting the
+    connection is used.
+
     Any other keyword parameter will be passed to the underlying client
     library: the list of supported parameters depends on the library version.
 
     """
-    kwasync = {}
+    kwconn = {}
     if 'async' in kwargs:
-        kwasync['async'] = kwargs.pop('async')
+        kwconn['async'] = kwargs.pop('async')
     if 'async_' in kwargs:
-        kwasync['async_'] = kwargs.pop('async_')
+        kwconn['async_'] = kwargs.pop('async_')
+    if 'parallel_hosts' in kwargs:
+        kwconn['parallel_hosts'] = kwargs.pop('parallel_hosts')
 
     dsn = _ext.make_dsn(dsn, **kwargs)
-    conn = _connect(dsn, connection_factory=connection_factory, **kwasync)
+    conn = _connect(dsn, connection_factory=connection_factory, **kwconn)
     if cursor_factory is not None:
         conn.cursor_factory = cursor_factory
 
@@ -49,9 +49,10 @@ from psycopg2._psycopg import (                         # noqa
 
 from psycopg2._psycopg import (                             # noqa
     adapt, adapters, encodings, connection, cursor,
-    lobject, Xid, libpq_version, parse_dsn, quote_ident,
+    lobject, Xid, libpq_version, parse_dsn, quote_ident, poll_many,
     string_types, binary_types, new_type, new_array_type, register_type,
-    ISQLQuote, Notify, Diagnostics, Column, ConnectionInfo,
+    ISQLQuote, Notice, Notify, NotifyQueue, Diagnostics, Column,
+    ConnectionInfo,
     QueryCanceledError, TransactionRollbackError,
     set_wait_callback, get_wait_callback, encrypt_password, )
 
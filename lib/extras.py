@@ -26,6 +26,7 @@ and classes until a better place in the distribution is found.
 # FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
 # License for more details.
 
+import io as _io
 import os as _os
 import time as _time
 import re as _re
@@ -44,7 +45,10 @@ from psycopg2._psycopg import (                             # noqa
     REPLICATION_PHYSICAL, REPLICATION_LOGICAL,
     ReplicationConnection as _replicationConnection,
     ReplicationCursor as _replicationCursor,
-    ReplicationMessage)
+    ReplicationMessage, PgoutputDecoder, UNCHANGED_TOAST,
+    PgoutputBegin, PgoutputCommit, PgoutputOrigin, PgoutputRelation,
+    PgoutputColumn, PgoutputType, PgoutputInsert, PgoutputUpdate,
+    PgoutputDelete, PgoutputTruncate, PgoutputMessage)
 
 
 # expose the json adaptation stuff into the module
@@ -560,7 +564,8 @@ class ReplicationCursor(_replicationCursor):
 
     def start_replication(
             self, slot_name=None, slot_type=None, start_lsn=0,
-            timeline=0, options=None, decode=False, status_interval=10):
+            timeline=0, options=None, decode=False, status_interval=10,
+            zero_copy=False):
         """Start replication stream."""
 
         command = "START_REPLICATION "
@@ -614,7 +619,8 @@ class ReplicationCursor(_replicationCursor):
             command += ")"
 
         self.start_replication_expert(
-            command, decode=decode, status_interval=status_interval)
+            command, decode=decode, status_interval=status_interval,
+            zero_copy=zero_copy)
 
     # allows replication cursors to be used in select.select() directly
     def fileno(self):
@@ -770,6 +776,332 @@ def wait_select(conn):
             continue
 
 
+def as_completed(objs, timeout=None):
+    """Wait for many async connections or cursors and yield them as they complete.
+
+    *objs* is a sequence of async connections, or cursors on different async
+    connections, with an operation in progress: the sockets of all of them
+    are waited on by `~psycopg2.extensions.poll_many()` with a single poll
+    call. If an operation fails its exception is raised; the operations on
+    the other connections keep on running. Raise `TimeoutError` if not all
+    the operations have completed within *timeout* seconds.
+    """
+    pending = {}
+    for obj in objs:
+        conn = getattr(obj, 'connection', obj)
+        if conn in pending:
+            raise psycopg2.ProgrammingError(
+                "more than one operation on the same connection")
+        pending[conn] = obj
+
+    if timeout is not None:
+        deadline = _time.monotonic() + timeout
+
+    while pending:
+        if timeout is not None:
+            timeout = max(0.0, deadline - _time.monotonic())
+        done = _ext.poll_many(list(pending), timeout)
+        if not done:
+            raise TimeoutError(
+                f"{len(pending)} operations not completed in time")
+        for conn, error in done:
+            obj = pending.pop(conn)
+            if error is not None:
+                raise error
+            yield obj
+
+
+async def aconnect(dsn=None, connection_factory=None, **kwargs):
+    """Create a new async connection and wait for it in the asyncio loop.
+
+    The arguments are the same of `~psycopg2.connect()`; the connection
+    factory defaults to `AsyncioConnection`.
+    """
+    if connection_factory is None:
+        connection_factory = AsyncioConnection
+    kwargs['async_'] = True
+    conn = psycopg2.connect(
+        dsn, connection_factory=connection_factory, **kwargs)
+    try:
+        await conn.wait()
+    except BaseException:
+        conn.close()
+        raise
+    return conn
+
+
+class AsyncioConnection(_connection):
+    """An async connection whose operations can be awaited in asyncio.
+
+    The cursors returned by `!cursor()` are `AsyncioCursor` by default.
+    """
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.cursor_factory = AsyncioCursor
+
+    async def wait(self):
+        """Wait for the current operation on the connection to complete.
+
+        If the waiting task is cancelled, cancel the query running. The
+        cancel request blocks until the server answers, so it is sent from
+        the loop default executor.
+        """
+        import asyncio
+        loop = asyncio.get_running_loop()
+        try:
+            await self.poll_future(loop)
+        except asyncio.CancelledError:
+            if self.status != _ext.STATUS_READY or not self.isexecuting():
+                raise
+            await loop.run_in_executor(None, self.cancel)
+            try:
+                await self.poll_future(loop)
+            except _ext.QueryCanceledError:
+                pass
+            raise
+
+    async def _execute_simple(self, query):
+        curs = self.cursor(cursor_factory=_cursor)
+        try:
+            curs.execute(query)
+            await self.wait()
+        finally:
+            curs.close()
+
+    async def commit(self):
+        """Commit the current transaction, started by an explicit BEGIN."""
+        await self._execute_simple("COMMIT")
+
+    async def rollback(self):
+        """Roll back the current transaction, started by an explicit BEGIN."""
+        await self._execute_simple("ROLLBACK")
+
+
+class AsyncioCursor(_cursor):
+    """A cursor whose operations can be awaited in asyncio.
+
+    The cursor can be used on async connections: it waits for the results in
+    the running loop after executing a query.
+    """
+    async def execute(self, query, vars=None):
+        super().execute(query, vars)
+        await self.connection.wait()
+
+    async def callproc(self, procname, vars=None):
+        rv = super().callproc(procname, vars)
+        await self.connection.wait()
+        return rv
+
+    async def fetchone(self):
+        return super().fetchone()
+
+    async def fetchmany(self, size=None):
+        if size is None:
+            return super().fetchmany()
+        else:
+            return super().fetchmany(size)
+
+    async def fetchall(self):
+        return super().fetchall()
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        rv = super().fetchone()
+        if rv is None:
+            raise StopAsyncIteration
+        return rv
+
+
+class LargeObjectIO(_io.RawIOBase):
+    """A raw binary stream on a large object.
+
+    *lobj* is an open `~psycopg2.extensions.lobject`: the stream reads it
+    with `!readinto()`, without intermediate copies. If *readahead* is a
+    positive number the large object is read in chunks of that size, and the
+    next chunk is requested in a background thread while the current one is
+    consumed.
+
+    Closing the stream closes the large object.
+    """
+    def __init__(self, lobj, readahead=0):
+        super().__init__()
+        self.lobj = lobj
+        self.readahead = readahead
+        self._executor = None
+        self._future = None
+        self._chunk = memoryview(b'')
+        self._pos = 0
+        if readahead > 0:
+            from concurrent.futures import ThreadPoolExecutor
+            self._executor = ThreadPoolExecutor(1)
+            self._bufs = [bytearray(readahead), bytearray(readahead)]
+            self._next = 0
+
+    def readable(self):
+        return 'r' in self.lobj.mode
+
+    def writable(self):
+        return 'w' in self.lobj.mode
+
+    def seekable(self):
+        return True
+
+    def readinto(self, b):
+        if self.closed:
+            raise ValueError("I/O operation on closed file")
+        if self._executor is None:
+            return self.lobj.readinto(b)
+
+        if self._pos >= len(self._chunk):
+            if self._future is None:
+                self._future = self._executor.submit(self._read_chunk)
+            future, self._future = self._future, None
+            self._chunk = future.result()
+            self._pos = 0
+            if not self._chunk:
+                return 0
+            # read the next chunk while this one is consumed
+            self._future = self._executor.submit(self._read_chunk)
+
+        n = min(len(b), len(self._chunk) - self._pos)
+        b[:n] = self._chunk[self._pos:self._pos + n]
+        self._pos += n
+        return n
+
+    def readall(self):
+        self._drain()
+        pos = self.lobj.tell()
+        buf = bytearray(self.lobj.seek(0, _os.SEEK_END) - pos)
+        self.lobj.seek(pos)
+
+        # the server doesn't read more than 2GB at once
+        bufsize = self.readahead if self.readahead > 0 else 1024 * 1024
+        n = 0
+        with memoryview(buf) as view:
+            while n < len(buf):
+                nread = self.lobj.readinto(view[n:n + bufsize])
+                if not nread:
+                    break
+                n += nread
+        del buf[n:]
+        return bytes(buf)
+
+    def write(self, b):
+        self._drain()
+        return self.lobj.write(b)
+
+    def seek(self, offset, whence=_os.SEEK_SET):
+        if whence == _os.SEEK_CUR:
+            offset += self.tell()
+            whence = _os.SEEK_SET
+        self._drain()
+        return self.lobj.seek(offset, whence)
+
+    def tell(self):
+        ahead = len(self._chunk) - self._pos
+        if self._future is not None:
+            ahead += len(self._future.result())
+        return self.lobj.tell() - ahead
+
+    def truncate(self, size=None):
+        if size is None:
+            size = self.tell()
+        self._drain()
+        self.lobj.truncate(size)
+        return size
+
+    def close(self):
+        if self.closed:
+            return
+        try:
+            if self._future is not None:
+                self._future, future = None, self._future
+                future.exception()
+            if self._executor is not None:
+                self._executor.shutdown()
+            self.lobj.close()
+        finally:
+            super().close()
+
+    def _read_chunk(self):
+        # Run in the executor thread: the buffers alternate, so the chunk
+        # being consumed is never overwritten.
+        buf = self._bufs[self._next]
+        self._next ^= 1
+        return memoryview(buf)[:self.lobj.readinto(buf)]
+
+    def _drain(self):
+        # Discard the data read ahead, moving the large object back to the
+        # position of the stream.
+        ahead = len(self._chunk) - self._pos
+        self._chunk = memoryview(b'')
+        self._pos = 0
+        if self._future is not None:
+            future, self._future = self._future, None
+            ahead += len(future.result())
+        if ahead:
+            self.lobj.seek(-ahead, _os.SEEK_CUR)
+
+
+def import_lobject(conn, src, new_oid=0, bufsize=8 * 1024 * 1024):
+    """Create a large object with the content of a file or buffer.
+
+    *src* is a bytes-like object or a binary file open for reading. The file
+    is read in blocks of *bufsize* bytes, each one written to the large object
+    with a single round trip to the server.
+
+    Return the new `~psycopg2.extensions.lobject`, open in ``wb`` mode.
+    """
+    lobj = conn.lobject(0, "wb", new_oid)
+    if not hasattr(src, 'read'):
+        lobj.write(src)
+        return lobj
+
+    readinto = getattr(src, 'readinto', None)
+    buf = bytearray(bufsize)
+    view = memoryview(buf)
+    while True:
+        if readinto is not None:
+            n = 0
+            while n < bufsize:
+                nread = readinto(view[n:])
+                if not nread:
+                    break
+                n += nread
+            data = view[:n]
+        else:
+            data = src.read(bufsize)
+        if not data:
+            break
+        lobj.write(data)
+
+    return lobj
+
+
+def export_lobject(lobj, dst, bufsize=8 * 1024 * 1024):
+    """Write the content of a large object to a file, from its current position.
+
+    *lobj* is an open `~psycopg2.extensions.lobject` and *dst* a binary file
+    open for writing. The large object is read in blocks of *bufsize* bytes,
+    with no intermediate copy.
+
+    Return the number of bytes written.
+    """
+    buf = bytearray(bufsize)
+    view = memoryview(buf)
+    total = 0
+    while True:
+        n = lobj.readinto(buf)
+        if not n:
+            break
+        dst.write(view[:n])
+        total += n
+
+    return total
+
+
 def _solve_conn_curs(conn_or_curs):
     """Return the connection and a DBAPI cursor from a connection or cursor."""
     if conn_or_curs is None:
@@ -25,8 +25,13 @@ This module implements thread-safe (and not) connection pools.
 # FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
 # License for more details.
 
+import functools as _functools
+import time as _time
+import weakref as _weakref
+
 import psycopg2
 from psycopg2 import extensions as _ext
+from psycopg2._psycopg import ConnectionPoolBase as _ConnectionPoolBase
 
 
 class PoolError(psycopg2.Error):
@@ -185,3 +190,207 @@ class ThreadedConnectionPool(AbstractConnectionPool):
             self._closeall()
         finally:
             self._lock.release()
+
+
+class NativeConnectionPool(_ConnectionPoolBase):
+    """A thread-safe connection pool with its fast path implemented in C.
+
+    Checking out and returning a connection doesn't take any Python lock: if
+    the pool is exhausted `getconn()` waits up to *timeout* seconds for a
+    connection to be returned before raising `PoolError`.
+
+    If *deferred_reset* is true, connections returned in a transaction are
+    rolled back only when they are checked out again and no clean connection
+    is available, instead of in `putconn()`. With *background_reset* they
+    are reset by a maintenance thread instead. If *discard* is true the
+    connections are also reset with ``DISCARD ALL`` when returned.
+
+    If *check_interval* is not None, connections idle for longer are checked
+    before use, and periodically by the maintenance thread. Connections older
+    than *max_lifetime* seconds are replaced.
+
+    The connections are opened in parallel when possible. If *elastic* is
+    true, callers finding the pool empty don't open a connection themselves:
+    new connections are opened in background for all the callers waiting,
+    and for the ones expected meanwhile at the current checkout rate; the
+    callers take the first connection available. Connections above *minconn*
+    idle for *max_idle* seconds are closed.
+    """
+
+    def __init__(self, minconn, maxconn, *args,
+                 timeout=30.0, deferred_reset=False, background_reset=False,
+                 discard=False, check_interval=None, max_lifetime=None,
+                 max_idle=None, elastic=False, **kwargs):
+        """Initialize the connection pool and start its maintenance."""
+        import threading
+
+        # parallel connections are opened as async and then made sync
+        connect_async = None
+        if not {'async', 'async_', 'parallel_hosts'} & set(kwargs):
+            connect_async = _functools.partial(
+                psycopg2.connect, *args, async_=True, **kwargs)
+
+        super().__init__(
+            _functools.partial(psycopg2.connect, *args, **kwargs),
+            int(minconn), int(maxconn),
+            deferred_reset=deferred_reset or background_reset,
+            discard=discard, max_lifetime=max_lifetime,
+            check_interval=check_interval, connect_async=connect_async,
+            connect_timeout=timeout or None, max_idle=max_idle,
+            elastic=elastic)
+        self.timeout = timeout
+        self._elastic = elastic
+        self._cond = threading.Condition(threading.Lock())
+        self._waiting = 0
+        self._wakeups = 0   # incremented under _cond at every notification
+        self._connect_error = None  # last error opening connections
+        self._keys = {}
+        self._rkeys = {}    # id(conn) -> key map
+
+        self._maint_event = None
+        if background_reset or check_interval or max_lifetime or max_idle:
+            self._maint_event = threading.Event()
+            _weakref.finalize(self, self._maint_event.set)
+            threading.Thread(
+                target=_maintain_pool,
+                args=(_weakref.ref(self), self._maint_event),
+                name="psycopg2-pool-maintenance", daemon=True).start()
+
+    def getconn(self, key=None, timeout=None):
+        """Get a free connection and assign it to 'key' if not None.
+
+        Wait up to 'timeout' seconds (the pool timeout if None) if the pool
+        is exhausted.
+        """
+        if key is not None:
+            with self._cond:
+                conn = self._keys.get(key)
+            if conn is not None:
+                return conn
+
+        conn = self._getconn()
+        if conn is None:
+            conn = self._wait(self.timeout if timeout is None else timeout)
+
+        if key is not None:
+            with self._cond:
+                other = self._keys.get(key)
+                if other is None:
+                    self._keys[key] = conn
+                    self._rkeys[id(conn)] = key
+            if other is not None:
+                # another thread got a connection for the same key first
+                self.putconn(conn)
+                conn = other
+
+        return conn
+
+    def putconn(self, conn, key=None, close=False):
+        """Put away an unused connection.
+
+        'key' is accepted for compatibility: the key is found from 'conn'.
+        """
+        if self._rkeys:
+            with self._cond:
+                key = self._rkeys.pop(id(conn), None)
+                if key is not None:
+                    del self._keys[key]
+
+        if self._putconn(conn, close) and self._maint_event is not None:
+            self._maint_event.set()
+
+        if self._waiting:
+            self._notify()
+
+    def closeall(self):
+        """Close all connections (even the one currently in use.)"""
+        self._closeall()
+        if self._maint_event is not None:
+            self._maint_event.set()
+        self._notify(broadcast=True)
+
+    def _notify(self, broadcast=False):
+        """Wake up one or all the callers waiting for a connection."""
+        with self._cond:
+            self._wakeups += 1
+            if broadcast:
+                self._cond.notify_all()
+            else:
+                self._cond.notify()
+
+    def _wait(self, timeout):
+        """Wait for a connection to be returned to the pool.
+
+        The lock is only used to wait: `!_getconn()` may connect, reset or
+        check a connection, which shouldn't block `putconn()`. A notification
+        arriving between `!_getconn()` and the wait is detected by the change
+        of `!_wakeups`.
+
+        If opening the connections for the callers waiting fails, the error
+        is raised by all of them.
+        """
+        deadline = _time.monotonic() + timeout
+        with self._cond:
+            self._waiting += 1
+            error = self._connect_error
+        try:
+            while True:
+                with self._cond:
+                    wakeups = self._wakeups
+                    if self._connect_error is not error:
+                        raise self._connect_error
+                conn = self._getconn()
+                if conn is not None:
+                    return conn
+                if self._elastic:
+                    self._grow()
+                remaining = deadline - _time.monotonic()
+                if remaining <= 0:
+                    raise PoolError("connection pool exhausted")
+                with self._cond:
+                    if self._wakeups == wakeups:
+                        self._cond.wait(remaining)
+        finally:
+            with self._cond:
+                self._waiting -= 1
+
+    def _grow(self):
+        """Start opening the connections needed by the callers waiting."""
+        import threading
+
+        n = self._reserve(self._waiting)
+        if n:
+            threading.Thread(
+                target=self._open_reserved, args=(n,),
+                name="psycopg2-pool-connect", daemon=True).start()
+
+    def _open_reserved(self, n):
+        """Open the connections reserved and wake up the callers waiting."""
+        try:
+            self._prewarm(n)
+        except Exception as e:
+            # the reservation is released: let the callers fail now
+            with self._cond:
+                self._connect_error = e
+        self._notify(broadcast=True)
+
+
+def _maintain_pool(wpool, event):
+    """Maintain a pool until it is closed or garbage collected."""
+    while True:
+        pool = wpool()
+        if pool is None or pool.closed:
+            return
+
+        event.clear()
+        try:
+            delay = pool._maintain()
+        except Exception:
+            # e.g. the server is not reachable: try again later
+            delay = pool.check_interval or 1.0
+
+        if pool._waiting and pool.idle:
+            pool._notify(broadcast=True)
+
+        del pool
+        event.wait(delay)
@@ -46,6 +46,80 @@ binary_escape(unsigned char *from, size_t from_length,
         return PQescapeBytea(from, from_length, to_length);
 }
 
+/* the hex representation of every byte value, as pairs of digits */
+
+#define HEX_DIGIT(x) ((x) < 10 ? '0' + (x) : 'a' - 10 + (x))
+#define HEX_PAIR(h, l) HEX_DIGIT(h), HEX_DIGIT(l)
+#define HEX_ROW(h) \
+    HEX_PAIR(h, 0), HEX_PAIR(h, 1), HEX_PAIR(h, 2), HEX_PAIR(h, 3), \
+    HEX_PAIR(h, 4), HEX_PAIR(h, 5), HEX_PAIR(h, 6), HEX_PAIR(h, 7), \
+    HEX_PAIR(h, 8), HEX_PAIR(h, 9), HEX_PAIR(h, 10), HEX_PAIR(h, 11), \
+    HEX_PAIR(h, 12), HEX_PAIR(h, 13), HEX_PAIR(h, 14), HEX_PAIR(h, 15)
+
+static const char hex_pairs[512] = {
+    HEX_ROW(0), HEX_ROW(1), HEX_ROW(2), HEX_ROW(3),
+    HEX_ROW(4), HEX_ROW(5), HEX_ROW(6), HEX_ROW(7),
+    HEX_ROW(8), HEX_ROW(9), HEX_ROW(10), HEX_ROW(11),
+    HEX_ROW(12), HEX_ROW(13), HEX_ROW(14), HEX_ROW(15)
+};
+
+/* binary_quote_hex - quote a buffer in hex format
+
+   Return the same literal PQescapeByteaConn would produce for a server
+   supporting the hex format, but writing it directly into the result,
+   8 bytes per iteration.
+*/
+
+static PyObject *
+binary_quote_hex(connectionObject *conn,
+                 const unsigned char *from, Py_ssize_t len)
+{
+    static const char suffix[] = "'::bytea";
+    PyObject *rv;
+    char *to;
+    const char *scs;
+    int eq, bs;
+    Py_ssize_t i;
+
+    if (len > (PY_SSIZE_T_MAX - 16) / 2) {
+        return PyErr_NoMemory();
+    }
+
+    scs = PQparameterStatus(conn->pgconn, "standard_conforming_strings");
+    bs = (scs && 0 == strcmp(scs, "on")) ? 1 : 2;
+    eq = conn->equote ? 1 : 0;
+
+    if (!(rv = Bytes_FromStringAndSize(
+            NULL, eq + 1 + bs + 1 + 2 * len + sizeof(suffix) - 1))) {
+        return NULL;
+    }
+
+    to = Bytes_AS_STRING(rv);
+    if (eq) { *to++ = 'E'; }
+    *to++ = '\'';
+    *to++ = '\\';
+    if (bs == 2) { *to++ = '\\'; }
+    *to++ = 'x';
+
+    for (i = 0; i + 8 <= len; i += 8, to += 16) {
+        memcpy(to, hex_pairs + 2 * from[i], 2);
+        memcpy(to + 2, hex_pairs + 2 * from[i + 1], 2);
+        memcpy(to + 4, hex_pairs + 2 * from[i + 2], 2);
+        memcpy(to + 6, hex_pairs + 2 * from[i + 3], 2);
+        memcpy(to + 8, hex_pairs + 2 * from[i + 4], 2);
+        memcpy(to + 10, hex_pairs + 2 * from[i + 5], 2);
+        memcpy(to + 12, hex_pairs + 2 * from[i + 6], 2);
+        memcpy(to + 14, hex_pairs + 2 * from[i + 7], 2);
+    }
+    for (; i < len; i++, to += 2) {
+        memcpy(to, hex_pairs + 2 * from[i], 2);
+    }
+
+    memcpy(to, suffix, sizeof(suffix) - 1);
+
+    return rv;
+}
+
 /* binary_quote - do the quote process on plain and unicode strings */
 
 static PyObject *
@@ -80,6 +154,15 @@ binary_quote(binaryObject *self)
         goto exit;
     }
 
+    /* servers understanding the hex format get it without going to libpq */
+    if (self->conn && ((connectionObject*)self->conn)->pgconn
+            && PQserverVersion(((connectionObject*)self->conn)->pgconn)
+                >= 90000) {
+        rv = binary_quote_hex((connectionObject*)self->conn,
+            (const unsigned char *)buffer, buffer_len);
+        goto exit;
+    }
+
     /* escape and build quoted buffer */
 
     to = (char *)binary_escape((unsigned char*)buffer, (size_t)buffer_len,
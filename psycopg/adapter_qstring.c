@@ -41,8 +41,8 @@ static PyObject *
 qstring_quote(qstringObject *self)
 {
     PyObject *str = NULL;
-    char *s, *buffer = NULL;
-    Py_ssize_t len, qlen;
+    char *s;
+    Py_ssize_t len;
     const char *encoding;
     PyObject *rv = NULL;
 
@@ -72,22 +72,11 @@ qstring_quote(qstringObject *self)
         goto exit;
     }
 
-    /* encode the string into buffer */
+    /* escape the string into the result */
     Bytes_AsStringAndSize(str, &s, &len);
-    if (!(buffer = psyco_escape_string(self->conn, s, len, NULL, &qlen))) {
-        goto exit;
-    }
-
-    if (qlen > PY_SSIZE_T_MAX) {
-        PyErr_SetString(PyExc_IndexError,
-            "PG buffer too large to fit in Python buffer.");
-        goto exit;
-    }
-
-    rv = Bytes_FromStringAndSize(buffer, qlen);
+    rv = psyco_quote_string(self->conn, s, len);
 
 exit:
-    PyMem_Free(buffer);
     Py_XDECREF(str);
 
     return rv;
@@ -146,7 +135,11 @@ static PyObject *
 qstring_get_encoding(qstringObject *self)
 {
     if (self->conn) {
-        return conn_pgenc_to_pyenc(self->conn->encoding, NULL);
+        PyObject *rv;
+        Py_BEGIN_CRITICAL_SECTION(self->conn);
+        rv = conn_pgenc_to_pyenc(self->conn->encoding, NULL);
+        Py_END_CRITICAL_SECTION();
+        return rv;
     }
     else {
         return Text_FromUTF8(self->encoding ? self->encoding : default_encoding);
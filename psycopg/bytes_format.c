@@ -113,6 +113,49 @@ resize_bytes(PyObject *b, Py_ssize_t newsize) {
     }
 }
 
+/* Return the size to allocate for the result of Bytes_Format.
+ *
+ * Every placeholder is at least two chars long and is replaced by at most a
+ * whole value, so the sum of the length of the format and of the values is
+ * enough to contain the result. The estimate is too small only if a value
+ * is used more than once (the same key in a mapping): in this case the
+ * result will be resized as needed. Allocating the size upfront avoids
+ * reallocating and copying the result several times when the values are
+ * many or large.
+ */
+static Py_ssize_t
+estimate_result_size(Py_ssize_t fmtcnt, PyObject *args)
+{
+    Py_ssize_t rv = fmtcnt, len, i;
+    PyObject *key, *value;
+
+    if (PyTuple_Check(args)) {
+        for (i = 0; i < PyTuple_GET_SIZE(args); i++) {
+            /* _mogrify leaves NULL items if there are more arguments than
+             * placeholders: the error is raised later */
+            value = PyTuple_GET_ITEM(args, i);
+            if (!value || !Bytes_CheckExact(value)) { continue; }
+            len = Bytes_GET_SIZE(value);
+            if (len > PY_SSIZE_T_MAX - rv) { return fmtcnt + 100; }
+            rv += len;
+        }
+    }
+    else if (PyDict_Check(args)) {
+        i = 0;
+        while (PyDict_Next(args, &i, &key, &value)) {
+            if (!Bytes_CheckExact(value)) { continue; }
+            len = Bytes_GET_SIZE(value);
+            if (len > PY_SSIZE_T_MAX - rv) { return fmtcnt + 100; }
+            rv += len;
+        }
+    }
+    else {
+        rv += 100;
+    }
+
+    return rv;
+}
+
 /* fmt%(v1,v2,...) is roughly equivalent to sprintf(fmt, v1, v2, ...) */
 
 PyObject *
@@ -130,7 +173,7 @@ Bytes_Format(PyObject *format, PyObject *args)
     }
     fmt = Bytes_AS_STRING(format);
     fmtcnt = Bytes_GET_SIZE(format);
-    reslen = rescnt = fmtcnt + 100;
+    reslen = rescnt = estimate_result_size(fmtcnt, args);
     result = Bytes_FromStringAndSize((char *)NULL, reslen);
     if (result == NULL)
         return NULL;
@@ -28,6 +28,7 @@
 #define PSYCOPG_CONNECTION_H 1
 
 #include "psycopg/xid.h"
+#include "psycopg/notice.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -66,9 +67,15 @@ extern "C" {
 #define PSYCO_POLL_WRITE 2
 #define PSYCO_POLL_ERROR 3
 
-/* Hard limit on the notices stored by the Python connection */
+/* Hard limit on the notices stored by the Python connection, and size of the
+ * ring buffer storing the notices not processed yet */
 #define CONN_NOTICES_LIMIT 50
 
+/* Number of queries whose parsing is cached by the connection, for str and
+ * for bytes queries, and maximum length of a query to cache */
+#define CONN_QUERY_CACHE_SIZE 128
+#define CONN_QUERY_CACHE_MAXLEN 8192
+
 /* we need the initial date style to be ISO, for typecasters; if the user
    later change it, she must know what she's doing... these are the queries we
    need to issue */
@@ -76,11 +83,6 @@ extern "C" {
 
 extern HIDDEN PyTypeObject connectionType;
 
-struct connectionObject_notice {
-    struct connectionObject_notice *next;
-    char *message;
-};
-
 /* the typedef is forward-declared in psycopg.h */
 struct connectionObject {
     PyObject_HEAD
@@ -113,8 +115,11 @@ struct connectionObject {
 
     /* notice processing */
     PyObject *notice_list;
-    struct connectionObject_notice *notice_pending;
-    struct connectionObject_notice *last_notice;
+    PyObject *notice_handlers;  /* list of callables, or NULL */
+    pthread_mutex_t notice_lock;  /* protects the ring from the receiver */
+    noticeData notice_ring[CONN_NOTICES_LIMIT];
+    int notice_head;            /* position of the oldest notice pending */
+    int notice_count;           /* number of notices pending in the ring */
 
     /* notifies */
     PyObject *notifies;
@@ -127,11 +132,21 @@ struct connectionObject {
     PyObject *weakreflist;    /* list of weak references */
 
     int autocommit;
+    int begin_with_query;     /* send the implicit BEGIN with the query */
 
     PyObject *cursor_factory;    /* default cursor factory from cursor() */
 
-    /* Optional pointer to a decoding C function, e.g. PyUnicode_DecodeUTF8 */
+    /* Optional pointers to C codec functions, e.g. PyUnicode_DecodeUTF8 */
     PyObject *(*cdecoder)(const char *, Py_ssize_t, const char *);
+    PyObject *(*cencoder)(PyObject *);
+
+    /* Charmap tables of single-byte encodings (e.g. cp1252), used to
+     * encode/decode in C if the encoding has no C codec function */
+    PyObject *decoding_table;
+    PyObject *encoding_table;
+
+    /* The encoding is a superset of ascii: ascii strings need no codec */
+    int ascii_compat;
 
     /* Pointers to python encoding/decoding functions, e.g.
      * codecs.getdecoder('utf8') */
@@ -148,6 +163,15 @@ struct connectionObject {
 
     /* inside a with block */
     int entered;
+
+    /* queries already encoded and parsed for placeholders, by query. str
+     * and bytes queries are kept apart: comparing them warns with -b */
+    PyObject *query_cache;
+    PyObject *query_cache_bytes;
+    unsigned long query_cache_clock;  /* counter to find the LRU query */
+
+    /* the attempts of an async parallel connection in progress */
+    struct parallelConnect *parallel;
 };
 
 /* map isolation level values into a numeric const */
@@ -165,10 +189,12 @@ HIDDEN PyObject *conn_pgenc_to_pyenc(const char *encoding, char **clean_encoding
 HIDDEN int  conn_get_protocol_version(PGconn *pgconn);
 HIDDEN int  conn_get_server_version(PGconn *pgconn);
 HIDDEN void conn_notice_process(connectionObject *self);
+HIDDEN void conn_notice_flush(connectionObject *self);
 HIDDEN void conn_notice_clean(connectionObject *self);
 HIDDEN void conn_notifies_process(connectionObject *self);
 RAISES_NEG HIDDEN int conn_setup(connectionObject *self);
-HIDDEN int  conn_connect(connectionObject *self, const char *dsn, long int async);
+HIDDEN int  conn_connect(connectionObject *self, const char *dsn, long int async,
+                         int parallel);
 HIDDEN char *conn_obscure_password(const char *dsn);
 HIDDEN void conn_close(connectionObject *self);
 HIDDEN void conn_close_locked(connectionObject *self);
@@ -178,6 +204,9 @@ RAISES_NEG HIDDEN int conn_set_session(connectionObject *self, int autocommit,
         int isolevel, int readonly, int deferrable);
 RAISES_NEG HIDDEN int  conn_set_client_encoding(connectionObject *self, const char *enc);
 HIDDEN int  conn_poll(connectionObject *self);
+HIDDEN int  conn_socket(connectionObject *self);
+HIDDEN PyObject *conn_poll_many(PyObject *conns, double timeout);
+RAISES_NEG HIDDEN int  conn_set_sync(connectionObject *self);
 RAISES_NEG HIDDEN int  conn_tpc_begin(connectionObject *self, xidObject *xid);
 RAISES_NEG HIDDEN int  conn_tpc_command(connectionObject *self,
                              const char *cmd, xidObject *xid);
@@ -32,9 +32,33 @@
 #include "psycopg/pqpath.h"
 #include "psycopg/green.h"
 #include "psycopg/notify.h"
+#include "psycopg/notifyqueue.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+/* WSAPoll() */
+#include <winsock2.h>
+/* gettimeofday() */
+#include "win32_support.h"
+#elif defined(__sun) && defined(__SVR4)
+#include "solaris_support.h"
+#elif defined(_AIX)
+#include "aix_support.h"
+#else
+#include <sys/time.h>
+#endif
+#ifndef _WIN32
+#include <poll.h>
+#endif
+#if defined(__linux__)
+/* parallel async connections wait on the attempts with epoll */
+#define HAVE_PARALLEL_ASYNC 1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
 
 /* String indexes match the ISOLATION_LEVEL_* consts */
 const char *srv_isolevels[] = {
@@ -72,6 +96,26 @@ const char *srv_state_guc[] = {
 const int SRV_STATE_UNCHANGED = -1;
 
 
+/* Return a new reference to an object member of the connection, or NULL.
+ *
+ * Members such as the codecs or the notices list can be replaced while we
+ * use them: in free-threaded builds another thread may release them, so
+ * take a reference in a critical section before using them.
+ */
+static PyObject *
+conn_get_ref(connectionObject *self, PyObject **member)
+{
+    PyObject *rv;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rv = *member;
+    Py_XINCREF(rv);
+    Py_END_CRITICAL_SECTION();
+
+    return rv;
+}
+
+
 /* Return a new "string" from a char* from the database.
  *
  * On Py2 just get a string, on Py3 decode it in the connection codec.
@@ -81,7 +125,15 @@ const int SRV_STATE_UNCHANGED = -1;
 PyObject *
 conn_text_from_chars(connectionObject *self, const char *str)
 {
-    return psyco_text_from_chars_safe(str, -1, self ? self->pydecoder : NULL);
+    PyObject *pydecoder = NULL;
+    PyObject *rv;
+
+    if (self) {
+        pydecoder = conn_get_ref(self, &self->pydecoder);
+    }
+    rv = psyco_text_from_chars_safe(str, -1, pydecoder);
+    Py_XDECREF(pydecoder);
+    return rv;
 }
 
 
@@ -94,13 +146,37 @@ conn_encode(connectionObject *self, PyObject *u)
 {
     PyObject *t = NULL;
     PyObject *rv = NULL;
+    PyObject *pyencoder = NULL;
+    PyObject *table = NULL;
+
+    if (!self) {
+        rv = PyUnicode_AsUTF8String(u);
+        goto exit;
+    }
+
+    /* ascii strings are the same in every ascii-compatible encoding */
+    if (self->ascii_compat && PyUnicode_Check(u) && PyUnicode_IS_ASCII(u)) {
+        rv = Bytes_FromStringAndSize(
+            (const char *)PyUnicode_DATA(u), PyUnicode_GET_LENGTH(u));
+        goto exit;
+    }
+
+    if (self->cencoder) {
+        rv = self->cencoder(u);
+        goto exit;
+    }
 
-    if (!(self && self->pyencoder)) {
+    if ((table = conn_get_ref(self, &self->encoding_table))) {
+        rv = PyUnicode_AsCharmapString(u, table);
+        goto exit;
+    }
+
+    if (!(pyencoder = conn_get_ref(self, &self->pyencoder))) {
         rv = PyUnicode_AsUTF8String(u);
         goto exit;
     }
 
-    if (!(t = PyObject_CallFunctionObjArgs(self->pyencoder, u, NULL))) {
+    if (!(t = PyObject_CallFunctionObjArgs(pyencoder, u, NULL))) {
         goto exit;
     }
 
@@ -109,6 +185,8 @@ conn_encode(connectionObject *self, PyObject *u)
 
 exit:
     Py_XDECREF(t);
+    Py_XDECREF(table);
+    Py_XDECREF(pyencoder);
 
     return rv;
 }
@@ -123,19 +201,30 @@ exit:
 PyObject *
 conn_decode(connectionObject *self, const char *str, Py_ssize_t len)
 {
+    PyObject *pydecoder;
+    PyObject *table;
+
     if (len < 0) { len = strlen(str); }
 
     if (self) {
         if (self->cdecoder) {
             return self->cdecoder(str, len, NULL);
         }
-        else if (self->pydecoder) {
+        else if (self->ascii_compat && psyco_is_ascii(str, len)) {
+            return PyUnicode_DecodeASCII(str, len, NULL);
+        }
+        else if ((table = conn_get_ref(self, &self->decoding_table))) {
+            PyObject *rv = PyUnicode_DecodeCharmap(str, len, table, NULL);
+            Py_DECREF(table);
+            return rv;
+        }
+        else if ((pydecoder = conn_get_ref(self, &self->pydecoder))) {
             PyObject *b = NULL;
             PyObject *t = NULL;
             PyObject *rv = NULL;
 
             if (!(b = Bytes_FromStringAndSize(str, len))) { goto error; }
-            if (!(t = PyObject_CallFunctionObjArgs(self->pydecoder, b, NULL))) {
+            if (!(t = PyObject_CallFunctionObjArgs(pydecoder, b, NULL))) {
                 goto error;
             }
             if (!(rv = PyTuple_GetItem(t, 0))) { goto error; }
@@ -143,6 +232,7 @@ conn_decode(connectionObject *self, const char *str, Py_ssize_t len)
 error:
             Py_XDECREF(t);
             Py_XDECREF(b);
+            Py_DECREF(pydecoder);
             return rv;
         }
         else {
@@ -154,56 +244,85 @@ error:
     }
 }
 
-/* conn_notice_callback - process notices */
+/* conn_notice_callback - process notices
+ *
+ * Store the notice fields in the ring of the connection, overwriting the
+ * oldest notice if full. The function may be called without the GIL.
+ */
 
 static void
-conn_notice_callback(void *args, const char *message)
+conn_notice_callback(void *args, const PGresult *res)
 {
-    struct connectionObject_notice *notice;
     connectionObject *self = (connectionObject *)args;
+    noticeData *slot;
 
-    Dprintf("conn_notice_callback: %s", message);
-
-    /* NOTE: if we get here and the connection is unlocked then there is a
-       problem but this should happen because the notice callback is only
-       called from libpq and when we're inside libpq the connection is usually
-       locked.
-    */
-    notice = (struct connectionObject_notice *)
-        malloc(sizeof(struct connectionObject_notice));
-    if (NULL == notice) {
-        /* Discard the notice in case of failed allocation. */
-        return;
-    }
-    notice->next = NULL;
-    notice->message = strdup(message);
-    if (NULL == notice->message) {
-        free(notice);
-        return;
-    }
+    Dprintf("conn_notice_callback: %s", PQresultErrorMessage(res));
 
-    if (NULL == self->last_notice) {
-        self->notice_pending = self->last_notice = notice;
+    pthread_mutex_lock(&self->notice_lock);
+    if (self->notice_count < CONN_NOTICES_LIMIT) {
+        slot = &self->notice_ring[
+            (self->notice_head + self->notice_count) % CONN_NOTICES_LIMIT];
+        self->notice_count++;
     }
     else {
-        self->last_notice->next = notice;
-        self->last_notice = notice;
+        slot = &self->notice_ring[self->notice_head];
+        self->notice_head = (self->notice_head + 1) % CONN_NOTICES_LIMIT;
     }
+
+    /* In case of failed allocation the slot is left empty and the notice
+     * is discarded when processed. */
+    notice_data_set(slot, res);
+    pthread_mutex_unlock(&self->notice_lock);
 }
 
 /* Expose the notices received as Python objects.
  *
- * The function should be called with the connection lock and the GIL.
+ * The function should be called holding the GIL.
  */
 void
 conn_notice_process(connectionObject *self)
 {
-    struct connectionObject_notice *notice;
+    if (!self->notice_count) {
+        return;
+    }
+
+    conn_notice_flush(self);
+}
+
+/* Deliver the notices pending in the ring to the notices list and to the
+ * notice handlers.
+ *
+ * The function should be called holding the GIL.
+ */
+void
+conn_notice_flush(connectionObject *self)
+{
+    noticeData pending[CONN_NOTICES_LIMIT];
+    PyObject *notice_list = NULL;
+    PyObject *handlers = NULL;
+    PyObject *pydecoder = NULL;
     PyObject *msg = NULL;
+    PyObject *notice = NULL;
     PyObject *tmp = NULL;
+    const char *message;
+    int i, j, n;
+    Py_ssize_t h;
     static PyObject *append;
 
-    if (NULL == self->notice_pending) {
+    /* Take the pending notices out of the ring without running Python code
+     * while holding the lock: the receiver may be waiting with the GIL. */
+    pthread_mutex_lock(&self->notice_lock);
+    n = self->notice_count;
+    for (i = 0; i < n; i++) {
+        j = (self->notice_head + i) % CONN_NOTICES_LIMIT;
+        pending[i] = self->notice_ring[j];
+        self->notice_ring[j].buf = NULL;
+        self->notice_ring[j].size = 0;
+    }
+    self->notice_head = self->notice_count = 0;
+    pthread_mutex_unlock(&self->notice_lock);
+
+    if (!n) {
         return;
     }
 
@@ -213,63 +332,108 @@ conn_notice_process(connectionObject *self)
         }
     }
 
-    notice = self->notice_pending;
-    while (notice != NULL) {
-        Dprintf("conn_notice_process: %s", notice->message);
+    if (!(notice_list = conn_get_ref(self, &self->notice_list))) {
+        goto error;
+    }
+    if ((tmp = conn_get_ref(self, &self->notice_handlers))) {
+        /* a copy, in case a handler changes the list */
+        handlers = PySequence_List(tmp);
+        Py_CLEAR(tmp);
+        if (!handlers) { goto error; }
+        pydecoder = conn_get_ref(self, &self->pydecoder);
+    }
 
-        if (!(msg = conn_text_from_chars(self, notice->message))) { goto error; }
+    for (i = 0; i < n; i++) {
+        if (!(message = notice_data_message(&pending[i]))) {
+            continue;
+        }
+        Dprintf("conn_notice_flush: %s", message);
 
-        if (!(tmp = PyObject_CallMethodObjArgs(
-                self->notice_list, append, msg, NULL))) {
+        if (!(msg = conn_text_from_chars(self, message))) { goto error; }
 
-            goto error;
+        if (PyList_CheckExact(notice_list)) {
+            if (0 > PyList_Append(notice_list, msg)) { goto error; }
+        }
+        else {
+            if (!(tmp = PyObject_CallMethodObjArgs(
+                    notice_list, append, msg, NULL))) {
+                goto error;
+            }
+            Py_DECREF(tmp); tmp = NULL;
         }
-
-        Py_DECREF(tmp); tmp = NULL;
         Py_DECREF(msg); msg = NULL;
 
-        notice = notice->next;
+        if (!handlers || !PyList_GET_SIZE(handlers)) {
+            continue;
+        }
+        if (!(notice = notice_from_data(&pending[i], pydecoder))) {
+            goto error;
+        }
+        for (h = 0; h < PyList_GET_SIZE(handlers); h++) {
+            PyObject *handler = PyList_GET_ITEM(handlers, h);
+            if (!(tmp = PyObject_CallFunctionObjArgs(handler, notice, NULL))) {
+                /* don't let a broken handler stop the others */
+                PyErr_WriteUnraisable(handler);
+            }
+            Py_XDECREF(tmp); tmp = NULL;
+        }
+        Py_DECREF(notice); notice = NULL;
     }
 
     /* Remove the oldest item if the queue is getting too long. */
-    if (PyList_Check(self->notice_list)) {
+    if (PyList_Check(notice_list)) {
         Py_ssize_t nnotices;
-        nnotices = PyList_GET_SIZE(self->notice_list);
+        Py_BEGIN_CRITICAL_SECTION(notice_list);
+        nnotices = PyList_GET_SIZE(notice_list);
         if (nnotices > CONN_NOTICES_LIMIT) {
-            if (-1 == PySequence_DelSlice(self->notice_list,
-                    0, nnotices - CONN_NOTICES_LIMIT)) {
+            if (-1 == PyList_SetSlice(notice_list,
+                    0, nnotices - CONN_NOTICES_LIMIT, NULL)) {
                 PyErr_Clear();
             }
         }
+        Py_END_CRITICAL_SECTION();
     }
 
-    conn_notice_clean(self);
-    return;
+    goto exit;
 
 error:
+    /* TODO: the caller doesn't expects errors from us */
+    PyErr_Clear();
+
+exit:
     Py_XDECREF(tmp);
     Py_XDECREF(msg);
-    conn_notice_clean(self);
+    Py_XDECREF(notice);
+    Py_XDECREF(pydecoder);
+    Py_XDECREF(handlers);
+    Py_XDECREF(notice_list);
 
-    /* TODO: the caller doesn't expects errors from us */
-    PyErr_Clear();
+    /* Give the buffers back to the ring, to be reused by the next notices */
+    pthread_mutex_lock(&self->notice_lock);
+    for (i = 0, j = 0; i < n; i++) {
+        while (j < CONN_NOTICES_LIMIT && self->notice_ring[j].buf) { j++; }
+        if (j == CONN_NOTICES_LIMIT) { break; }
+        self->notice_ring[j].buf = pending[i].buf;
+        self->notice_ring[j].size = pending[i].size;
+        pending[i].buf = NULL;
+    }
+    pthread_mutex_unlock(&self->notice_lock);
+
+    for (i = 0; i < n; i++) {
+        notice_data_free(&pending[i]);
+    }
 }
 
+/* Release the memory used by the notices ring. */
 void
 conn_notice_clean(connectionObject *self)
 {
-    struct connectionObject_notice *tmp, *notice;
+    int i;
 
-    notice = self->notice_pending;
-
-    while (notice != NULL) {
-        tmp = notice;
-        notice = notice->next;
-        free(tmp->message);
-        free(tmp);
+    for (i = 0; i < CONN_NOTICES_LIMIT; i++) {
+        notice_data_free(&self->notice_ring[i]);
     }
-
-    self->last_notice = self->notice_pending = NULL;
+    self->notice_head = self->notice_count = 0;
 }
 
 
@@ -282,9 +446,12 @@ void
 conn_notifies_process(connectionObject *self)
 {
     PGnotify *pgn = NULL;
+    PyObject *notifies = NULL;
     PyObject *notify = NULL;
     PyObject *pid = NULL, *channel = NULL, *payload = NULL;
     PyObject *tmp = NULL;
+    PyObject *last_channel = NULL;
+    char *last_relname = NULL;
 
     static PyObject *append;
 
@@ -300,31 +467,66 @@ conn_notifies_process(connectionObject *self)
                 (int) pgn->be_pid, pgn->relname);
 
         if (!(pid = PyInt_FromLong((long)pgn->be_pid))) { goto error; }
-        if (!(channel = conn_text_from_chars(self, pgn->relname))) { goto error; }
-        if (!(payload = conn_text_from_chars(self, pgn->extra))) { goto error; }
 
-        if (!(notify = PyObject_CallFunctionObjArgs((PyObject *)&notifyType,
-                pid, channel, payload, NULL))) {
-            goto error;
+        /* In a burst the notifications usually come from the same channel:
+         * reuse the name decoded for the previous one. */
+        if (last_relname && 0 == strcmp(last_relname, pgn->relname)) {
+            Py_INCREF(last_channel);
+            channel = last_channel;
+        }
+        else {
+            if (!(channel = conn_text_from_chars(self, pgn->relname))) {
+                goto error;
+            }
+            PyMem_Free(last_relname);
+            last_relname = NULL;
+            if (0 > psyco_strdup(&last_relname, pgn->relname, -1)) {
+                goto error;
+            }
+            Py_XDECREF(last_channel);
+            Py_INCREF(channel);
+            last_channel = channel;
         }
+        if (!(payload = conn_text_from_chars(self, pgn->extra))) { goto error; }
 
-        Py_DECREF(pid); pid = NULL;
-        Py_DECREF(channel); channel = NULL;
-        Py_DECREF(payload); payload = NULL;
+        /* Build the object without going through Notify.__init__ */
+        if (!(notify = notifyType.tp_alloc(&notifyType, 0))) { goto error; }
+        ((notifyObject *)notify)->pid = pid; pid = NULL;
+        ((notifyObject *)notify)->channel = channel; channel = NULL;
+        ((notifyObject *)notify)->payload = payload; payload = NULL;
 
-        if (!(tmp = PyObject_CallMethodObjArgs(
-                self->notifies, append, notify, NULL))) {
-            goto error;
+        if (!notifies) {
+            if (!(notifies = conn_get_ref(self, &self->notifies))) {
+                goto error;
+            }
+        }
+        if (Py_TYPE(notifies) == &notifyQueueType) {
+            /* bypass the Python method call: subclasses may override append */
+            if (0 > notifyqueue_put((notifyQueueObject *)notifies, notify)) {
+                goto error;
+            }
+        }
+        else {
+            if (!(tmp = PyObject_CallMethodObjArgs(
+                    notifies, append, notify, NULL))) {
+                goto error;
+            }
+            Py_DECREF(tmp); tmp = NULL;
         }
-        Py_DECREF(tmp); tmp = NULL;
 
         Py_DECREF(notify); notify = NULL;
         PQfreemem(pgn); pgn = NULL;
     }
+    Py_XDECREF(notifies);
+    Py_XDECREF(last_channel);
+    PyMem_Free(last_relname);
     return;  /* no error */
 
 error:
     if (pgn) { PQfreemem(pgn); }
+    Py_XDECREF(notifies);
+    Py_XDECREF(last_channel);
+    PyMem_Free(last_relname);
     Py_XDECREF(tmp);
     Py_XDECREF(notify);
     Py_XDECREF(pid);
@@ -410,26 +612,41 @@ exit:
 }
 
 /* set fast access functions according to the currently selected encoding
+ *
+ * The choice is made on the Python codec, as normalised by codecs.lookup(),
+ * rather than on the Postgres encoding: psycopg2.extensions.encodings may
+ * map the latter to a codec different from the usual one.
  */
 static void
-conn_set_fast_codec(connectionObject *self)
+conn_set_fast_codec(connectionObject *self, const char *codec)
 {
-    Dprintf("conn_set_fast_codec: encoding=%s", self->encoding);
+    Dprintf("conn_set_fast_codec: encoding=%s codec=%s",
+        self->encoding, codec ? codec : "(null)");
 
-    if (0 == strcmp(self->encoding, "UTF8")) {
+    if (codec && 0 == strcmp(codec, "utf-8")) {
         Dprintf("conn_set_fast_codec: PyUnicode_DecodeUTF8");
         self->cdecoder = PyUnicode_DecodeUTF8;
+        self->cencoder = PyUnicode_AsUTF8String;
         return;
     }
 
-    if (0 == strcmp(self->encoding, "LATIN1")) {
+    if (codec && 0 == strcmp(codec, "iso8859-1")) {
         Dprintf("conn_set_fast_codec: PyUnicode_DecodeLatin1");
         self->cdecoder = PyUnicode_DecodeLatin1;
+        self->cencoder = PyUnicode_AsLatin1String;
+        return;
+    }
+
+    if (codec && 0 == strcmp(codec, "ascii")) {
+        Dprintf("conn_set_fast_codec: PyUnicode_DecodeASCII");
+        self->cdecoder = PyUnicode_DecodeASCII;
+        self->cencoder = PyUnicode_AsASCIIString;
         return;
     }
 
     Dprintf("conn_set_fast_codec: no fast codec");
     self->cdecoder = NULL;
+    self->cencoder = NULL;
 }
 
 
@@ -444,12 +661,13 @@ conn_pgenc_to_pyenc(const char *encoding, char **clean_encoding)
     PyObject *rv = NULL;
 
     if (0 > clear_encoding_name(encoding, &pgenc)) { goto exit; }
-    if (!(rv = PyDict_GetItemString(psycoEncodings, pgenc))) {
-        PyErr_Format(OperationalError,
-            "no Python encoding for PostgreSQL encoding '%s'", pgenc);
+    if (0 >= PyDict_GetItemStringRef(psycoEncodings, pgenc, &rv)) {
+        if (!PyErr_Occurred()) {
+            PyErr_Format(OperationalError,
+                "no Python encoding for PostgreSQL encoding '%s'", pgenc);
+        }
         goto exit;
     }
-    Py_INCREF(rv);
 
     if (clean_encoding) {
         *clean_encoding = pgenc;
@@ -462,39 +680,170 @@ exit:
     return rv;
 }
 
+/* Return the charmap tables of a single-byte Python encoding.
+ *
+ * Single-byte codecs in the encodings package (e.g. cp1252, koi8_r) are
+ * implemented by a 256 chars decoding table: if pyenc is one of them return
+ * the table and the matching encoding map, so that we can encode and decode
+ * without calling into Python, else return NULL in both.
+ *
+ * Return 0 on success, else -1 and set an exception.
+ */
+RAISES_NEG static int
+conn_get_charmap_tables(
+    const char *pyenc, PyObject **dectable, PyObject **enctable)
+{
+    int rv = -1;
+    PyObject *modname = NULL;
+    PyObject *mod = NULL;
+    PyObject *dec_tmp = NULL, *enc_tmp = NULL;
+
+    if (!(modname = PyUnicode_FromFormat("encodings.%s", pyenc))) {
+        goto exit;
+    }
+    if (!(mod = PyImport_Import(modname))) {
+        if (!PyErr_ExceptionMatches(PyExc_ImportError)) { goto exit; }
+        PyErr_Clear();
+        goto done;
+    }
+    if (!(dec_tmp = PyObject_GetAttrString(mod, "decoding_table"))) {
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError)) { goto exit; }
+        PyErr_Clear();
+        goto done;
+    }
+    if (!(PyUnicode_Check(dec_tmp) && PyUnicode_GET_LENGTH(dec_tmp) == 256)) {
+        Py_CLEAR(dec_tmp);
+        goto done;
+    }
+    if (!(enc_tmp = PyUnicode_BuildEncodingMap(dec_tmp))) { goto exit; }
+
+    Dprintf("conn_get_charmap_tables: charmap codec for %s", pyenc);
+
+done:
+    *dectable = dec_tmp; dec_tmp = NULL;
+    *enctable = enc_tmp; enc_tmp = NULL;
+    rv = 0;
+
+exit:
+    Py_XDECREF(enc_tmp);
+    Py_XDECREF(dec_tmp);
+    Py_XDECREF(mod);
+    Py_XDECREF(modname);
+
+    return rv;
+}
+
+
+/* Return 1 if the codec functions leave ascii strings unchanged, else 0.
+ *
+ * All the PostgreSQL encodings are supposed to be ascii supersets, but the
+ * encodings map can be customised: check the codecs instead of trusting it.
+ */
+static int
+conn_codec_is_ascii_compat(PyObject *pyenc, PyObject *pydec)
+{
+    int rv = 0;
+    char ascii[128];
+    PyObject *b = NULL, *u = NULL;
+    PyObject *t = NULL;
+    int i;
+
+    for (i = 0; i < 128; i++) { ascii[i] = (char)i; }
+    if (!(b = Bytes_FromStringAndSize(ascii, 128))) { goto exit; }
+    if (!(u = PyUnicode_DecodeASCII(ascii, 128, NULL))) { goto exit; }
+
+    if (!(t = PyObject_CallFunctionObjArgs(pydec, b, NULL))) { goto exit; }
+    if (!(PyTuple_Check(t) && PyTuple_GET_SIZE(t) >= 1)) { goto exit; }
+    if (1 != PyObject_RichCompareBool(PyTuple_GET_ITEM(t, 0), u, Py_EQ)) {
+        goto exit;
+    }
+    Py_CLEAR(t);
+
+    if (!(t = PyObject_CallFunctionObjArgs(pyenc, u, NULL))) { goto exit; }
+    if (!(PyTuple_Check(t) && PyTuple_GET_SIZE(t) >= 1)) { goto exit; }
+    if (1 != PyObject_RichCompareBool(PyTuple_GET_ITEM(t, 0), b, Py_EQ)) {
+        goto exit;
+    }
+
+    rv = 1;
+
+exit:
+    /* a codec failing the test is not an error: just use it the slow way */
+    PyErr_Clear();
+    Py_XDECREF(t);
+    Py_XDECREF(u);
+    Py_XDECREF(b);
+
+    return rv;
+}
+
+
 /* Convert a Postgres encoding into Python encoding and decoding functions.
  *
  * Set clean_encoding to a clean version of the Postgres encoding name
- * and pyenc and pydec to python codec functions.
+ * and pyenc and pydec to python codec functions. Also return the name of
+ * the codec as normalised by codecs.lookup(), the charmap tables of the
+ * codec, if it has any, and whether it is ascii-compatible.
  *
  * Return 0 on success, else -1 and set an exception.
  */
 RAISES_NEG static int
 conn_get_python_codec(const char *encoding,
-    char **clean_encoding, PyObject **pyenc, PyObject **pydec)
+    char **clean_encoding, PyObject **pyenc, PyObject **pydec,
+    PyObject **codec, PyObject **dectable, PyObject **enctable,
+    int *ascii_compat)
 {
     int rv = -1;
     char *pgenc = NULL;
     PyObject *encname = NULL;
-    PyObject *enc_tmp = NULL, *dec_tmp = NULL;
+    PyObject *codecs = NULL, *info = NULL;
+    PyObject *enc_tmp = NULL, *dec_tmp = NULL, *codec_tmp = NULL;
+    PyObject *dectable_tmp = NULL, *enctable_tmp = NULL;
 
     /* get the Python name of the encoding as a C string */
     if (!(encname = conn_pgenc_to_pyenc(encoding, &pgenc))) { goto exit; }
     if (!(encname = psyco_ensure_bytes(encname))) { goto exit; }
 
     /* Look up the codec functions */
-    if (!(enc_tmp = PyCodec_Encoder(Bytes_AS_STRING(encname)))) { goto exit; }
-    if (!(dec_tmp = PyCodec_Decoder(Bytes_AS_STRING(encname)))) { goto exit; }
+    if (!(codecs = PyImport_ImportModule("codecs"))) { goto exit; }
+    if (!(info = PyObject_CallMethod(
+            codecs, "lookup", "s", Bytes_AS_STRING(encname)))) {
+        goto exit;
+    }
+    if (!(enc_tmp = PyObject_GetAttrString(info, "encode"))) { goto exit; }
+    if (!(dec_tmp = PyObject_GetAttrString(info, "decode"))) { goto exit; }
+    if (!(codec_tmp = PyObject_GetAttrString(info, "name"))) { goto exit; }
+    if (!PyUnicode_Check(codec_tmp)) {
+        PyErr_Format(PyExc_TypeError,
+            "codec name must be a string, got %s",
+            Py_TYPE(codec_tmp)->tp_name);
+        goto exit;
+    }
+
+    /* Look up what we need to skip the codec functions where possible */
+    if (0 > conn_get_charmap_tables(
+            Bytes_AS_STRING(encname), &dectable_tmp, &enctable_tmp)) {
+        goto exit;
+    }
+    *ascii_compat = conn_codec_is_ascii_compat(enc_tmp, dec_tmp);
 
     /* success */
     *pyenc = enc_tmp; enc_tmp = NULL;
     *pydec = dec_tmp; dec_tmp = NULL;
+    *codec = codec_tmp; codec_tmp = NULL;
+    *dectable = dectable_tmp; dectable_tmp = NULL;
+    *enctable = enctable_tmp; enctable_tmp = NULL;
     *clean_encoding = pgenc; pgenc = NULL;
     rv = 0;
 
 exit:
+    Py_XDECREF(enctable_tmp);
+    Py_XDECREF(dectable_tmp);
+    Py_XDECREF(codec_tmp);
     Py_XDECREF(enc_tmp);
     Py_XDECREF(dec_tmp);
+    Py_XDECREF(info);
+    Py_XDECREF(codecs);
     Py_XDECREF(encname);
     PyMem_Free(pgenc);
 
@@ -512,33 +861,61 @@ conn_store_encoding(connectionObject *self, const char *encoding)
 {
     int rv = -1;
     char *pgenc = NULL;
-    PyObject *enc_tmp = NULL, *dec_tmp = NULL;
+    PyObject *enc_tmp = NULL, *dec_tmp = NULL, *codec = NULL;
+    PyObject *dectable_tmp = NULL, *enctable_tmp = NULL;
+    const char *codec_name;
+    int ascii_compat = 0;
 
-    if (0 > conn_get_python_codec(encoding, &pgenc, &enc_tmp, &dec_tmp)) {
+    if (0 > conn_get_python_codec(encoding, &pgenc, &enc_tmp, &dec_tmp,
+            &codec, &dectable_tmp, &enctable_tmp, &ascii_compat)) {
         goto exit;
     }
+    if (!(codec_name = PyUnicode_AsUTF8(codec))) { goto exit; }
 
-    /* Good, success: store the encoding/codec in the connection. */
+    /* Good, success: store the encoding/codec in the connection, swapping
+     * the old ones in the tmp variables to release them below. */
+    Py_BEGIN_CRITICAL_SECTION(self);
     {
         char *tmp = self->encoding;
         self->encoding = pgenc;
-        PyMem_Free(tmp);
-        pgenc = NULL;
+        pgenc = tmp;
     }
+    {
+        PyObject *tmp = self->pyencoder;
+        self->pyencoder = enc_tmp;
+        enc_tmp = tmp;
 
-    Py_CLEAR(self->pyencoder);
-    self->pyencoder = enc_tmp;
-    enc_tmp = NULL;
+        tmp = self->pydecoder;
+        self->pydecoder = dec_tmp;
+        dec_tmp = tmp;
 
-    Py_CLEAR(self->pydecoder);
-    self->pydecoder = dec_tmp;
-    dec_tmp = NULL;
+        tmp = self->decoding_table;
+        self->decoding_table = dectable_tmp;
+        dectable_tmp = tmp;
 
-    conn_set_fast_codec(self);
+        tmp = self->encoding_table;
+        self->encoding_table = enctable_tmp;
+        enctable_tmp = tmp;
+    }
+    self->ascii_compat = ascii_compat;
+
+    conn_set_fast_codec(self, codec_name);
+    Py_END_CRITICAL_SECTION();
+
+    /* the cached queries were encoded with the old codec */
+    if (self->query_cache) {
+        PyDict_Clear(self->query_cache);
+    }
+    if (self->query_cache_bytes) {
+        PyDict_Clear(self->query_cache_bytes);
+    }
 
     rv = 0;
 
 exit:
+    Py_XDECREF(enctable_tmp);
+    Py_XDECREF(dectable_tmp);
+    Py_XDECREF(codec);
     Py_XDECREF(enc_tmp);
     Py_XDECREF(dec_tmp);
     PyMem_Free(pgenc);
@@ -584,137 +961,856 @@ conn_get_protocol_version(PGconn *pgconn)
     return ret;
 }
 
-int
-conn_get_server_version(PGconn *pgconn)
+int
+conn_get_server_version(PGconn *pgconn)
+{
+    return (int)PQserverVersion(pgconn);
+}
+
+/* set up the cancel key of the connection.
+ * On success return 0, else set an exception and return -1
+ */
+RAISES_NEG static int
+conn_setup_cancel(connectionObject *self, PGconn *pgconn)
+{
+    if (self->cancel) {
+        PQfreeCancel(self->cancel);
+    }
+
+    if (!(self->cancel = PQgetCancel(self->pgconn))) {
+        PyErr_SetString(OperationalError, "can't get cancellation key");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Return 1 if the "replication" keyword is set in the DSN, 0 otherwise */
+static int
+dsn_has_replication(char *pgdsn)
+{
+    int ret = 0;
+    PQconninfoOption *connopts, *ptr;
+
+    connopts = PQconninfoParse(pgdsn, NULL);
+
+    for(ptr = connopts; ptr->keyword != NULL; ptr++) {
+      if(strcmp(ptr->keyword, "replication") == 0 && ptr->val != NULL)
+        ret = 1;
+    }
+
+    PQconninfoFree(connopts);
+
+    return ret;
+}
+
+
+/* Return 1 if the server datestyle allows us to work without problems,
+   0 if it needs to be set to something better, e.g. ISO. */
+static int
+conn_is_datestyle_ok(PGconn *pgconn)
+{
+    const char *ds;
+
+    ds = PQparameterStatus(pgconn, "DateStyle");
+    Dprintf("conn_connect: DateStyle %s", ds);
+
+    /* pgbouncer does not pass on DateStyle */
+    if (ds == NULL)
+      return 0;
+
+    /* Return true if ds starts with "ISO"
+     * e.g. "ISO, DMY" is fine, "German" not. */
+    return (ds[0] == 'I' && ds[1] == 'S' && ds[2] == 'O');
+}
+
+
+/* conn_setup - setup and read basic information about the connection */
+
+RAISES_NEG int
+conn_setup(connectionObject *self)
+{
+    int rv = -1;
+
+    self->equote = conn_get_standard_conforming_strings(self->pgconn);
+    self->server_version = conn_get_server_version(self->pgconn);
+    self->protocol = conn_get_protocol_version(self->pgconn);
+    if (3 != self->protocol) {
+        PyErr_SetString(InterfaceError, "only protocol 3 supported");
+        goto exit;
+    }
+
+    if (0 > conn_read_encoding(self, self->pgconn)) {
+        goto exit;
+    }
+
+    if (0 > conn_setup_cancel(self, self->pgconn)) {
+        goto exit;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    pthread_mutex_lock(&self->lock);
+    Py_BLOCK_THREADS;
+
+    if (!dsn_has_replication(self->dsn) && !conn_is_datestyle_ok(self->pgconn)) {
+        int res;
+        Py_UNBLOCK_THREADS;
+        res = pq_set_guc_locked(self, "datestyle", "ISO", &_save);
+        Py_BLOCK_THREADS;
+        if (res < 0) {
+            pq_complete_error(self);
+            goto unlock;
+        }
+    }
+
+    /* for reset */
+    self->autocommit = 0;
+    self->isolevel = ISOLATION_LEVEL_DEFAULT;
+    self->readonly = STATE_DEFAULT;
+    self->deferrable = STATE_DEFAULT;
+
+    /* success */
+    rv = 0;
+
+unlock:
+    Py_UNBLOCK_THREADS;
+    pthread_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS;
+
+exit:
+    return rv;
+}
+
+/* Parallel connection attempts to the hosts of a multi-host dsn.
+ *
+ * libpq tries the hosts listed in a dsn one after the other, waiting up
+ * to connect_timeout for each one. Here a connection attempt is started
+ * for each host, the first one completing, and satisfying the
+ * target_session_attrs, wins, and the others are closed.
+ *
+ * The attempts are driven by poll(): in a loop for a sync connection, by
+ * conn_poll() for an async one. In the latter case the application waits
+ * on a single file descriptor: an epoll descriptor watching the sockets
+ * of all the attempts, so parallel async connections are only available
+ * where epoll is.
+ */
+
+typedef struct parallelConnect {
+    PQconninfoOption *options;  /* the dsn, owning the values below */
+    PQconninfoOption *defaults; /* the defaults, e.g. from env vars */
+    int nhosts;
+    char **hosts;           /* the items of the host list, or NULL */
+    char **hostaddrs;       /* the items of the hostaddr list, or NULL */
+    char **ports;           /* nhosts items, or NULL */
+    const char **keywords;  /* the other dsn parameters, NULL-terminated, */
+    const char **values;    /* with 4 free slots before the terminator */
+    int nparams;
+    const char *target_session_attrs;
+    int timeout;            /* connect_timeout, 0 if none */
+
+    /* the current round of attempts */
+    int round;
+    const char *attrs;      /* target_session_attrs of the round */
+    PGconn **conns;
+    PostgresPollingStatusType *statuses;
+    struct pollfd *fds;
+    int pending;
+    struct timeval deadline;
+    char errors[4096];      /* the errors of all the attempts failed */
+
+    /* async connections only */
+    int waitfd;             /* epoll fd watching the attempts, or -1 */
+    int timerfd;            /* timer for connect_timeout, or -1 */
+    int *watched;           /* the fd watched for every attempt, or -1 */
+} parallelConnect;
+
+static void
+_conn_free_list(char **items, int n)
+{
+    int i;
+
+    if (!items) { return; }
+    for (i = 0; i < n; i++) {
+        PyMem_Free(items[i]);
+    }
+    PyMem_Free(items);
+}
+
+/* Split a comma-separated list into a new array of strings.
+ *
+ * Return the number of items, -1 on error with an exception set.
+ */
+static int
+_conn_split_list(const char *list, char ***items)
+{
+    int n = 1, i;
+    const char *c, *start;
+    char **rv;
+
+    for (c = list; *c; c++) {
+        if (*c == ',') { n++; }
+    }
+    if (!(rv = PyMem_New(char *, n))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(rv, 0, n * sizeof(char *));
+
+    for (i = 0, start = c = list; i < n; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!(rv[i] = PyMem_Malloc(c - start + 1))) {
+                _conn_free_list(rv, i);
+                PyErr_NoMemory();
+                return -1;
+            }
+            memcpy(rv[i], start, c - start);
+            rv[i][c - start] = '\0';
+            i++;
+            start = c + 1;
+        }
+    }
+
+    *items = rv;
+    return n;
+}
+
+/* Append a message to the errors of the attempts */
+static void
+_conn_parallel_error(parallelConnect *pc, const char *msg)
+{
+    strncat(pc->errors, msg, sizeof(pc->errors) - strlen(pc->errors) - 1);
+}
+
+/* Close the attempts of the current round, collecting their errors. */
+static void
+_conn_parallel_end_round(parallelConnect *pc)
+{
+    int i;
+
+    if (!pc->conns) { return; }
+    for (i = 0; i < pc->nhosts; i++) {
+        if (!pc->conns[i]) { continue; }
+        if (pc->statuses[i] == PGRES_POLLING_FAILED) {
+            _conn_parallel_error(pc, PQerrorMessage(pc->conns[i]));
+        }
+        PQfinish(pc->conns[i]);
+        pc->conns[i] = NULL;
+    }
+    pc->pending = 0;
+}
+
+/* Release the attempts and the parallelConnect itself. */
+static void
+_conn_parallel_free(parallelConnect *pc)
+{
+    if (!pc) { return; }
+
+    _conn_parallel_end_round(pc);
+#ifdef HAVE_PARALLEL_ASYNC
+    if (pc->waitfd >= 0) { close(pc->waitfd); }
+    if (pc->timerfd >= 0) { close(pc->timerfd); }
+#endif
+    _conn_free_list(pc->hosts, pc->nhosts);
+    _conn_free_list(pc->hostaddrs, pc->nhosts);
+    _conn_free_list(pc->ports, pc->nhosts);
+    PyMem_Free(pc->keywords);
+    PyMem_Free(pc->values);
+    PyMem_Free(pc->conns);
+    PyMem_Free(pc->statuses);
+    PyMem_Free(pc->fds);
+    PyMem_Free(pc->watched);
+    PQconninfoFree(pc->options);
+    PQconninfoFree(pc->defaults);
+    PyMem_Free(pc);
+}
+
+/* Return the value of a parameter in a PQconninfoOption array, or NULL */
+static const char *
+_conn_option_value(PQconninfoOption *options, const char *keyword)
+{
+    PQconninfoOption *o;
+
+    for (o = options; o->keyword; o++) {
+        if (0 == strcmp(o->keyword, keyword)) {
+            return o->val;
+        }
+    }
+    return NULL;
+}
+
+/* Read the hosts and the other connection parameters from the dsn.
+ *
+ * The hosts and ports not in the dsn are taken from the environment, as
+ * libpq does. Return 1 if there is more than one host, 0 if there isn't,
+ * or if libpq would complain about it anyway, -1 on error with an exception
+ * set.
+ */
+static int
+_conn_parallel_parse(parallelConnect *pc)
+{
+    PQconninfoOption *o;
+    const char *host, *hostaddr, *port;
+    char **ports = NULL;
+    int nports = 0, n, i;
+    int rv = -1;
+
+    for (o = pc->options; o->keyword; o++) {
+        if (!o->val) { continue; }
+        if (0 == strcmp(o->keyword, "target_session_attrs")) {
+            pc->target_session_attrs = o->val;
+        }
+        else if (0 == strcmp(o->keyword, "connect_timeout")) {
+            pc->timeout = atoi(o->val);
+        }
+        pc->nparams++;
+    }
+
+    host = _conn_option_value(pc->options, "host");
+    hostaddr = _conn_option_value(pc->options, "hostaddr");
+    port = _conn_option_value(pc->options, "port");
+
+    /* A service file takes precedence over the environment: we can't know
+     * the values libpq would use. */
+    if (!(host || hostaddr) || !port) {
+        if (_conn_option_value(pc->options, "service")
+                || _conn_option_value(pc->defaults, "service")) {
+            if (0 > PyErr_WarnEx(PyExc_RuntimeWarning,
+                    "parallel_hosts is not supported with a service file "
+                    "providing the hosts or ports: ignored", 1)) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    if (!(host || hostaddr)) {
+        host = _conn_option_value(pc->defaults, "host");
+        hostaddr = _conn_option_value(pc->defaults, "hostaddr");
+    }
+    if (!port) {
+        port = _conn_option_value(pc->defaults, "port");
+    }
+
+    if (!((host && strchr(host, ',')) || (hostaddr && strchr(hostaddr, ',')))) {
+        return 0;
+    }
+
+    if (host) {
+        if (0 > (pc->nhosts = _conn_split_list(host, &pc->hosts))) {
+            pc->nhosts = 0;
+            goto exit;
+        }
+    }
+    if (hostaddr) {
+        if (0 > (n = _conn_split_list(hostaddr, &pc->hostaddrs))) {
+            goto exit;
+        }
+        if (host && n != pc->nhosts) {
+            /* a mismatch that libpq will report */
+            _conn_free_list(pc->hostaddrs, n);
+            pc->hostaddrs = NULL;
+            rv = 0;
+            goto exit;
+        }
+        pc->nhosts = n;
+    }
+    if (port) {
+        if (0 > (nports = _conn_split_list(port, &ports))) {
+            goto exit;
+        }
+        if (nports != 1 && nports != pc->nhosts) {
+            rv = 0;
+            goto exit;
+        }
+        /* a single port applies to all the hosts */
+        if (!(pc->ports = PyMem_New(char *, pc->nhosts))) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        memset(pc->ports, 0, pc->nhosts * sizeof(char *));
+        for (i = 0; i < pc->nhosts; i++) {
+            if (0 > psyco_strdup(&pc->ports[i], ports[nports == 1 ? 0 : i], -1)) {
+                goto exit;
+            }
+        }
+    }
+
+    /* the other parameters are passed as they are */
+    if (!(pc->keywords = PyMem_New(const char *, pc->nparams + 5))
+            || !(pc->values = PyMem_New(const char *, pc->nparams + 5))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    pc->nparams = 0;
+    for (o = pc->options; o->keyword; o++) {
+        if (!o->val
+                || 0 == strcmp(o->keyword, "host")
+                || 0 == strcmp(o->keyword, "hostaddr")
+                || 0 == strcmp(o->keyword, "port")
+                || 0 == strcmp(o->keyword, "target_session_attrs")) {
+            continue;
+        }
+        pc->keywords[pc->nparams] = o->keyword;
+        pc->values[pc->nparams++] = o->val;
+    }
+
+    rv = 1;
+
+exit:
+    _conn_free_list(ports, nports);
+    return rv;
+}
+
+/* Prepare the parallel connection to the hosts of a dsn.
+ *
+ * Return 1 and set 'rv' if the dsn has more than one host, 0 if it doesn't,
+ * -1 on error with an exception set.
+ */
+static int
+_conn_parallel_new(const char *dsn, parallelConnect **rv)
+{
+    parallelConnect *pc;
+    int i, res = 0;
+
+    if (!(pc = PyMem_Malloc(sizeof(parallelConnect)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(pc, 0, sizeof(parallelConnect));
+    pc->waitfd = pc->timerfd = -1;
+
+    /* if the dsn is not valid let PQconnectdb report the error */
+    if (!(pc->options = PQconninfoParse(dsn, NULL))
+            || !(pc->defaults = PQconndefaults())) {
+        goto exit;
+    }
+    if (1 != (res = _conn_parallel_parse(pc))) {
+        goto exit;
+    }
+
+    if (!(pc->conns = PyMem_New(PGconn *, pc->nhosts))
+            || !(pc->statuses = PyMem_New(
+                PostgresPollingStatusType, pc->nhosts))
+            || !(pc->fds = PyMem_New(struct pollfd, pc->nhosts))
+            || !(pc->watched = PyMem_New(int, pc->nhosts))) {
+        PyErr_NoMemory();
+        res = -1;
+        goto exit;
+    }
+    for (i = 0; i < pc->nhosts; i++) {
+        pc->conns[i] = NULL;
+        pc->watched[i] = -1;
+    }
+
+exit:
+    if (res == 1) {
+        *rv = pc;
+    }
+    else {
+        _conn_parallel_free(pc);
+    }
+    return res;
+}
+
+/* Start a connection attempt to the i-th host of the list. */
+static PGconn *
+_conn_parallel_start(parallelConnect *pc, int i)
+{
+    int n = pc->nparams;
+
+    if (pc->hosts) {
+        pc->keywords[n] = "host";
+        pc->values[n++] = pc->hosts[i];
+    }
+    if (pc->hostaddrs) {
+        pc->keywords[n] = "hostaddr";
+        pc->values[n++] = pc->hostaddrs[i];
+    }
+    if (pc->ports) {
+        pc->keywords[n] = "port";
+        pc->values[n++] = pc->ports[i];
+    }
+    if (pc->attrs) {
+        pc->keywords[n] = "target_session_attrs";
+        pc->values[n++] = pc->attrs;
+    }
+    pc->keywords[n] = NULL;
+    pc->values[n] = NULL;
+
+    return PQconnectStartParams(pc->keywords, pc->values, 0);
+}
+
+/* Start a round of attempts to all the hosts at the same time.
+ *
+ * libpq's prefer-standby makes a second round accepting any server.
+ * Return 0 if there are no more rounds to try, else 1.
+ */
+static int
+_conn_parallel_start_round(parallelConnect *pc)
+{
+    const char *attrs = pc->target_session_attrs;
+    int prefer = attrs && 0 == strcmp(attrs, "prefer-standby");
+    int i;
+
+    switch (pc->round++) {
+    case 0:
+        pc->attrs = prefer ? "standby" : attrs;
+        break;
+    case 1:
+        if (prefer) {
+            pc->attrs = "any";
+            break;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+
+    pc->pending = 0;
+    for (i = 0; i < pc->nhosts; i++) {
+        pc->conns[i] = _conn_parallel_start(pc, i);
+        if (pc->conns[i] && PQstatus(pc->conns[i]) != CONNECTION_BAD) {
+            pc->statuses[i] = PGRES_POLLING_WRITING;
+            pc->pending++;
+        }
+        else {
+            pc->statuses[i] = PGRES_POLLING_FAILED;
+        }
+    }
+
+    if (pc->timeout > 0) {
+        /* libpq doesn't accept timeouts smaller than 2 seconds */
+        gettimeofday(&pc->deadline, NULL);
+        pc->deadline.tv_sec += pc->timeout < 2 ? 2 : pc->timeout;
+    }
+    return 1;
+}
+
+/* Set up pc->fds to wait for the attempts pending. */
+static void
+_conn_parallel_wait_fds(parallelConnect *pc)
+{
+    int i, fd;
+
+    for (i = 0; i < pc->nhosts; i++) {
+        pc->fds[i].fd = -1;
+        pc->fds[i].revents = 0;
+        if (pc->statuses[i] != PGRES_POLLING_READING
+                && pc->statuses[i] != PGRES_POLLING_WRITING) {
+            continue;
+        }
+        if (0 > (fd = PQsocket(pc->conns[i]))) {
+            pc->statuses[i] = PGRES_POLLING_FAILED;
+            pc->pending--;
+            continue;
+        }
+        pc->fds[i].fd = fd;
+        pc->fds[i].events =
+            pc->statuses[i] == PGRES_POLLING_READING ? POLLIN : POLLOUT;
+    }
+}
+
+/* Advance the attempts whose socket is ready after poll().
+ *
+ * Return the first connection established, NULL if none is yet.
+ */
+static PGconn *
+_conn_parallel_advance(parallelConnect *pc)
+{
+    PGconn *rv;
+    int i;
+
+    for (i = 0; i < pc->nhosts; i++) {
+        if (pc->fds[i].fd < 0 || !pc->fds[i].revents) {
+            continue;
+        }
+        pc->statuses[i] = PQconnectPoll(pc->conns[i]);
+        switch (pc->statuses[i]) {
+        case PGRES_POLLING_OK:
+            Dprintf("conn_connect: parallel connection %d won", i);
+            rv = pc->conns[i];
+            pc->conns[i] = NULL;
+            pc->pending--;
+            return rv;
+        case PGRES_POLLING_READING:
+        case PGRES_POLLING_WRITING:
+            break;
+        default:
+            pc->statuses[i] = PGRES_POLLING_FAILED;
+            pc->pending--;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Return the msec left before connect_timeout expires, 0 if expired, -1 if
+ * there is no timeout. */
+static int
+_conn_parallel_msec_left(parallelConnect *pc)
 {
-    return (int)PQserverVersion(pgconn);
+    struct timeval now, left;
+
+    if (pc->timeout <= 0) {
+        return -1;
+    }
+    gettimeofday(&now, NULL);
+    timersub(&pc->deadline, &now, &left);
+    if (left.tv_sec < 0) {
+        Dprintf("conn_connect: parallel connection timeout");
+        return 0;
+    }
+    return (int)(left.tv_sec * 1000 + (left.tv_usec + 999) / 1000);
 }
 
-/* set up the cancel key of the connection.
- * On success return 0, else set an exception and return -1
+/* Run the attempts until a connection is established.
+ *
+ * Return the connection, NULL if all the attempts failed: in this case the
+ * error messages of the attempts are accumulated in pc->errors. Called
+ * without holding the GIL.
  */
-RAISES_NEG static int
-conn_setup_cancel(connectionObject *self, PGconn *pgconn)
+static PGconn *
+_conn_parallel_run(parallelConnect *pc)
 {
-    if (self->cancel) {
-        PQfreeCancel(self->cancel);
-    }
-
-    if (!(self->cancel = PQgetCancel(self->pgconn))) {
-        PyErr_SetString(OperationalError, "can't get cancellation key");
-        return -1;
+    PGconn *rv = NULL;
+    int msec;
+
+    while (!rv && _conn_parallel_start_round(pc)) {
+        while (!rv) {
+            _conn_parallel_wait_fds(pc);
+            if (!pc->pending) { break; }
+            if (0 == (msec = _conn_parallel_msec_left(pc))) {
+                _conn_parallel_error(pc, "timeout expired\n");
+                break;
+            }
+            if (0 > poll(pc->fds, pc->nhosts, msec)) {
+                if (errno == EINTR) { continue; }
+                _conn_parallel_error(pc, strerror(errno));
+                break;
+            }
+            rv = _conn_parallel_advance(pc);
+        }
+        _conn_parallel_end_round(pc);
     }
 
-    return 0;
+    return rv;
 }
 
-/* Return 1 if the "replication" keyword is set in the DSN, 0 otherwise */
+/* Connect to a multi-host dsn trying all the hosts at the same time.
+ *
+ * Return 1 if self->pgconn was connected, 0 if the dsn has a single host,
+ * -1 on error with an exception set.
+ */
 static int
-dsn_has_replication(char *pgdsn)
+_conn_parallel_connect(connectionObject *self, const char *dsn)
 {
-    int ret = 0;
-    PQconninfoOption *connopts, *ptr;
-
-    connopts = PQconninfoParse(pgdsn, NULL);
+    parallelConnect *pc;
+    int rv;
 
-    for(ptr = connopts; ptr->keyword != NULL; ptr++) {
-      if(strcmp(ptr->keyword, "replication") == 0 && ptr->val != NULL)
-        ret = 1;
+    if (1 != (rv = _conn_parallel_new(dsn, &pc))) {
+        return rv;
     }
 
-    PQconninfoFree(connopts);
+    Py_BEGIN_ALLOW_THREADS;
+    self->pgconn = _conn_parallel_run(pc);
+    Py_END_ALLOW_THREADS;
 
-    return ret;
+    if (!self->pgconn) {
+        PyErr_SetString(OperationalError,
+            *pc->errors ? pc->errors : "parallel connection failed");
+        rv = -1;
+    }
+    else {
+        Dprintf("conn_connect: new parallel PG connection at %p",
+            self->pgconn);
+    }
+
+    _conn_parallel_free(pc);
+    return rv;
 }
 
+#ifdef HAVE_PARALLEL_ASYNC
 
-/* Return 1 if the server datestyle allows us to work without problems,
-   0 if it needs to be set to something better, e.g. ISO. */
+/* Arm the connect_timeout timer of an async parallel connection. */
 static int
-conn_is_datestyle_ok(PGconn *pgconn)
+_conn_parallel_arm_timer(parallelConnect *pc)
 {
-    const char *ds;
-
-    ds = PQparameterStatus(pgconn, "DateStyle");
-    Dprintf("conn_connect: DateStyle %s", ds);
-
-    /* pgbouncer does not pass on DateStyle */
-    if (ds == NULL)
-      return 0;
+    struct itimerspec ts;
+    uint64_t expired;
 
-    /* Return true if ds starts with "ISO"
-     * e.g. "ISO, DMY" is fine, "German" not. */
-    return (ds[0] == 'I' && ds[1] == 'S' && ds[2] == 'O');
+    if (pc->timeout <= 0) {
+        return 0;
+    }
+    /* drop an expiration of the previous round */
+    if (0 > read(pc->timerfd, &expired, sizeof(expired))) {
+        /* EAGAIN: the timer didn't expire */
+    }
+    memset(&ts, 0, sizeof(ts));
+    ts.it_value.tv_sec = pc->deadline.tv_sec;
+    ts.it_value.tv_nsec = pc->deadline.tv_usec * 1000;
+    return timerfd_settime(pc->timerfd, TFD_TIMER_ABSTIME, &ts, NULL);
 }
 
+/* Make the epoll descriptor watch the attempts pending, as in pc->fds. */
+static int
+_conn_parallel_watch(parallelConnect *pc)
+{
+    struct epoll_event ev;
+    int i;
+
+    /* drop all the sockets first: a socket closed by an attempt may have
+     * been reused by another */
+    for (i = 0; i < pc->nhosts; i++) {
+        if (pc->watched[i] >= 0) {
+            epoll_ctl(pc->waitfd, EPOLL_CTL_DEL, pc->watched[i], NULL);
+            pc->watched[i] = -1;
+        }
+    }
+    for (i = 0; i < pc->nhosts; i++) {
+        if (pc->fds[i].fd < 0) { continue; }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = pc->fds[i].events == POLLIN ? EPOLLIN : EPOLLOUT;
+        ev.data.fd = pc->fds[i].fd;
+        if (0 > epoll_ctl(pc->waitfd, EPOLL_CTL_ADD, pc->fds[i].fd, &ev)) {
+            return -1;
+        }
+        pc->watched[i] = pc->fds[i].fd;
+    }
+    return 0;
+}
 
-/* conn_setup - setup and read basic information about the connection */
-
-RAISES_NEG int
-conn_setup(connectionObject *self)
+/* Start the attempts of an async parallel connection. */
+RAISES_NEG static int
+_conn_parallel_async_start(parallelConnect *pc)
 {
-    int rv = -1;
+    struct epoll_event ev;
 
-    self->equote = conn_get_standard_conforming_strings(self->pgconn);
-    self->server_version = conn_get_server_version(self->pgconn);
-    self->protocol = conn_get_protocol_version(self->pgconn);
-    if (3 != self->protocol) {
-        PyErr_SetString(InterfaceError, "only protocol 3 supported");
-        goto exit;
+    if (0 > (pc->waitfd = epoll_create1(EPOLL_CLOEXEC))) {
+        PyErr_SetFromErrno(OperationalError);
+        return -1;
     }
-
-    if (0 > conn_read_encoding(self, self->pgconn)) {
-        goto exit;
+    if (pc->timeout > 0) {
+        /* the deadlines are computed by gettimeofday() */
+        if (0 > (pc->timerfd = timerfd_create(
+                CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC))) {
+            PyErr_SetFromErrno(OperationalError);
+            return -1;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = pc->timerfd;
+        if (0 > epoll_ctl(pc->waitfd, EPOLL_CTL_ADD, pc->timerfd, &ev)) {
+            PyErr_SetFromErrno(OperationalError);
+            return -1;
+        }
     }
 
-    if (0 > conn_setup_cancel(self, self->pgconn)) {
-        goto exit;
+    _conn_parallel_start_round(pc);
+    if (0 > _conn_parallel_arm_timer(pc)) {
+        PyErr_SetFromErrno(OperationalError);
+        return -1;
     }
+    return 0;
+}
 
-    Py_BEGIN_ALLOW_THREADS;
-    pthread_mutex_lock(&self->lock);
-    Py_BLOCK_THREADS;
+#endif /* HAVE_PARALLEL_ASYNC */
 
-    if (!dsn_has_replication(self->dsn) && !conn_is_datestyle_ok(self->pgconn)) {
-        int res;
-        Py_UNBLOCK_THREADS;
-        res = pq_set_guc_locked(self, "datestyle", "ISO", &_save);
-        Py_BLOCK_THREADS;
-        if (res < 0) {
-            pq_complete_error(self);
-            goto unlock;
+/* Advance the attempts of an async parallel connection.
+ *
+ * Called by conn_poll() in CONN_STATUS_CONNECTING. While the attempts are
+ * pending return PSYCO_POLL_READ: the application should wait for the
+ * descriptor returned by conn_socket() to be readable.
+ */
+static int
+_conn_poll_parallel(connectionObject *self)
+{
+#ifdef HAVE_PARALLEL_ASYNC
+    parallelConnect *pc = self->parallel;
+    PGconn *pgconn = NULL;
+
+    for (;;) {
+        _conn_parallel_wait_fds(pc);
+        if (pc->pending && 0 < poll(pc->fds, pc->nhosts, 0)
+                && (pgconn = _conn_parallel_advance(pc))) {
+            break;
+        }
+        _conn_parallel_wait_fds(pc);
+        if (pc->pending) {
+            if (0 != _conn_parallel_msec_left(pc)) {
+                if (0 > _conn_parallel_watch(pc)) {
+                    _conn_parallel_error(pc, strerror(errno));
+                    goto error;
+                }
+                return PSYCO_POLL_READ;
+            }
+            _conn_parallel_error(pc, "timeout expired\n");
+        }
+
+        /* the attempts of the round failed: try the next round, if any */
+        _conn_parallel_end_round(pc);
+        if (!_conn_parallel_start_round(pc)) {
+            goto error;
+        }
+        if (0 > _conn_parallel_arm_timer(pc)) {
+            _conn_parallel_error(pc, strerror(errno));
+            goto error;
         }
     }
 
-    /* for reset */
-    self->autocommit = 0;
-    self->isolevel = ISOLATION_LEVEL_DEFAULT;
-    self->readonly = STATE_DEFAULT;
-    self->deferrable = STATE_DEFAULT;
+    Dprintf("conn_poll: new parallel PG connection at %p", pgconn);
+    self->pgconn = pgconn;
+    self->parallel = NULL;
+    _conn_parallel_free(pc);
 
-    /* success */
-    rv = 0;
+    PQsetNoticeReceiver(self->pgconn, conn_notice_callback, (void*)self);
+    if (0 > pq_set_non_blocking(self, 1)) {
+        return PSYCO_POLL_ERROR;
+    }
+    return PSYCO_POLL_OK;
 
-unlock:
-    Py_UNBLOCK_THREADS;
-    pthread_mutex_unlock(&self->lock);
-    Py_END_ALLOW_THREADS;
+error:
+    _conn_parallel_end_round(pc);
+    PyErr_SetString(OperationalError,
+        *pc->errors ? pc->errors : "parallel connection failed");
+    self->parallel = NULL;
+    _conn_parallel_free(pc);
+    return PSYCO_POLL_ERROR;
+#else
+    PyErr_SetString(InternalError, "unexpected parallel connection");
+    return PSYCO_POLL_ERROR;
+#endif
+}
 
-exit:
-    return rv;
+/* conn_socket - return the file descriptor to wait on for the connection
+ *
+ * During an async parallel connection it is the descriptor watching all the
+ * attempts.
+ */
+int
+conn_socket(connectionObject *self)
+{
+    if (self->parallel) {
+        return self->parallel->waitfd;
+    }
+    return PQsocket(self->pgconn);
 }
 
 /* conn_connect - execute a connection to the database */
 
 static int
-_conn_sync_connect(connectionObject *self, const char *dsn)
+_conn_sync_connect(connectionObject *self, const char *dsn, int parallel)
 {
-    int green;
+    int green, rv;
 
     /* store this value to prevent inconsistencies due to a change
      * in the middle of the function. */
     green = psyco_green();
-    if (!green) {
+    if (!green && parallel
+            && 0 != (rv = _conn_parallel_connect(self, dsn))) {
+        if (rv < 0) {
+            return -1;
+        }
+    }
+    else if (!green) {
         Py_BEGIN_ALLOW_THREADS;
         self->pgconn = PQconnectdb(dsn);
         Py_END_ALLOW_THREADS;
@@ -740,7 +1836,7 @@ _conn_sync_connect(connectionObject *self, const char *dsn)
         return -1;
     }
 
-    PQsetNoticeProcessor(self->pgconn, conn_notice_callback, (void*)self);
+    PQsetNoticeReceiver(self->pgconn, conn_notice_callback, (void*)self);
 
     /* if the connection is green, wait to finish connection */
     if (green) {
@@ -765,9 +1861,29 @@ _conn_sync_connect(connectionObject *self, const char *dsn)
 }
 
 static int
-_conn_async_connect(connectionObject *self, const char *dsn)
+_conn_async_connect(connectionObject *self, const char *dsn, int parallel)
 {
     PGconn *pgconn;
+    parallelConnect *pc;
+    int rv;
+
+    if (parallel) {
+        if (0 > (rv = _conn_parallel_new(dsn, &pc))) {
+            return -1;
+        }
+        if (rv == 1) {
+#ifdef HAVE_PARALLEL_ASYNC
+            /* the attempts will be completed by conn_poll() */
+            self->parallel = pc;
+            return _conn_parallel_async_start(pc);
+#else
+            _conn_parallel_free(pc);
+            PyErr_SetString(NotSupportedError, "parallel_hosts is not "
+                "supported in asynchronous mode on this platform");
+            return -1;
+#endif
+        }
+    }
 
     self->pgconn = pgconn = PQconnectStart(dsn);
 
@@ -786,7 +1902,7 @@ _conn_async_connect(connectionObject *self, const char *dsn)
         return -1;
     }
 
-    PQsetNoticeProcessor(pgconn, conn_notice_callback, (void*)self);
+    PQsetNoticeReceiver(pgconn, conn_notice_callback, (void*)self);
 
     /* Set the connection to nonblocking now. */
     if (pq_set_non_blocking(self, 1) != 0) {
@@ -802,17 +1918,18 @@ _conn_async_connect(connectionObject *self, const char *dsn)
 }
 
 int
-conn_connect(connectionObject *self, const char *dsn, long int async)
+conn_connect(connectionObject *self, const char *dsn, long int async,
+             int parallel)
 {
     int rv;
 
     if (async == 1) {
       Dprintf("con_connect: connecting in ASYNC mode");
-      rv = _conn_async_connect(self, dsn);
+      rv = _conn_async_connect(self, dsn, parallel);
     }
     else {
       Dprintf("con_connect: connecting in SYNC mode");
-      rv = _conn_sync_connect(self, dsn);
+      rv = _conn_sync_connect(self, dsn, parallel);
     }
 
     if (rv != 0) {
@@ -1082,12 +2199,17 @@ conn_poll(connectionObject *self)
     case CONN_STATUS_SETUP:
         Dprintf("conn_poll: status -> CONN_STATUS_SETUP");
         self->status = CONN_STATUS_CONNECTING;
-        res = PSYCO_POLL_WRITE;
-        break;
+        if (!self->parallel) {
+            res = PSYCO_POLL_WRITE;
+            break;
+        }
+        /* the parallel attempts may be already advanced */
+        /* fall through */
 
     case CONN_STATUS_CONNECTING:
         Dprintf("conn_poll: status -> CONN_STATUS_CONNECTING");
-        res = _conn_poll_connecting(self);
+        res = self->parallel ?
+            _conn_poll_parallel(self) : _conn_poll_connecting(self);
         if (res == PSYCO_POLL_OK && self->async) {
             res = _conn_poll_setup_async(self);
         }
@@ -1139,6 +2261,191 @@ conn_poll(connectionObject *self)
     return res;
 }
 
+
+/* conn_set_sync - turn an established async connection into a sync one
+ *
+ * The connection, completed by conn_poll(), is switched to blocking mode and
+ * to the default session characteristics, as if it was opened by a blocking
+ * connect: this allows to open sync connections in parallel.
+ */
+RAISES_NEG int
+conn_set_sync(connectionObject *self)
+{
+    if (!self->async || self->closed || self->async_cursor
+            || self->status != CONN_STATUS_READY) {
+        PyErr_SetString(ProgrammingError,
+            "only an idle async connection can be made sync");
+        return -1;
+    }
+
+    if (!psyco_green() && 0 > pq_set_non_blocking(self, 0)) {
+        return -1;
+    }
+
+    self->async = 0;
+    self->autocommit = 0;
+    self->isolevel = ISOLATION_LEVEL_DEFAULT;
+    self->readonly = STATE_DEFAULT;
+    self->deferrable = STATE_DEFAULT;
+
+    return 0;
+}
+
+
+/* Poll a connection of conn_poll_many() and append it to the completed ones.
+ *
+ * Return PSYCO_POLL_READ/WRITE if the connection has to wait, else
+ * PSYCO_POLL_OK after appending (conn, error) to 'done', -1 on error.
+ */
+static int
+_conn_poll_one(connectionObject *conn, PyObject *done)
+{
+    PyObject *type, *value = NULL, *tb, *item;
+    int res;
+
+    if (conn->closed) {
+        PyErr_SetString(InterfaceError, "connection already closed");
+        res = PSYCO_POLL_ERROR;
+    }
+    else {
+        res = conn_poll(conn);
+    }
+    if (res == PSYCO_POLL_READ || res == PSYCO_POLL_WRITE) {
+        return res;
+    }
+
+    if (res != PSYCO_POLL_OK) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(OperationalError, PQerrorMessage(conn->pgconn));
+        }
+        PyErr_Fetch(&type, &value, &tb);
+        PyErr_NormalizeException(&type, &value, &tb);
+        if (tb) {
+            PyException_SetTraceback(value, tb);
+        }
+        Py_XDECREF(type);
+        Py_XDECREF(tb);
+    }
+
+    item = Py_BuildValue("(OO)", conn, value ? value : Py_None);
+    Py_XDECREF(value);
+    if (!item) { return -1; }
+    res = PyList_Append(done, item);
+    Py_DECREF(item);
+    return res < 0 ? -1 : PSYCO_POLL_OK;
+}
+
+/* Poll many connections until the operation of at least one is complete.
+ *
+ * All the sockets of the connections still waiting are monitored with a
+ * single poll() call. 'timeout' is in seconds, negative to wait forever.
+ *
+ * Return a new list of (connection, error) tuples for the connections whose
+ * operation completed, with error None on success or the exception raised by
+ * poll(). The list is empty if the timeout expired. Return NULL on error.
+ */
+PyObject *
+conn_poll_many(PyObject *conns, double timeout)
+{
+    PyObject *seq = NULL, *done = NULL, *rv = NULL;
+    struct pollfd *fds = NULL;
+    struct timeval deadline, now, tv;
+    Py_ssize_t i, n;
+    int res, msec = -1;
+
+    if (!(seq = PySequence_Fast(conns, "expected a sequence of connections"))) {
+        goto exit;
+    }
+    n = PySequence_Fast_GET_SIZE(seq);
+    for (i = 0; i < n; i++) {
+        PyObject *conn = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(conn, &connectionType)) {
+            PyErr_Format(PyExc_TypeError,
+                "expected a sequence of connections, got %s",
+                Py_TYPE(conn)->tp_name);
+            goto exit;
+        }
+        if (!((connectionObject *)conn)->async) {
+            PyErr_SetString(ProgrammingError,
+                "poll_many() can only be used with async connections");
+            goto exit;
+        }
+    }
+
+    if (!(done = PyList_New(0))) { goto exit; }
+    if (!(fds = PyMem_New(struct pollfd, n))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < n; i++) {
+        /* poll all the connections on the first round */
+        fds[i].fd = -1;
+        fds[i].revents = POLLIN;
+    }
+
+    if (timeout >= 0) {
+        gettimeofday(&deadline, NULL);
+        tv.tv_sec = (long)timeout;
+        tv.tv_usec = (long)((timeout - (long)timeout) * 1.0e6);
+        timeradd(&deadline, &tv, &deadline);
+    }
+
+    for (;;) {
+        for (i = 0; i < n; i++) {
+            connectionObject *conn;
+
+            if (!fds[i].revents) { continue; }
+            conn = (connectionObject *)PySequence_Fast_GET_ITEM(seq, i);
+            res = _conn_poll_one(conn, done);
+            if (res < 0) { goto exit; }
+            if (res == PSYCO_POLL_OK) {
+                fds[i].fd = -1;
+            }
+            else {
+                fds[i].fd = conn_socket(conn);
+                fds[i].events = res == PSYCO_POLL_READ ? POLLIN : POLLOUT;
+            }
+            fds[i].revents = 0;
+        }
+        if (PyList_GET_SIZE(done) || !n) {
+            break;
+        }
+
+        if (timeout >= 0) {
+            gettimeofday(&now, NULL);
+            timersub(&deadline, &now, &tv);
+            if (tv.tv_sec < 0) {
+                Dprintf("conn_poll_many: timeout expired");
+                break;
+            }
+            msec = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+        }
+
+        Dprintf("conn_poll_many: waiting on %d connections", (int)n);
+        Py_BEGIN_ALLOW_THREADS;
+        res = poll(fds, n, msec);
+        Py_END_ALLOW_THREADS;
+
+        if (res < 0) {
+            if (errno == EINTR) {
+                if (0 > PyErr_CheckSignals()) { goto exit; }
+                continue;
+            }
+            PyErr_SetFromErrno(OperationalError);
+            goto exit;
+        }
+    }
+
+    rv = done;
+    done = NULL;
+
+exit:
+    PyMem_Free(fds);
+    Py_XDECREF(done);
+    Py_XDECREF(seq);
+    return rv;
+}
+
 /* conn_close - do anything needed to shut down the connection */
 
 void
@@ -1149,6 +2456,12 @@ conn_close(connectionObject *self)
         return;
     }
 
+    /* an async parallel connection still in progress */
+    if (self->parallel) {
+        _conn_parallel_free(self->parallel);
+        self->parallel = NULL;
+    }
+
     /* sets this connection as closed even for other threads; */
     Py_BEGIN_ALLOW_THREADS;
     pthread_mutex_lock(&self->lock);
@@ -1272,6 +2585,9 @@ conn_set_session(connectionObject *self, int autocommit,
     int rv = -1;
     int want_autocommit = autocommit == SRV_STATE_UNCHANGED ?
         self->autocommit : autocommit;
+    const char *params[3];
+    const char *values[3];
+    int nparams = 0;
 
     if (deferrable != SRV_STATE_UNCHANGED && self->server_version < 90100) {
         PyErr_SetString(ProgrammingError,
@@ -1297,53 +2613,40 @@ conn_set_session(connectionObject *self, int autocommit,
         /* we are or are going in autocommit state, so no BEGIN will be issued:
          * configure the session with the characteristics requested */
         if (isolevel != SRV_STATE_UNCHANGED) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_isolation", srv_isolevels[isolevel],
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_isolation";
+            values[nparams++] = srv_isolevels[isolevel];
         }
         if (readonly != SRV_STATE_UNCHANGED) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_read_only", srv_state_guc[readonly],
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_read_only";
+            values[nparams++] = srv_state_guc[readonly];
         }
         if (deferrable != SRV_STATE_UNCHANGED) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_deferrable", srv_state_guc[deferrable],
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_deferrable";
+            values[nparams++] = srv_state_guc[deferrable];
         }
     }
     else if (self->autocommit) {
         /* we are moving from autocommit to not autocommit, so revert the
          * characteristics to defaults to let BEGIN do its work */
         if (self->isolevel != ISOLATION_LEVEL_DEFAULT) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_isolation", "default",
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_isolation";
+            values[nparams++] = "default";
         }
         if (self->readonly != STATE_DEFAULT) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_read_only", "default",
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_read_only";
+            values[nparams++] = "default";
         }
         if (self->server_version >= 90100 && self->deferrable != STATE_DEFAULT) {
-            if (0 > pq_set_guc_locked(self,
-                    "default_transaction_deferrable", "default",
-                    &_save)) {
-                goto endlock;
-            }
+            params[nparams] = "default_transaction_deferrable";
+            values[nparams++] = "default";
         }
     }
 
+    /* all the parameters are set in a single round trip */
+    if (0 > pq_set_gucs_locked(self, nparams, params, values, &_save)) {
+        goto endlock;
+    }
+
     Py_BLOCK_THREADS;
     conn_notifies_process(self);
     conn_notice_process(self);
@@ -1388,6 +2691,7 @@ RAISES_NEG int
 conn_set_client_encoding(connectionObject *self, const char *pgenc)
 {
     int res = -1;
+    int same;
     char *clean_enc = NULL;
 
     /* We must know what python encoding this encoding is. */
@@ -1395,7 +2699,10 @@ conn_set_client_encoding(connectionObject *self, const char *pgenc)
 
     /* If the current encoding is equal to the requested one we don't
        issue any query to the backend */
-    if (strcmp(self->encoding, clean_enc) == 0) {
+    Py_BEGIN_CRITICAL_SECTION(self);
+    same = (strcmp(self->encoding, clean_enc) == 0);
+    Py_END_CRITICAL_SECTION();
+    if (same) {
         res = 0;
         goto exit;
     }
@@ -1429,7 +2736,7 @@ endlock:
 
     res = conn_store_encoding(self, pgenc);
 
-    Dprintf("conn_set_client_encoding: encoding set to %s", self->encoding);
+    Dprintf("conn_set_client_encoding: encoding set to %s", clean_enc);
 
 exit:
     PyMem_Free(clean_enc);
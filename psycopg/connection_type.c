@@ -33,6 +33,8 @@
 #include "psycopg/conninfo.h"
 #include "psycopg/lobject.h"
 #include "psycopg/green.h"
+#include "psycopg/notifyqueue.h"
+#include "psycopg/poller.h"
 #include "psycopg/xid.h"
 
 #include <stdlib.h>
@@ -661,6 +663,28 @@ psyco_conn_autocommit_set(connectionObject *self, PyObject *pyvalue)
 }
 
 
+/* begin_with_query - send the BEGIN in the same message of the query */
+
+#define psyco_conn_begin_with_query_doc \
+"Set or return if the implicit BEGIN is sent together with the query."
+
+static PyObject *
+psyco_conn_begin_with_query_get(connectionObject *self)
+{
+    return PyBool_FromLong(self->begin_with_query);
+}
+
+static int
+psyco_conn_begin_with_query_set(connectionObject *self, PyObject *pyvalue)
+{
+    int value;
+
+    if (-1 == (value = PyObject_IsTrue(pyvalue))) { return -1; }
+    self->begin_with_query = value;
+    return 0;
+}
+
+
 /* isolation_level - return or set the current isolation level */
 
 #define psyco_conn_isolation_level_doc \
@@ -1036,6 +1060,115 @@ psyco_conn_info_get(connectionObject *self)
 }
 
 
+/* encoding - the current client encoding */
+
+#define psyco_conn_encoding_doc \
+"The current client encoding."
+
+static PyObject *
+psyco_conn_encoding_get(connectionObject *self)
+{
+    PyObject *rv;
+
+    /* the string is replaced by set_client_encoding() */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->encoding) {
+        rv = Text_FromUTF8(self->encoding);
+    }
+    else {
+        Py_INCREF(Py_None);
+        rv = Py_None;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    return rv;
+}
+
+
+/* notices - the object receiving the notices */
+
+#define psyco_conn_notices_doc \
+"The object receiving the notices, a list of the last 50 by default."
+
+static PyObject *
+psyco_conn_notices_get(connectionObject *self)
+{
+    PyObject *rv;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rv = self->notice_list;
+    Py_INCREF(rv);
+    Py_END_CRITICAL_SECTION();
+
+    return rv;
+}
+
+static int
+psyco_conn_notices_set(connectionObject *self, PyObject *value)
+{
+    PyObject *old;
+
+    if (!value) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete notices");
+        return -1;
+    }
+
+    Py_INCREF(value);
+    Py_BEGIN_CRITICAL_SECTION(self);
+    old = self->notice_list;
+    self->notice_list = value;
+    Py_END_CRITICAL_SECTION();
+
+    Py_XDECREF(old);
+    return 0;
+}
+
+
+/* notifies - the object receiving the notifications */
+
+#define psyco_conn_notifies_doc \
+"The object receiving the notifications, a list by default."
+
+static PyObject *
+psyco_conn_notifies_get(connectionObject *self)
+{
+    PyObject *rv;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rv = self->notifies;
+    Py_INCREF(rv);
+    Py_END_CRITICAL_SECTION();
+
+    return rv;
+}
+
+static int
+psyco_conn_notifies_set(connectionObject *self, PyObject *value)
+{
+    PyObject *old;
+
+    if (!value) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete notifies");
+        return -1;
+    }
+    if (0 > notifyqueue_bind(value, self)) {
+        return -1;
+    }
+
+    Py_INCREF(value);
+    Py_BEGIN_CRITICAL_SECTION(self);
+    old = self->notifies;
+    self->notifies = value;
+    Py_END_CRITICAL_SECTION();
+
+    if (old != value) {
+        notifyqueue_unbind(old, self);
+    }
+    Py_XDECREF(old);
+    return 0;
+}
+
+
 /* return the pointer to the PGconn structure */
 
 #define psyco_conn_pgconn_ptr_doc \
@@ -1106,6 +1239,21 @@ psyco_conn_poll(connectionObject *self, PyObject *dummy)
 }
 
 
+#define psyco_conn_poll_future_doc \
+"poll_future(loop) -> Future -- Poll the connection from an asyncio loop.\n\n" \
+"Return a future completed when `poll()` returns `POLL_OK`, or failed with\n" \
+"the error raised by `!poll()`. The connection socket is registered in the\n" \
+"loop and polled at every readiness event, without Python calls."
+
+static PyObject *
+psyco_conn_poll_future(connectionObject *self, PyObject *loop)
+{
+    EXC_IF_CONN_CLOSED(self);
+
+    return poller_start(self, loop);
+}
+
+
 #define psyco_conn_fileno_doc \
 "fileno() -> int -- Return file descriptor associated to database connection."
 
@@ -1116,7 +1264,7 @@ psyco_conn_fileno(connectionObject *self, PyObject *dummy)
 
     EXC_IF_CONN_CLOSED(self);
 
-    socket = (long int)PQsocket(self->pgconn);
+    socket = (long int)conn_socket(self);
 
     return PyInt_FromLong(socket);
 }
@@ -1178,6 +1326,65 @@ psyco_conn_cancel(connectionObject *self, PyObject *dummy)
 }
 
 
+#define psyco_conn_add_notice_handler_doc \
+"add_notice_handler(callable) -- Call *callable* with each notice received.\n\n" \
+"The handler receives a `~psycopg2.extensions.Notice` object."
+
+static PyObject *
+psyco_conn_add_notice_handler(connectionObject *self, PyObject *handler)
+{
+    PyObject *handlers = NULL;
+    int rv = 0;
+
+    if (!PyCallable_Check(handler)) {
+        PyErr_SetString(PyExc_TypeError, "the notice handler must be callable");
+        return NULL;
+    }
+
+    /* deliver the notices received so far to the list only */
+    conn_notice_flush(self);
+
+    if (!(handlers = PyList_New(0))) { return NULL; }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!self->notice_handlers) {
+        self->notice_handlers = handlers;
+        handlers = NULL;
+    }
+    rv = PyList_Append(self->notice_handlers, handler);
+    Py_END_CRITICAL_SECTION();
+    Py_XDECREF(handlers);
+
+    if (rv < 0) { return NULL; }
+    Py_RETURN_NONE;
+}
+
+
+#define psyco_conn_remove_notice_handler_doc \
+"remove_notice_handler(callable) -- Remove a handler added by add_notice_handler()."
+
+static PyObject *
+psyco_conn_remove_notice_handler(connectionObject *self, PyObject *handler)
+{
+    PyObject *handlers, *tmp = NULL;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    handlers = self->notice_handlers;
+    Py_XINCREF(handlers);
+    Py_END_CRITICAL_SECTION();
+
+    if (!handlers) {
+        PyErr_SetString(PyExc_ValueError, "notice handler not found");
+        return NULL;
+    }
+    tmp = PyObject_CallMethod(handlers, "remove", "O", handler);
+    Py_DECREF(handlers);
+    if (!tmp) { return NULL; }
+    Py_DECREF(tmp);
+
+    Py_RETURN_NONE;
+}
+
+
 /** the connection object **/
 
 
@@ -1228,6 +1435,8 @@ static struct PyMethodDef connectionObject_methods[] = {
      METH_NOARGS, psyco_conn_reset_doc},
     {"poll", (PyCFunction)psyco_conn_poll,
      METH_NOARGS, psyco_conn_poll_doc},
+    {"poll_future", (PyCFunction)psyco_conn_poll_future,
+     METH_O, psyco_conn_poll_future_doc},
     {"fileno", (PyCFunction)psyco_conn_fileno,
      METH_NOARGS, psyco_conn_fileno_doc},
     {"isexecuting", (PyCFunction)psyco_conn_isexecuting,
@@ -1236,6 +1445,10 @@ static struct PyMethodDef connectionObject_methods[] = {
      METH_NOARGS, psyco_conn_cancel_doc},
     {"get_native_connection", (PyCFunction)psyco_get_native_connection,
      METH_NOARGS, psyco_get_native_connection_doc},
+    {"add_notice_handler", (PyCFunction)psyco_conn_add_notice_handler,
+     METH_O, psyco_conn_add_notice_handler_doc},
+    {"remove_notice_handler", (PyCFunction)psyco_conn_remove_notice_handler,
+     METH_O, psyco_conn_remove_notice_handler_doc},
     {NULL}
 };
 
@@ -1244,10 +1457,6 @@ static struct PyMethodDef connectionObject_methods[] = {
 static struct PyMemberDef connectionObject_members[] = {
     {"closed", T_LONG, offsetof(connectionObject, closed), READONLY,
         "True if the connection is closed."},
-    {"encoding", T_STRING, offsetof(connectionObject, encoding), READONLY,
-        "The current client encoding."},
-    {"notices", T_OBJECT, offsetof(connectionObject, notice_list), 0},
-    {"notifies", T_OBJECT, offsetof(connectionObject, notifies), 0},
     {"dsn", T_STRING, offsetof(connectionObject, dsn), READONLY,
         "The current connection string."},
     {"async", T_LONG, offsetof(connectionObject, async), READONLY,
@@ -1290,6 +1499,10 @@ static struct PyGetSetDef connectionObject_getsets[] = {
         (getter)psyco_conn_autocommit_get,
         (setter)psyco_conn_autocommit_set,
         psyco_conn_autocommit_doc },
+    { "begin_with_query",
+        (getter)psyco_conn_begin_with_query_get,
+        (setter)psyco_conn_begin_with_query_set,
+        psyco_conn_begin_with_query_doc },
     { "isolation_level",
         (getter)psyco_conn_isolation_level_get,
         (setter)psyco_conn_isolation_level_set,
@@ -1302,6 +1515,17 @@ static struct PyGetSetDef connectionObject_getsets[] = {
         (getter)psyco_conn_deferrable_get,
         (setter)psyco_conn_deferrable_set,
         psyco_conn_deferrable_doc },
+    { "encoding",
+        (getter)psyco_conn_encoding_get, NULL,
+        psyco_conn_encoding_doc },
+    { "notices",
+        (getter)psyco_conn_notices_get,
+        (setter)psyco_conn_notices_set,
+        psyco_conn_notices_doc },
+    { "notifies",
+        (getter)psyco_conn_notifies_get,
+        (setter)psyco_conn_notifies_set,
+        psyco_conn_notifies_doc },
     { "info",
         (getter)psyco_conn_info_get, NULL,
         psyco_conn_info_doc },
@@ -1315,7 +1539,8 @@ static struct PyGetSetDef connectionObject_getsets[] = {
 /* initialization and finalization methods */
 
 static int
-connection_setup(connectionObject *self, const char *dsn, long int async)
+connection_setup(connectionObject *self, const char *dsn, long int async,
+                 int parallel)
 {
     int rv = -1;
 
@@ -1332,6 +1557,8 @@ connection_setup(connectionObject *self, const char *dsn, long int async)
     self->async_status = ASYNC_DONE;
     if (!(self->string_types = PyDict_New())) { goto exit; }
     if (!(self->binary_types = PyDict_New())) { goto exit; }
+    if (!(self->query_cache = PyDict_New())) { goto exit; }
+    if (!(self->query_cache_bytes = PyDict_New())) { goto exit; }
     self->isolevel = ISOLATION_LEVEL_DEFAULT;
     self->readonly = STATE_DEFAULT;
     self->deferrable = STATE_DEFAULT;
@@ -1341,12 +1568,13 @@ connection_setup(connectionObject *self, const char *dsn, long int async)
 
     /* other fields have been zeroed by tp_alloc */
 
-    if (0 != pthread_mutex_init(&(self->lock), NULL)) {
+    if (0 != pthread_mutex_init(&(self->lock), NULL)
+            || 0 != pthread_mutex_init(&(self->notice_lock), NULL)) {
         PyErr_SetString(InternalError, "lock initialization failed");
         goto exit;
     }
 
-    if (conn_connect(self, dsn, async) != 0) {
+    if (conn_connect(self, dsn, async, parallel) != 0) {
         Dprintf("connection_init: FAILED");
         goto exit;
     }
@@ -1368,12 +1596,18 @@ connection_clear(connectionObject *self)
     Py_CLEAR(self->tpc_xid);
     Py_CLEAR(self->async_cursor);
     Py_CLEAR(self->notice_list);
+    Py_CLEAR(self->notice_handlers);
+    notifyqueue_unbind(self->notifies, self);
     Py_CLEAR(self->notifies);
     Py_CLEAR(self->string_types);
     Py_CLEAR(self->binary_types);
     Py_CLEAR(self->cursor_factory);
     Py_CLEAR(self->pyencoder);
     Py_CLEAR(self->pydecoder);
+    Py_CLEAR(self->decoding_table);
+    Py_CLEAR(self->encoding_table);
+    Py_CLEAR(self->query_cache);
+    Py_CLEAR(self->query_cache_bytes);
     return 0;
 }
 
@@ -1412,6 +1646,7 @@ connection_dealloc(PyObject* obj)
     connection_clear(self);
 
     pthread_mutex_destroy(&(self->lock));
+    pthread_mutex_destroy(&(self->notice_lock));
 
     Dprintf("connection_dealloc: deleted connection object at %p, refcnt = "
         FORMAT_CODE_PY_SSIZE_T,
@@ -1426,14 +1661,16 @@ connection_init(PyObject *obj, PyObject *args, PyObject *kwds)
 {
     const char *dsn;
     long int async = 0, async_ = 0;
-    static char *kwlist[] = {"dsn", "async", "async_", NULL};
+    int parallel_hosts = 0;
+    static char *kwlist[] = {"dsn", "async", "async_", "parallel_hosts", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|ll", kwlist,
-            &dsn, &async, &async_))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|llp", kwlist,
+            &dsn, &async, &async_, &parallel_hosts))
         return -1;
 
     if (async_) { async = async_; }
-    return connection_setup((connectionObject *)obj, dsn, async);
+    return connection_setup((connectionObject *)obj, dsn, async,
+        parallel_hosts);
 }
 
 static PyObject *
@@ -1456,12 +1693,17 @@ connection_traverse(connectionObject *self, visitproc visit, void *arg)
     Py_VISIT((PyObject *)(self->tpc_xid));
     Py_VISIT(self->async_cursor);
     Py_VISIT(self->notice_list);
+    Py_VISIT(self->notice_handlers);
     Py_VISIT(self->notifies);
     Py_VISIT(self->string_types);
     Py_VISIT(self->binary_types);
     Py_VISIT(self->cursor_factory);
     Py_VISIT(self->pyencoder);
     Py_VISIT(self->pydecoder);
+    Py_VISIT(self->decoding_table);
+    Py_VISIT(self->encoding_table);
+    Py_VISIT(self->query_cache);
+    Py_VISIT(self->query_cache_bytes);
     return 0;
 }
 
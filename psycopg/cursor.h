@@ -28,6 +28,7 @@
 #define PSYCOPG_CURSOR_H 1
 
 #include "psycopg/connection.h"
+#include "psycopg/typecast.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -66,6 +67,8 @@ struct cursorObject {
     Oid         lastoid;   /* last oid from an insert or InvalidOid */
 
     PyObject *casts;       /* an array (tuple) of typecast functions */
+    typecast_function *ccasts; /* the C functions to call directly for each
+                                  column, NULL where casts must be used */
     PyObject *caster;      /* the current typecaster object */
 
     PyObject  *copyfile;   /* file-like used during COPY TO/FROM ops */
@@ -92,7 +95,7 @@ struct cursorObject {
 
 
 /* C-callable functions in cursor_int.c and cursor_type.c */
-BORROWED HIDDEN PyObject *curs_get_cast(cursorObject *self, PyObject *oid);
+HIDDEN PyObject *curs_get_cast(cursorObject *self, PyObject *oid);
 HIDDEN void curs_reset(cursorObject *self);
 RAISES_NEG HIDDEN int curs_withhold_set(cursorObject *self, PyObject *pyvalue);
 RAISES_NEG HIDDEN int curs_scrollable_set(cursorObject *self, PyObject *pyvalue);
@@ -36,32 +36,39 @@
  * Return the most specific type caster, from cursor to connection to global.
  * If no type caster is found, return the default one.
  *
- * Return a borrowed reference.
+ * Return a new reference, NULL on error.
  */
 
-BORROWED PyObject *
+PyObject *
 curs_get_cast(cursorObject *self, PyObject *oid)
 {
     PyObject *cast;
 
     /* cursor lookup */
     if (self->string_types != NULL && self->string_types != Py_None) {
-        cast = PyDict_GetItem(self->string_types, oid);
+        if (0 > PyDict_GetItemRef(self->string_types, oid, &cast)) {
+            return NULL;
+        }
         Dprintf("curs_get_cast:        per-cursor dict: %p", cast);
         if (cast) { return cast; }
     }
 
     /* connection lookup */
-    cast = PyDict_GetItem(self->conn->string_types, oid);
+    if (0 > PyDict_GetItemRef(self->conn->string_types, oid, &cast)) {
+        return NULL;
+    }
     Dprintf("curs_get_cast:        per-connection dict: %p", cast);
     if (cast) { return cast; }
 
     /* global lookup */
-    cast = PyDict_GetItem(psyco_types, oid);
+    if (0 > PyDict_GetItemRef(psyco_types, oid, &cast)) {
+        return NULL;
+    }
     Dprintf("curs_get_cast:        global dict: %p", cast);
     if (cast) { return cast; }
 
     /* fallback */
+    Py_INCREF(psyco_default_cast);
     return psyco_default_cast;
 }
 
@@ -80,6 +87,8 @@ curs_reset(cursorObject *self)
 
     Py_CLEAR(self->description);
     Py_CLEAR(self->casts);
+    PyMem_Free(self->ccasts);
+    self->ccasts = NULL;
 }
 
 
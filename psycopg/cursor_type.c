@@ -243,6 +243,13 @@ _mogrify(PyObject *var, PyObject *fmt, cursorObject *curs, PyObject **new)
             c = d + 1;  /* after the ) */
             break;
 
+        /* a '%' ending the query can't be a placeholder */
+        case '\0':
+            Py_XDECREF(n);
+            psyco_set_error(ProgrammingError, curs,
+               "incomplete placeholder: '%' at the end of the query");
+            return -1;
+
         default:
             /* this is a format that expects a tuple; it is much easier,
                because we don't need to check the old/new dictionary for
@@ -370,6 +377,388 @@ _psyco_curs_merge_query_args(cursorObject *self,
     return fquery;
 }
 
+/* Queries parsed for placeholders
+ *
+ * A query template stores a query already validated and encoded, and the
+ * position of its placeholders, so that a query executed several times is
+ * only scanned the first time and the arguments can be directly merged.
+ * Templates of queries with arguments are cached in the connection, by
+ * query string, unless the query is too long.
+ */
+
+#define QUERY_TEMPLATE_NAME "psycopg2.cursor.query_template"
+
+#define QUERY_PARAMS_NONE 0
+#define QUERY_PARAMS_MAPPING 1
+#define QUERY_PARAMS_SEQUENCE 2
+
+typedef struct {
+    PyObject *query;        /* the query validated and encoded to bytes */
+
+    /* The parts of the query between the placeholders, concatenated, with
+     * '%%' already unescaped. NULL if the query has anything unusual (mixed
+     * formats, placeholders other than %s...): in this case the arguments
+     * are merged by _mogrify() and Bytes_Format(), which raise the errors. */
+    PyObject *literals;
+    Py_ssize_t *litends;    /* offset in literals where every part ends */
+
+    int kind;               /* QUERY_PARAMS_* */
+    Py_ssize_t nparams;     /* number of placeholders */
+    PyObject *keys;         /* the distinct keys of a mapping query */
+    Py_ssize_t *keyidx;     /* for each placeholder, the index in keys */
+
+    unsigned long lastuse;  /* connection clock when last used */
+} queryTemplate;
+
+static void
+_query_template_destroy(PyObject *capsule)
+{
+    queryTemplate *t = PyCapsule_GetPointer(capsule, QUERY_TEMPLATE_NAME);
+
+    Py_XDECREF(t->query);
+    Py_XDECREF(t->literals);
+    Py_XDECREF(t->keys);
+    PyMem_Free(t->litends);
+    PyMem_Free(t->keyidx);
+    PyMem_Free(t);
+}
+
+/* Find the placeholders in t->query and fill the template.
+ *
+ * Accept the same syntax accepted by _mogrify(). If the query is not
+ * well-formed leave t->literals NULL. Return -1 and set an exception on
+ * error.
+ */
+RAISES_NEG static int
+_query_template_parse(queryTemplate *t)
+{
+    const char *c, *d, *end;
+    char *lit;
+    Py_ssize_t qlen, i, npct = 0;
+    PyObject *literals = NULL, *keys = NULL, *key = NULL, *idx = NULL;
+    Py_ssize_t *litends = NULL, *keyidx = NULL;
+    int kind = QUERY_PARAMS_NONE;
+    Py_ssize_t nparams = 0;
+    int rv = -1;
+
+    c = Bytes_AS_STRING(t->query);
+    qlen = Bytes_GET_SIZE(t->query);
+    end = c + qlen;
+
+    /* _mogrify stops at the first NUL, Bytes_Format doesn't */
+    if (memchr(c, '\0', qlen)) {
+        rv = 0;
+        goto exit;
+    }
+
+    /* every placeholder starts with a '%' not escaped; a '%' ending the
+     * query is rejected by _mogrify() */
+    for (d = c; (d = memchr(d, '%', end - d)); d += 2) {
+        if (d + 1 >= end) { break; }
+        if (d[1] != '%') { npct++; }
+    }
+    if (!(litends = PyMem_New(Py_ssize_t, npct + 1))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    if (!(keyidx = PyMem_New(Py_ssize_t, npct + 1))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    if (!(literals = Bytes_FromStringAndSize(NULL, qlen))) { goto exit; }
+    lit = Bytes_AS_STRING(literals);
+    if (!(keys = PyDict_New())) { goto exit; }
+
+    while (c < end) {
+        if (*c != '%') {
+            *lit++ = *c++;
+            continue;
+        }
+        c++;
+        switch (*c) {
+        case '%':
+            *lit++ = *c++;
+            break;
+
+        case '(':
+            if (kind == QUERY_PARAMS_SEQUENCE) { goto bad_query; }
+            kind = QUERY_PARAMS_MAPPING;
+
+            /* look for the ')' as _mogrify does; Bytes_Format would also
+             * deal with nested parens, so avoid them */
+            for (d = c + 1; *d && *d != ')' && *d != '%' && *d != '('; d++);
+            if (*d != ')' || d[1] != 's') { goto bad_query; }
+
+            if (!(key = Text_FromUTF8AndSize(c + 1, d - c - 1))) {
+                goto exit;
+            }
+            if (!(idx = PyDict_GetItem(keys, key))) {
+                if (!(idx = PyLong_FromSsize_t(PyDict_Size(keys)))) {
+                    goto exit;
+                }
+                if (0 > PyDict_SetItem(keys, key, idx)) {
+                    Py_DECREF(idx);
+                    goto exit;
+                }
+                Py_DECREF(idx);
+            }
+            Py_CLEAR(key);
+            keyidx[nparams] = PyLong_AsSsize_t(idx);
+            litends[nparams++] = lit - Bytes_AS_STRING(literals);
+            c = d + 2;
+            break;
+
+        case 's':
+            if (kind == QUERY_PARAMS_MAPPING) { goto bad_query; }
+            kind = QUERY_PARAMS_SEQUENCE;
+            litends[nparams++] = lit - Bytes_AS_STRING(literals);
+            c++;
+            break;
+
+        default:
+            goto bad_query;
+        }
+    }
+    litends[nparams] = lit - Bytes_AS_STRING(literals);
+
+    if (0 > _Bytes_Resize(&literals, litends[nparams])) { goto exit; }
+
+    /* keys by index, not by name */
+    if (!(t->keys = PyTuple_New(PyDict_Size(keys)))) { goto exit; }
+    i = 0;
+    while (PyDict_Next(keys, &i, &key, &idx)) {
+        Py_INCREF(key);
+        PyTuple_SET_ITEM(t->keys, PyLong_AsSsize_t(idx), key);
+    }
+    key = NULL;
+
+    t->literals = literals; literals = NULL;
+    t->litends = litends; litends = NULL;
+    t->keyidx = keyidx; keyidx = NULL;
+    t->kind = kind;
+    t->nparams = nparams;
+
+bad_query:
+    rv = 0;
+
+exit:
+    Py_XDECREF(key);
+    Py_XDECREF(keys);
+    Py_XDECREF(literals);
+    PyMem_Free(litends);
+    PyMem_Free(keyidx);
+    return rv;
+}
+
+/* Return a template for the query `sql`, parsing it if not in cache.
+ *
+ * The query is only parsed if it is executed with `vars`.
+ * Return a new reference to a capsule wrapping the template, NULL on error.
+ */
+static PyObject *
+_psyco_curs_get_template(cursorObject *self, PyObject *sql, PyObject *vars)
+{
+    connectionObject *conn = self->conn;
+    PyObject *capsule = NULL, *cache = NULL;
+    queryTemplate *t = NULL;
+    int found = 0, err = 0;
+
+    /* only cache plain strings: other objects may compare equal but have
+     * a different representation, or be unhashable */
+    if (vars && vars != Py_None && sql) {
+        if (PyUnicode_CheckExact(sql)) {
+            if (PyUnicode_GET_LENGTH(sql) <= CONN_QUERY_CACHE_MAXLEN) {
+                cache = conn->query_cache;
+            }
+        }
+        else if (Bytes_CheckExact(sql)) {
+            if (Bytes_GET_SIZE(sql) <= CONN_QUERY_CACHE_MAXLEN) {
+                cache = conn->query_cache_bytes;
+            }
+        }
+    }
+
+    /* the cache is shared by the cursors of the connection, which may be
+     * used in different threads: update it in a critical section */
+    if (cache) {
+        Py_BEGIN_CRITICAL_SECTION(cache);
+        found = PyDict_GetItemRef(cache, sql, &capsule);
+        if (found > 0) {
+            t = PyCapsule_GetPointer(capsule, QUERY_TEMPLATE_NAME);
+            t->lastuse = ++conn->query_cache_clock;
+        }
+        Py_END_CRITICAL_SECTION();
+        if (found) {
+            return capsule;
+        }
+    }
+
+    if (!(t = PyMem_Malloc(sizeof(queryTemplate)))) {
+        return PyErr_NoMemory();
+    }
+    memset(t, 0, sizeof(queryTemplate));
+    if (!(capsule = PyCapsule_New(
+            t, QUERY_TEMPLATE_NAME, _query_template_destroy))) {
+        PyMem_Free(t);
+        return NULL;
+    }
+
+    if (!(t->query = curs_validate_sql_basic(self, sql))) { goto error; }
+    if (!cache) {
+        return capsule;
+    }
+    if (0 > _query_template_parse(t)) { goto error; }
+
+    Py_BEGIN_CRITICAL_SECTION(cache);
+    /* make room evicting the least recently used query */
+    if (PyDict_Size(cache) >= CONN_QUERY_CACHE_SIZE) {
+        PyObject *k, *v, *lru = NULL;
+        unsigned long lastuse = ULONG_MAX;
+        Py_ssize_t i = 0;
+        while (PyDict_Next(cache, &i, &k, &v)) {
+            queryTemplate *vt = PyCapsule_GetPointer(v, QUERY_TEMPLATE_NAME);
+            if (vt->lastuse <= lastuse) {
+                lastuse = vt->lastuse;
+                lru = k;
+            }
+        }
+        if (lru) {
+            err = PyDict_DelItem(cache, lru);
+        }
+    }
+    if (0 == err) {
+        t->lastuse = ++conn->query_cache_clock;
+        err = PyDict_SetItem(cache, sql, capsule);
+    }
+    Py_END_CRITICAL_SECTION();
+    if (0 > err) { goto error; }
+
+    return capsule;
+
+error:
+    Py_DECREF(capsule);
+    return NULL;
+}
+
+/* Return the query of a template merged with the arguments in vars.
+ *
+ * Return a new reference to bytes, NULL and set an exception on error.
+ */
+static PyObject *
+_psyco_curs_template_merge(cursorObject *self, PyObject *capsule,
+                           PyObject *vars)
+{
+    queryTemplate *t = PyCapsule_GetPointer(capsule, QUERY_TEMPLATE_NAME);
+    PyObject *values_static[16];
+    PyObject **values = values_static;
+    PyObject *fquery = NULL, *cvt = NULL;
+    Py_ssize_t nvalues = 0, i, len;
+    char *buf;
+    const char *lit;
+
+    if (!vars || vars == Py_None) {
+        Py_INCREF(t->query);
+        return t->query;
+    }
+
+    /* unusual query: use the general code path */
+    if (!t->literals) {
+        if (0 > _mogrify(vars, t->query, self, &cvt)) { goto exit; }
+        if (cvt) {
+            fquery = _psyco_curs_merge_query_args(self, t->query, cvt);
+        }
+        else {
+            Py_INCREF(t->query);
+            fquery = t->query;
+        }
+        goto exit;
+    }
+
+    nvalues = (t->kind == QUERY_PARAMS_MAPPING)
+        ? PyTuple_GET_SIZE(t->keys) : t->nparams;
+    if (nvalues > (Py_ssize_t)(sizeof(values_static) / sizeof(PyObject *))) {
+        if (!(values = PyMem_New(PyObject *, nvalues))) {
+            PyErr_NoMemory();
+            nvalues = 0;
+            goto exit;
+        }
+    }
+    memset(values, 0, nvalues * sizeof(PyObject *));
+
+    /* adapt the arguments */
+    len = Bytes_GET_SIZE(t->literals);
+    for (i = 0; i < nvalues; i++) {
+        PyObject *value;
+
+        if (t->kind == QUERY_PARAMS_MAPPING) {
+            value = PyObject_GetItem(vars, PyTuple_GET_ITEM(t->keys, i));
+        }
+        else {
+            value = PySequence_GetItem(vars, i);
+        }
+        if (!value) { goto exit; }
+
+        /* None is always converted to NULL, as in _mogrify() */
+        if (value == Py_None) {
+            Py_INCREF(psyco_null);
+            values[i] = psyco_null;
+        }
+        else {
+            values[i] = microprotocol_getquoted(value, self->conn);
+        }
+        Py_DECREF(value);
+        if (!values[i]) { goto exit; }
+        if (!Bytes_CheckExact(values[i])) {
+            PyErr_Format(PyExc_ValueError,
+                "only bytes values expected, got %s",
+                Py_TYPE(values[i])->tp_name);
+            goto exit;
+        }
+    }
+
+    if (t->kind == QUERY_PARAMS_SEQUENCE
+            && PyObject_Length(vars) > t->nparams) {
+        PyErr_SetString(PyExc_TypeError,
+            "not all arguments converted during string formatting");
+        goto exit;
+    }
+
+    /* merge them into the query */
+    for (i = 0; i < t->nparams; i++) {
+        PyObject *v = values[
+            t->kind == QUERY_PARAMS_MAPPING ? t->keyidx[i] : i];
+        if (Bytes_GET_SIZE(v) > PY_SSIZE_T_MAX - len) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        len += Bytes_GET_SIZE(v);
+    }
+    if (!(fquery = Bytes_FromStringAndSize(NULL, len))) { goto exit; }
+    buf = Bytes_AS_STRING(fquery);
+    lit = Bytes_AS_STRING(t->literals);
+    for (i = 0; i < t->nparams; i++) {
+        PyObject *v = values[
+            t->kind == QUERY_PARAMS_MAPPING ? t->keyidx[i] : i];
+        len = t->litends[i] - (i ? t->litends[i - 1] : 0);
+        memcpy(buf, lit, len);
+        buf += len;
+        lit += len;
+        memcpy(buf, Bytes_AS_STRING(v), Bytes_GET_SIZE(v));
+        buf += Bytes_GET_SIZE(v);
+    }
+    memcpy(buf, lit, t->litends[i] - (i ? t->litends[i - 1] : 0));
+
+exit:
+    for (i = 0; i < nvalues; i++) {
+        Py_XDECREF(values[i]);
+    }
+    if (values != values_static) {
+        PyMem_Free(values);
+    }
+    Py_XDECREF(cvt);
+    return fquery;
+}
+
 #define curs_execute_doc \
 "execute(query, vars=None) -- Execute query with bound vars."
 
@@ -380,10 +769,10 @@ _psyco_curs_execute(cursorObject *self,
 {
     int res = -1;
     int tmp;
-    PyObject *fquery = NULL, *cvt = NULL;
+    PyObject *fquery = NULL, *tmpl = NULL;
 
-    /* query becomes NULL or refcount +1, so good to XDECREF at the end */
-    if (!(query = curs_validate_sql_basic(self, query))) {
+    /* tmpl becomes NULL or refcount +1, so good to XDECREF at the end */
+    if (!(tmpl = _psyco_curs_get_template(self, query, vars))) {
         goto exit;
     }
 
@@ -394,20 +783,8 @@ _psyco_curs_execute(cursorObject *self,
     /* here we are, and we have a sequence or a dictionary filled with
        objects to be substituted (bound variables). we try to be smart and do
        the right thing (i.e., what the user expects) */
-    if (vars && vars != Py_None)
-    {
-        if (0 > _mogrify(vars, query, self, &cvt)) { goto exit; }
-    }
-
-    /* Merge the query to the arguments if needed */
-    if (cvt) {
-        if (!(fquery = _psyco_curs_merge_query_args(self, query, cvt))) {
-            goto exit;
-        }
-    }
-    else {
-        Py_INCREF(query);
-        fquery = query;
+    if (!(fquery = _psyco_curs_template_merge(self, tmpl, vars))) {
+        goto exit;
     }
 
     if (self->qname != NULL) {
@@ -451,9 +828,8 @@ _psyco_curs_execute(cursorObject *self,
     res = 0; /* Success */
 
 exit:
-    Py_XDECREF(query);
+    Py_XDECREF(tmpl);
     Py_XDECREF(fquery);
-    Py_XDECREF(cvt);
 
     return res;
 }
@@ -564,41 +940,21 @@ static PyObject *
 _psyco_curs_mogrify(cursorObject *self,
                    PyObject *operation, PyObject *vars)
 {
-    PyObject *fquery = NULL, *cvt = NULL;
+    PyObject *fquery = NULL, *tmpl = NULL;
 
-    operation = curs_validate_sql_basic(self, operation);
-    if (operation == NULL) { goto cleanup; }
+    if (!(tmpl = _psyco_curs_get_template(self, operation, vars))) {
+        goto cleanup;
+    }
 
     Dprintf("curs_mogrify: starting mogrify");
 
     /* here we are, and we have a sequence or a dictionary filled with
        objects to be substituted (bound variables). we try to be smart and do
        the right thing (i.e., what the user expects) */
-
-    if (vars && vars != Py_None)
-    {
-        if (0 > _mogrify(vars, operation, self, &cvt)) {
-            goto cleanup;
-        }
-    }
-
-    if (vars && cvt) {
-        if (!(fquery = _psyco_curs_merge_query_args(self, operation, cvt))) {
-            goto cleanup;
-        }
-
-        Dprintf("curs_mogrify: cvt->refcnt = " FORMAT_CODE_PY_SSIZE_T
-            ", fquery->refcnt = " FORMAT_CODE_PY_SSIZE_T,
-            Py_REFCNT(cvt), Py_REFCNT(fquery));
-    }
-    else {
-        fquery = operation;
-        Py_INCREF(fquery);
-    }
+    fquery = _psyco_curs_template_merge(self, tmpl, vars);
 
 cleanup:
-    Py_XDECREF(operation);
-    Py_XDECREF(cvt);
+    Py_XDECREF(tmpl);
 
     return fquery;
 }
@@ -633,12 +989,15 @@ curs_cast(cursorObject *self, PyObject *args)
     PyObject *oid;
     PyObject *s;
     PyObject *cast;
+    PyObject *rv;
 
     if (!PyArg_ParseTuple(args, "OO", &oid, &s))
         return NULL;
 
-    cast = curs_get_cast(self, oid);
-    return PyObject_CallFunctionObjArgs(cast, s, (PyObject *)self, NULL);
+    if (!(cast = curs_get_cast(self, oid))) { return NULL; }
+    rv = PyObject_CallFunctionObjArgs(cast, s, (PyObject *)self, NULL);
+    Py_DECREF(cast);
+    return rv;
 }
 
 
@@ -667,33 +1026,67 @@ _psyco_curs_prefetch(cursorObject *self)
     return i;
 }
 
+/* a value converted before building the row, see _psyco_curs_stage_rows() */
+typedef struct {
+    int kind;               /* TYPECAST_STAGE_*, NONE if not converted */
+    long long ival;         /* the value of an integer */
+    char *buf;              /* the decoded bytea, owned until used */
+    Py_ssize_t len;
+} stagedValue;
+
 RAISES_NEG static int
 _psyco_curs_buildrow_fill(cursorObject *self, PyObject *res,
-                          int row, int n, int istuple)
+                          int row, int n, int istuple, stagedValue *staged)
 {
     int i, len, err;
     const char *str;
+    typecast_function ccast;
     PyObject *val;
     int rv = -1;
 
     for (i=0; i < n; i++) {
-        if (PQgetisnull(self->pgres, row, i)) {
-            str = NULL;
-            len = 0;
+        /* use the value already converted without the GIL, if any */
+        if (staged && staged[i].kind) {
+            if (staged[i].kind == TYPECAST_STAGE_INT) {
+                val = PyLong_FromLongLong(staged[i].ival);
+            }
+            else {
+                val = typecast_binary_from_buffer(staged[i].buf, staged[i].len);
+                staged[i].buf = NULL;
+            }
+            goto setval;
         }
-        else {
-            str = PQgetvalue(self->pgres, row, i);
-            len = PQgetlength(self->pgres, row, i);
+
+        /* PQgetvalue returns an empty string for NULL values: check for
+         * nulls only on empty values */
+        str = PQgetvalue(self->pgres, row, i);
+        len = PQgetlength(self->pgres, row, i);
+        if (len == 0 && PQgetisnull(self->pgres, row, i)) {
+            str = NULL;
         }
 
         Dprintf("_psyco_curs_buildrow: row %ld, element %d, len %d",
                 self->row, i, len);
 
-        if (!(val = typecast_cast(PyTuple_GET_ITEM(self->casts, i), str, len,
-                            (PyObject*)self))) {
-            goto exit;
+        /* call the C typecasters directly, without the typecast_cast()
+         * dispatch: they would return None anyway on NULL */
+        if ((ccast = self->ccasts[i])) {
+            if (str) {
+                val = ccast(str, len, (PyObject *)self);
+            }
+            else {
+                Py_INCREF(Py_None);
+                val = Py_None;
+            }
+        }
+        else {
+            val = typecast_cast(PyTuple_GET_ITEM(self->casts, i), str, len,
+                                (PyObject*)self);
         }
 
+setval:
+        if (!val) { goto exit; }
+
         Dprintf("_psyco_curs_buildrow: val->refcnt = "
             FORMAT_CODE_PY_SSIZE_T,
             Py_REFCNT(val)
@@ -715,7 +1108,7 @@ exit:
 }
 
 static PyObject *
-_psyco_curs_buildrow(cursorObject *self, int row)
+_psyco_curs_buildrow(cursorObject *self, int row, stagedValue *staged)
 {
     int n;
     int istuple;
@@ -733,7 +1126,7 @@ _psyco_curs_buildrow(cursorObject *self, int row)
     }
     if (!t) { goto exit; }
 
-    if (0 <= _psyco_curs_buildrow_fill(self, t, row, n, istuple)) {
+    if (0 <= _psyco_curs_buildrow_fill(self, t, row, n, istuple, staged)) {
         rv = t;
         t = NULL;
     }
@@ -744,6 +1137,174 @@ exit:
 
 }
 
+/* Convert the values of a block of rows that don't need the GIL.
+ *
+ * Fill 'staged' (nrows * nfields items) with the values of the integer and
+ * hex bytea columns from row 'first'. The conversion is done in a separate
+ * phase, releasing the GIL if there is enough data to convert, so that
+ * threads fetching from different connections can run in parallel; only
+ * the creation of the Python objects needs the GIL afterwards. Items not
+ * converted are left with kind TYPECAST_STAGE_NONE.
+ */
+
+#define CURS_STAGE_ROWS 1000
+#define CURS_STAGE_NOGIL_SIZE 65536
+
+/* The part of _psyco_curs_stage_rows() not using the Python API. */
+static void
+_psyco_curs_stage_values(PGresult *pgres, const int *kinds,
+                         stagedValue *staged, int first, int nrows, int nfields)
+{
+    stagedValue *sv;
+    const char *str;
+    int row, i, len;
+
+    for (row = 0; row < nrows; row++) {
+        for (i = 0; i < nfields; i++) {
+            sv = staged + row * nfields + i;
+            str = PQgetvalue(pgres, first + row, i);
+            len = PQgetlength(pgres, first + row, i);
+
+            switch (kinds[i]) {
+            case TYPECAST_STAGE_INT:
+                if (len && typecast_int_parse(str, len, &sv->ival)) {
+                    sv->kind = TYPECAST_STAGE_INT;
+                }
+                break;
+            case TYPECAST_STAGE_BINARY:
+                if (sv->buf) {
+                    sv->len = typecast_binary_parse_hex(str, len, sv->buf);
+                    sv->kind = TYPECAST_STAGE_BINARY;
+                }
+                break;
+            }
+        }
+    }
+}
+
+static int
+_psyco_curs_stage_rows(cursorObject *self, const int *kinds,
+                       stagedValue *staged, int first, int nrows, int nfields)
+{
+    PGresult *pgres = self->pgres;
+    stagedValue *sv;
+    const char *str;
+    Py_ssize_t size = 0;
+    int row, i, len;
+    int rv = -1;
+
+    /* allocate the buffers for bytea: it needs the GIL */
+    for (row = 0; row < nrows; row++) {
+        for (i = 0; i < nfields; i++) {
+            sv = staged + row * nfields + i;
+            sv->kind = TYPECAST_STAGE_NONE;
+            sv->buf = NULL;
+            if (kinds[i] == TYPECAST_STAGE_NONE) { continue; }
+
+            len = PQgetlength(pgres, first + row, i);
+            size += len;
+            if (kinds[i] != TYPECAST_STAGE_BINARY
+                    || PQgetisnull(pgres, first + row, i)) {
+                continue;
+            }
+            str = PQgetvalue(pgres, first + row, i);
+            if (0 > (sv->len = typecast_binary_hex_size(str, len))) {
+                continue;
+            }
+            if (!(sv->buf = PyMem_Malloc(sv->len ? sv->len : 1))) {
+                PyErr_NoMemory();
+                goto exit;
+            }
+        }
+    }
+
+    if (size >= CURS_STAGE_NOGIL_SIZE) {
+        Py_BEGIN_ALLOW_THREADS;
+        _psyco_curs_stage_values(pgres, kinds, staged, first, nrows, nfields);
+        Py_END_ALLOW_THREADS;
+    }
+    else {
+        _psyco_curs_stage_values(pgres, kinds, staged, first, nrows, nfields);
+    }
+
+    rv = 0;
+
+exit:
+    return rv;
+}
+
+/* Release the bytea buffers staged and not consumed. */
+static void
+_psyco_curs_stage_clear(stagedValue *staged, int nitems)
+{
+    int i;
+
+    for (i = 0; i < nitems; i++) {
+        PyMem_Free(staged[i].buf);
+        staged[i].buf = NULL;
+        staged[i].kind = TYPECAST_STAGE_NONE;
+    }
+}
+
+/* Build 'size' rows from the current one into 'list' */
+static int
+_psyco_curs_buildrows(cursorObject *self, PyObject *list, int size)
+{
+    int i, n, nrows = 0, nstaged = 0;
+    int *kinds = NULL;
+    stagedValue *staged = NULL;
+    PyObject *row;
+    int rv = -1;
+
+    n = PQnfields(self->pgres);
+    if (self->ccasts && size > 1) {
+        if (!(kinds = PyMem_New(int, n))) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        for (i = 0; i < n; i++) {
+            kinds[i] = self->ccasts[i]
+                ? typecast_stage_kind(self->ccasts[i]) : TYPECAST_STAGE_NONE;
+            if (kinds[i]) { nstaged++; }
+        }
+    }
+    if (nstaged) {
+        nrows = size < CURS_STAGE_ROWS ? size : CURS_STAGE_ROWS;
+        if (!(staged = PyMem_New(stagedValue, nrows * n))) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        memset(staged, 0, nrows * n * sizeof(stagedValue));
+    }
+
+    for (i = 0; i < size; i++) {
+        if (staged && i % CURS_STAGE_ROWS == 0) {
+            nrows = size - i < CURS_STAGE_ROWS ? size - i : CURS_STAGE_ROWS;
+            if (0 > _psyco_curs_stage_rows(
+                    self, kinds, staged, self->row, nrows, n)) {
+                goto exit;
+            }
+        }
+
+        row = _psyco_curs_buildrow(self, self->row,
+            staged ? staged + (i % CURS_STAGE_ROWS) * n : NULL);
+        self->row++;
+        if (row == NULL) { goto exit; }
+
+        PyList_SET_ITEM(list, i, row);
+    }
+
+    rv = 0;
+
+exit:
+    if (staged) {
+        _psyco_curs_stage_clear(staged, nrows * n);
+    }
+    PyMem_Free(staged);
+    PyMem_Free(kinds);
+    return rv;
+}
+
 static PyObject *
 curs_fetchone(cursorObject *self, PyObject *dummy)
 {
@@ -772,7 +1333,7 @@ curs_fetchone(cursorObject *self, PyObject *dummy)
         Py_RETURN_NONE;
     }
 
-    res = _psyco_curs_buildrow(self, self->row);
+    res = _psyco_curs_buildrow(self, self->row, NULL);
     self->row++; /* move the counter to next line */
 
     /* if the query was async aggresively free pgres, to allow
@@ -819,7 +1380,7 @@ curs_next_named(cursorObject *self)
         return NULL;
     }
 
-    res = _psyco_curs_buildrow(self, self->row);
+    res = _psyco_curs_buildrow(self, self->row, NULL);
     self->row++; /* move the counter to next line */
 
     /* if the query was async aggresively free pgres, to allow
@@ -845,9 +1406,7 @@ curs_next_named(cursorObject *self)
 static PyObject *
 curs_fetchmany(cursorObject *self, PyObject *args, PyObject *kwords)
 {
-    int i;
     PyObject *list = NULL;
-    PyObject *row = NULL;
     PyObject *rv = NULL;
 
     PyObject *pysize = NULL;
@@ -897,15 +1456,7 @@ curs_fetchmany(cursorObject *self, PyObject *args, PyObject *kwords)
 
     if (!(list = PyList_New(size))) { goto exit; }
 
-    for (i = 0; i < size; i++) {
-        row = _psyco_curs_buildrow(self, self->row);
-        self->row++;
-
-        if (row == NULL) { goto exit; }
-
-        PyList_SET_ITEM(list, i, row);
-    }
-    row = NULL;
+    if (0 > _psyco_curs_buildrows(self, list, (int)size)) { goto exit; }
 
     /* if the query was async aggresively free pgres, to allow
        successive requests to reallocate it */
@@ -920,7 +1471,6 @@ curs_fetchmany(cursorObject *self, PyObject *args, PyObject *kwords)
 
 exit:
     Py_XDECREF(list);
-    Py_XDECREF(row);
 
     return rv;
 }
@@ -938,9 +1488,8 @@ exit:
 static PyObject *
 curs_fetchall(cursorObject *self, PyObject *dummy)
 {
-    int i, size;
+    int size;
     PyObject *list = NULL;
-    PyObject *row = NULL;
     PyObject *rv = NULL;
 
     EXC_IF_CURS_CLOSED(self);
@@ -967,14 +1516,7 @@ curs_fetchall(cursorObject *self, PyObject *dummy)
 
     if (!(list = PyList_New(size))) { goto exit; }
 
-    for (i = 0; i < size; i++) {
-        row = _psyco_curs_buildrow(self, self->row);
-        self->row++;
-        if (row == NULL) { goto exit; }
-
-        PyList_SET_ITEM(list, i, row);
-    }
-    row = NULL;
+    if (0 > _psyco_curs_buildrows(self, list, (int)size)) { goto exit; }
 
     /* if the query was async aggresively free pgres, to allow
        successive requests to reallocate it */
@@ -989,7 +1531,6 @@ curs_fetchall(cursorObject *self, PyObject *dummy)
 
 exit:
     Py_XDECREF(list);
-    Py_XDECREF(row);
 
     return rv;
 }
@@ -1977,6 +2518,8 @@ cursor_clear(cursorObject *self)
     Py_CLEAR(self->description);
     Py_CLEAR(self->pgstatus);
     Py_CLEAR(self->casts);
+    PyMem_Free(self->ccasts);
+    self->ccasts = NULL;
     Py_CLEAR(self->caster);
     Py_CLEAR(self->copyfile);
     Py_CLEAR(self->tuple_factory);
@@ -31,32 +31,6 @@
 #include "psycopg/error.h"
 
 
-/* These constants are defined in src/include/postgres_ext.h but some may not
- * be available with the libpq we currently support at compile time. */
-
-/* Available from PG 9.3 */
-#ifndef PG_DIAG_SCHEMA_NAME
-#define PG_DIAG_SCHEMA_NAME     's'
-#endif
-#ifndef PG_DIAG_TABLE_NAME
-#define PG_DIAG_TABLE_NAME      't'
-#endif
-#ifndef PG_DIAG_COLUMN_NAME
-#define PG_DIAG_COLUMN_NAME     'c'
-#endif
-#ifndef PG_DIAG_DATATYPE_NAME
-#define PG_DIAG_DATATYPE_NAME   'd'
-#endif
-#ifndef PG_DIAG_CONSTRAINT_NAME
-#define PG_DIAG_CONSTRAINT_NAME 'n'
-#endif
-
-/* Available from PG 9.6 */
-#ifndef PG_DIAG_SEVERITY_NONLOCALIZED
-#define PG_DIAG_SEVERITY_NONLOCALIZED 'V'
-#endif
-
-
 /* Retrieve an error string from the exception's cursor.
  *
  * If the cursor or its result isn't available, return None.
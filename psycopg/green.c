@@ -34,6 +34,17 @@
 
 HIDDEN PyObject *wait_callback = NULL;
 
+/* In free-threaded builds the callback can be replaced by a thread while
+ * another one is about to use it. */
+#ifdef Py_GIL_DISABLED
+static PyMutex wait_callback_mutex;
+#define wait_callback_lock() PyMutex_Lock(&wait_callback_mutex)
+#define wait_callback_unlock() PyMutex_Unlock(&wait_callback_mutex)
+#else
+#define wait_callback_lock()
+#define wait_callback_unlock()
+#endif
+
 static PyObject *have_wait_callback(void);
 static void green_panic(connectionObject *conn);
 
@@ -44,16 +55,21 @@ static void green_panic(connectionObject *conn);
 PyObject *
 psyco_set_wait_callback(PyObject *self, PyObject *obj)
 {
-    Py_XDECREF(wait_callback);
+    PyObject *old;
 
     if (obj != Py_None) {
-        wait_callback = obj;
         Py_INCREF(obj);
     }
     else {
-        wait_callback = NULL;
+        obj = NULL;
     }
 
+    wait_callback_lock();
+    old = wait_callback;
+    wait_callback = obj;
+    wait_callback_unlock();
+
+    Py_XDECREF(old);
     Py_RETURN_NONE;
 }
 
@@ -67,12 +83,14 @@ psyco_get_wait_callback(PyObject *self, PyObject *obj)
 {
     PyObject *ret;
 
+    wait_callback_lock();
     ret = wait_callback;
     if (!ret) {
         ret = Py_None;
     }
-
     Py_INCREF(ret);
+    wait_callback_unlock();
+
     return ret;
 }
 
@@ -95,12 +113,15 @@ have_wait_callback()
 {
     PyObject *cb;
 
+    wait_callback_lock();
     cb = wait_callback;
+    Py_XINCREF(cb);
+    wait_callback_unlock();
+
     if (!cb) {
         PyErr_SetString(OperationalError, "wait callback not available");
         return NULL;
     }
-    Py_INCREF(cb);
     return cb;
 }
 
@@ -39,6 +39,11 @@
 #else
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
 #endif
 
 /* support routines taken from pg_basebackup/streamutil.c */
@@ -64,6 +69,23 @@ feGetCurrentTimestamp(void)
     return result;
 }
 
+/*
+ * Return the time of a monotonic clock in microseconds, to measure
+ * intervals unaffected by changes of the system clock.
+ */
+int64_t
+fe_monotonic_usec(void)
+{
+#ifdef _WIN32
+    return (int64_t)GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * USECS_PER_SEC + ts.tv_nsec / 1000;
+#endif
+}
+
 /*
  * Converts an int64 to network byte order.
  */
@@ -104,3 +126,89 @@ fe_recvint64(char *buf)
 
     return result;
 }
+
+#if !defined(_MSC_VER) && !defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+/* 32 bits targets without 64 bits atomic instructions (e.g. mips, ppc32)
+ * would need libatomic for the __atomic builtins on a LSN: use a lock. */
+#define LSN_ATOMIC_LOCK 1
+static pthread_mutex_t lsn_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * Read a LSN which might be concurrently advanced by another thread.
+ */
+XLogRecPtr
+lsn_atomic_load(XLogRecPtr *ptr)
+{
+#if defined(_MSC_VER)
+    return (XLogRecPtr)_InterlockedCompareExchange64(
+        (volatile __int64 *)ptr, 0, 0);
+#elif defined(LSN_ATOMIC_LOCK)
+    XLogRecPtr rv;
+
+    pthread_mutex_lock(&lsn_lock);
+    rv = *ptr;
+    pthread_mutex_unlock(&lsn_lock);
+    return rv;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/*
+ * Move a LSN forward to 'lsn', leave it alone if it is already further.
+ */
+void
+lsn_atomic_advance(XLogRecPtr *ptr, XLogRecPtr lsn)
+{
+#ifdef LSN_ATOMIC_LOCK
+    pthread_mutex_lock(&lsn_lock);
+    if (lsn > *ptr) {
+        *ptr = lsn;
+    }
+    pthread_mutex_unlock(&lsn_lock);
+#else
+    XLogRecPtr curr = lsn_atomic_load(ptr);
+
+    while (lsn > curr) {
+#ifdef _MSC_VER
+        XLogRecPtr prev = (XLogRecPtr)_InterlockedCompareExchange64(
+            (volatile __int64 *)ptr, (__int64)lsn, (__int64)curr);
+        if (prev == curr) { break; }
+        curr = prev;
+#else
+        /* on failure curr is updated to the current value */
+        if (__atomic_compare_exchange_n(ptr, &curr, lsn, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+#endif
+    }
+#endif
+}
+
+/*
+ * Set some bits in a flags word.
+ */
+void
+flags_atomic_set(int *ptr, int flags)
+{
+#ifdef _MSC_VER
+    _InterlockedOr((volatile long *)ptr, flags);
+#else
+    __atomic_fetch_or(ptr, flags, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/*
+ * Return the flags set and reset them.
+ */
+int
+flags_atomic_take(int *ptr)
+{
+#ifdef _MSC_VER
+    return (int)_InterlockedExchange((volatile long *)ptr, 0);
+#else
+    return __atomic_exchange_n(ptr, 0, __ATOMIC_ACQ_REL);
+#endif
+}
@@ -43,7 +43,15 @@ typedef uint64_t XLogRecPtr;
 #define USECS_PER_SEC	1000000LL
 
 HIDDEN int64_t feGetCurrentTimestamp(void);
+HIDDEN int64_t fe_monotonic_usec(void);
 HIDDEN void fe_sendint64(int64_t i, char *buf);
 HIDDEN int64_t fe_recvint64(char *buf);
 
+/* Lock-free access to the values shared between the replication loop and
+ * the threads confirming the LSNs processed. */
+HIDDEN XLogRecPtr lsn_atomic_load(XLogRecPtr *ptr);
+HIDDEN void lsn_atomic_advance(XLogRecPtr *ptr, XLogRecPtr lsn);
+HIDDEN void flags_atomic_set(int *ptr, int flags);
+HIDDEN int flags_atomic_take(int *ptr);
+
 #endif /* !defined(PSYCOPG_LIBPQ_SUPPORT_H) */
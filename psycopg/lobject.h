@@ -89,6 +89,15 @@ if (self->conn->mark != self->mark) {                  \
     return NULL;                                       \
 }
 
+/* Size of the chunks to split the large writes into, and number of chunks
+ * sent in pipeline before waiting for their results */
+#define LOBJECT_WRITE_CHUNK (1024 * 1024)
+#define LOBJECT_WRITE_PIPELINE 8
+
+/* Largest write without pipelining: the server refuses messages of 1GB or
+ * more, leave some room for the message header */
+#define LOBJECT_WRITE_MAX (1024 * 1024 * 1024 - 1024)
+
 /* Values for the lobject mode */
 #define LOBJECT_READ  1
 #define LOBJECT_WRITE 2
@@ -30,6 +30,7 @@
 #include "psycopg/lobject.h"
 #include "psycopg/connection.h"
 #include "psycopg/pqpath.h"
+#include "psycopg/pgtypes.h"
 
 #include <string.h>
 
@@ -311,7 +312,131 @@ lobject_unlink(lobjectObject *self)
     return retvalue;
 }
 
-/* lobject_write - write bytes to a lo */
+#ifdef LIBPQ_HAS_PIPELINING
+
+/* Write a buffer to a lo in chunks of LOBJECT_WRITE_CHUNK bytes.
+ *
+ * The chunks are written with lowrite() queries sent in pipeline mode, so
+ * the server doesn't need to receive the whole buffer in a single message.
+ * At most LOBJECT_WRITE_PIPELINE chunks are sent before a sync and reading
+ * their results: the server never stalls writing results we don't read
+ * while we are still sending to it.
+ *
+ * Return the number of bytes written, -1 on error (with the connection
+ * error set, or the error result stored in conn->pgres).
+ */
+static Py_ssize_t
+_lobject_write_pipeline_locked(lobjectObject *self, const char *buf, size_t len)
+{
+    PGconn *pgconn = self->conn->pgconn;
+    static const Oid types[2] = {INT4OID, BYTEAOID};
+    static const int formats[2] = {1, 1};
+    const char *values[2];
+    int lengths[2];
+    char fdbuf[4];
+    const unsigned char *val;
+    PGresult *pgres;
+    size_t sent = 0, n;
+    Py_ssize_t written = 0;
+    int failed = 0, inflight, synced;
+
+    if (!PQenterPipelineMode(pgconn)) {
+        collect_error(self->conn);
+        return -1;
+    }
+
+    /* the lo descriptor as binary int4 */
+    fdbuf[0] = (char)((self->fd >> 24) & 0xFF);
+    fdbuf[1] = (char)((self->fd >> 16) & 0xFF);
+    fdbuf[2] = (char)((self->fd >> 8) & 0xFF);
+    fdbuf[3] = (char)(self->fd & 0xFF);
+    values[0] = fdbuf;
+    lengths[0] = 4;
+
+    while (sent < len && !failed) {
+        for (inflight = 0;
+                sent < len && inflight < LOBJECT_WRITE_PIPELINE; inflight++) {
+            n = len - sent;
+            if (n > LOBJECT_WRITE_CHUNK) { n = LOBJECT_WRITE_CHUNK; }
+            values[1] = buf + sent;
+            lengths[1] = (int)n;
+            if (!PQsendQueryParams(pgconn,
+                    "SELECT pg_catalog.lowrite($1, $2)",
+                    2, types, values, lengths, formats, 1)) {
+                collect_error(self->conn);
+                failed = 1;
+                break;
+            }
+            sent += n;
+        }
+
+        if (!PQpipelineSync(pgconn)) {
+            /* the connection is broken: there is nothing to wait for */
+            collect_error(self->conn);
+            return -1;
+        }
+
+        /* Consume all the results up to the sync point, keeping the first
+         * error. After an error the following queries are aborted. */
+        for (synced = 0; !synced;) {
+            if (!(pgres = PQgetResult(pgconn))) {
+                if (PQstatus(pgconn) == CONNECTION_BAD) {
+                    collect_error(self->conn);
+                    return -1;
+                }
+                continue;
+            }
+
+            switch (PQresultStatus(pgres)) {
+            case PGRES_TUPLES_OK:
+                if (PQntuples(pgres) == 1 && PQgetlength(pgres, 0, 0) == 4) {
+                    val = (const unsigned char *)PQgetvalue(pgres, 0, 0);
+                    written += ((Py_ssize_t)val[0] << 24) | (val[1] << 16)
+                        | (val[2] << 8) | val[3];
+                }
+                PQclear(pgres);
+                break;
+
+            case PGRES_PIPELINE_SYNC:
+                PQclear(pgres);
+                synced = 1;
+                break;
+
+            case PGRES_FATAL_ERROR:
+                if (!failed) {
+                    conn_set_result(self->conn, pgres);
+                    failed = 1;
+                }
+                else {
+                    PQclear(pgres);
+                }
+                break;
+
+            default:
+                /* PGRES_PIPELINE_ABORTED */
+                failed = 1;
+                PQclear(pgres);
+                break;
+            }
+        }
+    }
+
+    if (!PQexitPipelineMode(pgconn) && !failed) {
+        collect_error(self->conn);
+        failed = 1;
+    }
+
+    return failed ? -1 : written;
+}
+
+#endif  /* LIBPQ_HAS_PIPELINING */
+
+/* lobject_write - write bytes to a lo
+ *
+ * Buffers larger than LOBJECT_WRITE_CHUNK are written in chunks in pipeline
+ * if the libpq supports it. Otherwise only the buffers too large for a
+ * single message are split.
+ */
 
 RAISES_NEG Py_ssize_t
 lobject_write(lobjectObject *self, const char *buf, size_t len)
@@ -324,9 +449,32 @@ lobject_write(lobjectObject *self, const char *buf, size_t len)
     Py_BEGIN_ALLOW_THREADS;
     pthread_mutex_lock(&(self->conn->lock));
 
-    written = lo_write(self->conn->pgconn, self->fd, buf, len);
-    if (written < 0)
-        collect_error(self->conn);
+#ifdef LIBPQ_HAS_PIPELINING
+    if (len > LOBJECT_WRITE_CHUNK) {
+        written = _lobject_write_pipeline_locked(self, buf, len);
+    }
+    else {
+        written = lo_write(self->conn->pgconn, self->fd, buf, len);
+        if (written < 0)
+            collect_error(self->conn);
+    }
+#else
+    written = 0;
+    while ((size_t)written < len) {
+        size_t n = len - written;
+        Py_ssize_t rv;
+
+        if (n > LOBJECT_WRITE_MAX) { n = LOBJECT_WRITE_MAX; }
+        rv = lo_write(self->conn->pgconn, self->fd, buf + written, n);
+        if (rv < 0) {
+            collect_error(self->conn);
+            written = -1;
+            break;
+        }
+        written += rv;
+        if ((size_t)rv < n) { break; }
+    }
+#endif
 
     pthread_mutex_unlock(&(self->conn->lock));
     Py_END_ALLOW_THREADS;
@@ -64,7 +64,7 @@ psyco_lobj_close(lobjectObject *self, PyObject *args)
 /* write method - write data to the lobject */
 
 #define psyco_lobj_write_doc \
-"write(str | bytes) -- Write a string or bytes to the large object."
+"write(str | bytes) -- Write a string or bytes-like object to the large object."
 
 static PyObject *
 psyco_lobj_write(lobjectObject *self, PyObject *args)
@@ -75,6 +75,9 @@ psyco_lobj_write(lobjectObject *self, PyObject *args)
     PyObject *obj;
     PyObject *data = NULL;
     PyObject *rv = NULL;
+    Py_buffer view;
+
+    view.obj = NULL;
 
     if (!PyArg_ParseTuple(args, "O", &obj)) return NULL;
 
@@ -82,12 +85,18 @@ psyco_lobj_write(lobjectObject *self, PyObject *args)
     EXC_IF_LOBJ_LEVEL0(self);
     EXC_IF_LOBJ_UNMARKED(self);
 
-    if (Bytes_Check(obj)) {
-        Py_INCREF(obj);
-        data = obj;
-    }
-    else if (PyUnicode_Check(obj)) {
+    if (PyUnicode_Check(obj)) {
         if (!(data = conn_encode(self->conn, obj))) { goto exit; }
+        if (-1 == Bytes_AsStringAndSize(data, &buffer, &len)) {
+            goto exit;
+        }
+    }
+    else if (PyObject_CheckBuffer(obj)) {
+        if (0 > PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE)) {
+            goto exit;
+        }
+        buffer = view.buf;
+        len = view.len;
     }
     else {
         PyErr_Format(PyExc_TypeError,
@@ -96,10 +105,6 @@ psyco_lobj_write(lobjectObject *self, PyObject *args)
         goto exit;
     }
 
-    if (-1 == Bytes_AsStringAndSize(data, &buffer, &len)) {
-        goto exit;
-    }
-
     if (0 > (res = lobject_write(self, buffer, (size_t)len))) {
         goto exit;
     }
@@ -107,6 +112,7 @@ psyco_lobj_write(lobjectObject *self, PyObject *args)
     rv = PyInt_FromSsize_t((Py_ssize_t)res);
 
 exit:
+    if (view.obj) { PyBuffer_Release(&view); }
     Py_XDECREF(data);
     return rv;
 }
@@ -156,6 +162,33 @@ psyco_lobj_read(lobjectObject *self, PyObject *args)
     return res;
 }
 
+/* readinto method - read data from the lobject into a buffer */
+
+#define psyco_lobj_readinto_doc \
+"readinto(buffer) -- Read bytes into a writable buffer, return the number of bytes read."
+
+static PyObject *
+psyco_lobj_readinto(lobjectObject *self, PyObject *args)
+{
+    Py_buffer view;
+    Py_ssize_t size;
+
+    EXC_IF_LOBJ_CLOSED(self);
+    EXC_IF_LOBJ_LEVEL0(self);
+    EXC_IF_LOBJ_UNMARKED(self);
+
+    if (!PyArg_ParseTuple(args, "w*", &view)) return NULL;
+
+    /* the data is not decoded in text mode: there is no buffer to copy */
+    size = lobject_read(self, view.buf, (size_t)view.len);
+    PyBuffer_Release(&view);
+    if (size < 0) {
+        return NULL;
+    }
+
+    return PyInt_FromSsize_t(size);
+}
+
 /* seek method - seek in the lobject */
 
 #define psyco_lobj_seek_doc \
@@ -308,6 +341,8 @@ psyco_lobj_truncate(lobjectObject *self, PyObject *args)
 static struct PyMethodDef lobjectObject_methods[] = {
     {"read", (PyCFunction)psyco_lobj_read,
      METH_VARARGS, psyco_lobj_read_doc},
+    {"readinto", (PyCFunction)psyco_lobj_readinto,
+     METH_VARARGS, psyco_lobj_readinto_doc},
     {"write", (PyCFunction)psyco_lobj_write,
      METH_VARARGS, psyco_lobj_write_doc},
     {"seek", (PyCFunction)psyco_lobj_seek,
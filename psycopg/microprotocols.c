@@ -37,13 +37,178 @@
 
 PyObject *psyco_adapters;
 
+/* Cache of the ISQLQuote adapters resolved for a type.
+ *
+ * Map a type to a tuple (adapter, exact, conform), where adapter is the
+ * adapter registered for the type (exact is True) or for its nearest
+ * superclass (exact is False), or None if no adapter is registered for the
+ * type mro; conform tells if the objects may have a __conform__ method.
+ * The cache is emptied on every change to the registry. It holds references
+ * to the types, so it is also emptied when it grows too big, in order to
+ * not leak dynamically created classes.
+ */
+static PyObject *adapters_cache;
+
+#define ADAPTERS_CACHE_MAXSIZE 1024
+
+static void
+adapters_cache_clear(void)
+{
+    if (adapters_cache) {
+        Py_BEGIN_CRITICAL_SECTION(adapters_cache);
+        PyDict_Clear(adapters_cache);
+        Py_END_CRITICAL_SECTION();
+    }
+}
+
+
+/** the adapters registry type
+ *
+ * A dict subclass emptying the adapters cache whenever it is changed, so
+ * that changes made from Python (register_adapter() or manipulating the
+ * adapters dict directly) are seen by microprotocols_adapt().
+ */
+
+static int
+adapters_ass_subscript(PyObject *self, PyObject *key, PyObject *value)
+{
+    int rv;
+
+    rv = PyDict_Type.tp_as_mapping->mp_ass_subscript(self, key, value);
+    adapters_cache_clear();
+    return rv;
+}
+
+static PyObject *
+adapters_inplace_or(PyObject *self, PyObject *other)
+{
+    PyObject *rv;
+
+    rv = PyDict_Type.tp_as_number->nb_inplace_or(self, other);
+    adapters_cache_clear();
+    return rv;
+}
+
+/* Call the dict method `name` on self, then empty the cache. */
+static PyObject *
+adapters_call_dict_method(
+    PyObject *self, const char *name, PyObject *args, PyObject *kwargs)
+{
+    PyObject *descr = NULL, *meth = NULL;
+    PyObject *rv = NULL;
+
+    if (!(descr = PyObject_GetAttrString((PyObject *)&PyDict_Type, name))) {
+        goto exit;
+    }
+    if (!(meth = Py_TYPE(descr)->tp_descr_get(
+            descr, self, (PyObject *)Py_TYPE(self)))) {
+        goto exit;
+    }
+    rv = PyObject_Call(meth, args, kwargs);
+    adapters_cache_clear();
+
+exit:
+    Py_XDECREF(meth);
+    Py_XDECREF(descr);
+    return rv;
+}
+
+#define ADAPTERS_DICT_METHOD(name) \
+static PyObject * \
+adapters_ ## name(PyObject *self, PyObject *args, PyObject *kwargs) \
+{ \
+    return adapters_call_dict_method(self, #name, args, kwargs); \
+}
+
+ADAPTERS_DICT_METHOD(clear)
+ADAPTERS_DICT_METHOD(pop)
+ADAPTERS_DICT_METHOD(popitem)
+ADAPTERS_DICT_METHOD(setdefault)
+ADAPTERS_DICT_METHOD(update)
+
+static struct PyMethodDef adaptersObject_methods[] = {
+    {"clear", (PyCFunction)adapters_clear,
+     METH_VARARGS|METH_KEYWORDS, NULL},
+    {"pop", (PyCFunction)adapters_pop,
+     METH_VARARGS|METH_KEYWORDS, NULL},
+    {"popitem", (PyCFunction)adapters_popitem,
+     METH_VARARGS|METH_KEYWORDS, NULL},
+    {"setdefault", (PyCFunction)adapters_setdefault,
+     METH_VARARGS|METH_KEYWORDS, NULL},
+    {"update", (PyCFunction)adapters_update,
+     METH_VARARGS|METH_KEYWORDS, NULL},
+    {NULL}
+};
+
+static PyMappingMethods adaptersObject_as_mapping = {
+    0,                                  /*mp_length*/
+    0,                                  /*mp_subscript*/
+    adapters_ass_subscript,             /*mp_ass_subscript*/
+};
+
+static PyNumberMethods adaptersObject_as_number = {
+    .nb_inplace_or = adapters_inplace_or,
+};
+
+static PyTypeObject adaptersType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2._psycopg.adapters_registry",
+    0, 0,
+    0,          /*tp_dealloc*/
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    0,          /*tp_repr*/
+    &adaptersObject_as_number, /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    &adaptersObject_as_mapping, /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT, /*tp_flags*/
+    "Registry of the object adapters", /*tp_doc*/
+    0,          /*tp_traverse*/
+    0,          /*tp_clear*/
+    0,          /*tp_richcompare*/
+    0,          /*tp_weaklistoffset*/
+    0,          /*tp_iter*/
+    0,          /*tp_iternext*/
+    adaptersObject_methods, /*tp_methods*/
+    0,          /*tp_members*/
+    0,          /*tp_getset*/
+    0,          /*tp_base*/
+    0,          /*tp_dict*/
+    0,          /*tp_descr_get*/
+    0,          /*tp_descr_set*/
+    0,          /*tp_dictoffset*/
+    0,          /*tp_init*/
+    0,          /*tp_alloc*/
+    0,          /*tp_new*/
+};
+
+
 /* microprotocols_init - initialize the adapters dictionary */
 
 RAISES_NEG int
 microprotocols_init(PyObject *module)
 {
+    Py_SET_TYPE(&adaptersType, &PyType_Type);
+    adaptersType.tp_base = &PyDict_Type;
+    if (0 > PyType_Ready(&adaptersType)) {
+        return -1;
+    }
+
+    if (!(adapters_cache = PyDict_New())) {
+        return -1;
+    }
+
     /* create adapters dictionary and put it in module namespace */
-    if (!(psyco_adapters = PyDict_New())) {
+    if (!(psyco_adapters = PyObject_CallObject(
+            (PyObject *)&adaptersType, NULL))) {
         return -1;
     }
 
@@ -75,26 +240,28 @@ microprotocols_add(PyTypeObject *type, PyObject *proto, PyObject *cast)
     rv = 0;
 
 exit:
+    adapters_cache_clear();
     Py_XDECREF(key);
     return rv;
 }
 
 /* Check if one of `obj` superclasses has an adapter for `proto`.
  *
- * If it does, return a *borrowed reference* to the adapter, else to None.
+ * If it does, return a new reference to the adapter, else to None.
  */
-BORROWED static PyObject *
+static PyObject *
 _get_superclass_adapter(PyObject *obj, PyObject *proto)
 {
     PyTypeObject *type;
     PyObject *mro, *st;
     PyObject *key, *adapter;
     Py_ssize_t i, ii;
+    int found;
 
     type = Py_TYPE(obj);
     if (!(type->tp_mro)) {
         /* has no mro */
-        return Py_None;
+        Py_RETURN_NONE;
     }
 
     /* Walk the mro from the most specific subclass. */
@@ -102,10 +269,11 @@ _get_superclass_adapter(PyObject *obj, PyObject *proto)
     for (i = 1, ii = PyTuple_GET_SIZE(mro); i < ii; ++i) {
         st = PyTuple_GET_ITEM(mro, i);
         if (!(key = PyTuple_Pack(2, st, proto))) { return NULL; }
-        adapter = PyDict_GetItem(psyco_adapters, key);
+        found = PyDict_GetItemRef(psyco_adapters, key, &adapter);
         Py_DECREF(key);
+        if (found < 0) { return NULL; }
 
-        if (adapter) {
+        if (found) {
             Dprintf(
                 "microprotocols_adapt: using '%s' adapter to adapt '%s'",
                 ((PyTypeObject *)st)->tp_name, type->tp_name);
@@ -124,7 +292,79 @@ _get_superclass_adapter(PyObject *obj, PyObject *proto)
             return adapter;
         }
     }
-    return Py_None;
+    Py_RETURN_NONE;
+}
+
+
+/* Return 1 if attributes can be added to the type after its creation. */
+static int
+_type_is_mutable(PyTypeObject *type)
+{
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+    return !(type->tp_flags & Py_TPFLAGS_IMMUTABLETYPE);
+#else
+    return (type->tp_flags & Py_TPFLAGS_HEAPTYPE) != 0;
+#endif
+}
+
+/* Return the cache entry for the ISQLQuote adapter of the type of `obj`.
+ *
+ * Look up the registry and the superclasses adapters only on cache miss.
+ * Return a new reference to the (adapter, exact, conform) tuple, NULL on
+ * error. `conform` is False if the objects of the type cannot have a
+ * __conform__ method. This is only known for types which can't change and
+ * whose objects have no instance dict: for the other ones a __conform__
+ * may be added later to the class or set on the object, so it is always
+ * looked up.
+ */
+static PyObject *
+_get_cached_adapter(PyObject *obj)
+{
+    PyObject *type = (PyObject *)Py_TYPE(obj);
+    PyObject *proto = (PyObject *)&isqlquoteType;
+    PyObject *entry = NULL, *key, *adapter = NULL;
+    int found, conform;
+
+    /* The registry is read and the cache is filled in the same critical
+     * section, so a cache clear following a registry change cannot be
+     * overwritten by an entry computed on the old registry. */
+    Py_BEGIN_CRITICAL_SECTION(adapters_cache);
+
+    if (0 != PyDict_GetItemRef(adapters_cache, type, &entry)) {
+        goto exit;
+    }
+
+    if (!(key = PyTuple_Pack(2, type, proto))) { goto exit; }
+    found = PyDict_GetItemRef(psyco_adapters, key, &adapter);
+    Py_DECREF(key);
+    if (found < 0) { goto exit; }
+    if (!found) {
+        if (!(adapter = _get_superclass_adapter(obj, proto))) {
+            goto exit;
+        }
+    }
+
+    conform = _type_is_mutable(Py_TYPE(obj))
+        || Py_TYPE(obj)->tp_dictoffset
+        || Py_TYPE(obj)->tp_getattro != PyObject_GenericGetAttr
+        || PyObject_HasAttrString(type, "__conform__");
+
+    if (!(entry = PyTuple_Pack(3, adapter, found ? Py_True : Py_False,
+            conform ? Py_True : Py_False))) {
+        goto exit;
+    }
+    if (PyDict_Size(adapters_cache) >= ADAPTERS_CACHE_MAXSIZE) {
+        PyDict_Clear(adapters_cache);
+    }
+    if (0 > PyDict_SetItem(adapters_cache, type, entry)) {
+        Py_CLEAR(entry);
+        goto exit;
+    }
+
+exit:
+    Py_END_CRITICAL_SECTION();
+    Py_XDECREF(adapter);
+    return entry;
 }
 
 
@@ -133,8 +373,10 @@ _get_superclass_adapter(PyObject *obj, PyObject *proto)
 PyObject *
 microprotocols_adapt(PyObject *obj, PyObject *proto, PyObject *alt)
 {
-    PyObject *adapter, *adapted, *key, *meth;
+    PyObject *adapter = NULL, *adapted = NULL, *key, *meth;
+    PyObject *cached = NULL;
     char buffer[256];
+    int found;
 
     /* we don't check for exact type conformance as specified in PEP 246
        because the ISQLQuote type is abstract and there is no way to get a
@@ -144,25 +386,41 @@ microprotocols_adapt(PyObject *obj, PyObject *proto, PyObject *alt)
         Py_TYPE(obj)->tp_name);
 
     /* look for an adapter in the registry */
-    if (!(key = PyTuple_Pack(2, Py_TYPE(obj), proto))) { return NULL; }
-    adapter = PyDict_GetItem(psyco_adapters, key);
-    Py_DECREF(key);
-    if (adapter) {
-        adapted = PyObject_CallFunctionObjArgs(adapter, obj, NULL);
-        return adapted;
+    if (proto == (PyObject *)&isqlquoteType) {
+        if (!(cached = _get_cached_adapter(obj))) { goto exit; }
+        if (PyTuple_GET_ITEM(cached, 1) == Py_True) {
+            adapter = PyTuple_GET_ITEM(cached, 0);
+            Py_INCREF(adapter);
+            adapted = PyObject_CallFunctionObjArgs(adapter, obj, NULL);
+            goto exit;
+        }
+    }
+    else {
+        if (!(key = PyTuple_Pack(2, Py_TYPE(obj), proto))) { goto exit; }
+        found = PyDict_GetItemRef(psyco_adapters, key, &adapter);
+        Py_DECREF(key);
+        if (found < 0) { goto exit; }
+        if (found) {
+            adapted = PyObject_CallFunctionObjArgs(adapter, obj, NULL);
+            goto exit;
+        }
     }
 
-    /* try to have the protocol adapt this object*/
-    if ((meth = PyObject_GetAttrString(proto, "__adapt__"))) {
+    /* try to have the protocol adapt this object. ISQLQuote is a C type
+       with no __adapt__ method: don't bother looking for it. */
+    if (cached) {
+        /* nothing to do */
+    }
+    else if ((meth = PyObject_GetAttrString(proto, "__adapt__"))) {
         adapted = PyObject_CallFunctionObjArgs(meth, obj, NULL);
         Py_DECREF(meth);
-        if (adapted && adapted != Py_None) return adapted;
-        Py_XDECREF(adapted);
+        if (adapted && adapted != Py_None) goto exit;
+        Py_CLEAR(adapted);
         if (PyErr_Occurred()) {
             if (PyErr_ExceptionMatches(PyExc_TypeError)) {
                PyErr_Clear();
             } else {
-                return NULL;
+                goto exit;
             }
         }
     }
@@ -172,16 +430,19 @@ microprotocols_adapt(PyObject *obj, PyObject *proto, PyObject *alt)
     }
 
     /* then try to have the object adapt itself */
-    if ((meth = PyObject_GetAttrString(obj, "__conform__"))) {
+    if (cached && PyTuple_GET_ITEM(cached, 2) != Py_True) {
+        /* the type doesn't have a __conform__ method */
+    }
+    else if ((meth = PyObject_GetAttrString(obj, "__conform__"))) {
         adapted = PyObject_CallFunctionObjArgs(meth, proto, NULL);
         Py_DECREF(meth);
-        if (adapted && adapted != Py_None) return adapted;
-        Py_XDECREF(adapted);
+        if (adapted && adapted != Py_None) goto exit;
+        Py_CLEAR(adapted);
         if (PyErr_Occurred()) {
             if (PyErr_ExceptionMatches(PyExc_TypeError)) {
                PyErr_Clear();
             } else {
-                return NULL;
+                goto exit;
             }
         }
     }
@@ -191,19 +452,27 @@ microprotocols_adapt(PyObject *obj, PyObject *proto, PyObject *alt)
     }
 
     /* Finally check if a superclass can be adapted and use the same adapter. */
-    if (!(adapter = _get_superclass_adapter(obj, proto))) {
-        return NULL;
+    if (cached) {
+        adapter = PyTuple_GET_ITEM(cached, 0);
+        Py_INCREF(adapter);
+    }
+    else if (!(adapter = _get_superclass_adapter(obj, proto))) {
+        goto exit;
     }
     if (Py_None != adapter) {
         adapted = PyObject_CallFunctionObjArgs(adapter, obj, NULL);
-        return adapted;
+        goto exit;
     }
 
     /* else set the right exception and return NULL */
     PyOS_snprintf(buffer, 255, "can't adapt type '%s'",
         Py_TYPE(obj)->tp_name);
     psyco_set_error(ProgrammingError, NULL, buffer);
-    return NULL;
+
+exit:
+    Py_XDECREF(adapter);
+    Py_XDECREF(cached);
+    return adapted;
 }
 
 /* microprotocol_getquoted - utility function that adapt and call getquoted.
@@ -0,0 +1,59 @@
+/* notice.h - definition for the psycopg Notice type
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#ifndef PSYCOPG_NOTICE_H
+#define PSYCOPG_NOTICE_H 1
+
+extern HIDDEN PyTypeObject noticeType;
+
+/* Number of strings stored for a notice: the message and the diag fields */
+#define NOTICE_NFIELDS 19
+
+/* The content of a notice received by libpq.
+ *
+ * The strings are copied into 'buf', which can be reused for the following
+ * notices. The functions handling the struct can be called without the GIL
+ * and use the C allocator.
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    int fields[NOTICE_NFIELDS];   /* offsets of the strings in buf, or -1 */
+} noticeData;
+
+typedef struct {
+    PyObject_HEAD
+
+    noticeData data;
+    PyObject *pydecoder;    /* codec to decode the strings, or NULL */
+
+} noticeObject;
+
+HIDDEN int notice_data_set(noticeData *data, const PGresult *res);
+HIDDEN const char *notice_data_message(const noticeData *data);
+HIDDEN void notice_data_free(noticeData *data);
+HIDDEN PyObject *notice_from_data(const noticeData *data, PyObject *pydecoder);
+
+#endif /* PSYCOPG_NOTICE_H */
@@ -0,0 +1,264 @@
+/* notice_type.c - python interface to the notices received
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#define PSYCOPG_MODULE
+#include "psycopg/psycopg.h"
+
+#include "psycopg/notice.h"
+#include "psycopg/diagnostics.h"
+
+#include <string.h>
+
+
+/* The fields stored in a noticeData, in order. 0 stands for the message. */
+static const int notice_codes[NOTICE_NFIELDS] = {
+    0,
+    PG_DIAG_SEVERITY,
+    PG_DIAG_SEVERITY_NONLOCALIZED,
+    PG_DIAG_SQLSTATE,
+    PG_DIAG_MESSAGE_PRIMARY,
+    PG_DIAG_MESSAGE_DETAIL,
+    PG_DIAG_MESSAGE_HINT,
+    PG_DIAG_STATEMENT_POSITION,
+    PG_DIAG_INTERNAL_POSITION,
+    PG_DIAG_INTERNAL_QUERY,
+    PG_DIAG_CONTEXT,
+    PG_DIAG_SCHEMA_NAME,
+    PG_DIAG_TABLE_NAME,
+    PG_DIAG_COLUMN_NAME,
+    PG_DIAG_DATATYPE_NAME,
+    PG_DIAG_CONSTRAINT_NAME,
+    PG_DIAG_SOURCE_FILE,
+    PG_DIAG_SOURCE_LINE,
+    PG_DIAG_SOURCE_FUNCTION,
+};
+
+
+/* Copy the content of a notice result into data.
+ *
+ * The buffer is only reallocated if the current one is too small. The
+ * function doesn't need the GIL. Return -1 on allocation failure, leaving
+ * the data empty.
+ */
+int
+notice_data_set(noticeData *data, const PGresult *res)
+{
+    const char *values[NOTICE_NFIELDS];
+    size_t lens[NOTICE_NFIELDS];
+    size_t size = 0, offset = 0;
+    char *buf;
+    int i;
+
+    for (i = 0; i < NOTICE_NFIELDS; i++) {
+        values[i] = notice_codes[i]
+            ? PQresultErrorField(res, notice_codes[i])
+            : PQresultErrorMessage(res);
+        lens[i] = values[i] ? strlen(values[i]) + 1 : 0;
+        size += lens[i];
+        data->fields[i] = -1;
+    }
+
+    if (size > data->size) {
+        if (!(buf = realloc(data->buf, size))) {
+            return -1;
+        }
+        data->buf = buf;
+        data->size = size;
+    }
+
+    for (i = 0; i < NOTICE_NFIELDS; i++) {
+        if (!values[i]) { continue; }
+        memcpy(data->buf + offset, values[i], lens[i]);
+        data->fields[i] = (int)offset;
+        offset += lens[i];
+    }
+
+    return 0;
+}
+
+/* Return the full text of the notice, or NULL if the data is empty. */
+const char *
+notice_data_message(const noticeData *data)
+{
+    if (!data->buf || data->fields[0] < 0) {
+        return NULL;
+    }
+    return data->buf + data->fields[0];
+}
+
+void
+notice_data_free(noticeData *data)
+{
+    free(data->buf);
+    data->buf = NULL;
+    data->size = 0;
+}
+
+/* Create a new Notice object from a copy of the data. */
+PyObject *
+notice_from_data(const noticeData *data, PyObject *pydecoder)
+{
+    noticeObject *self;
+
+    if (!(self = (noticeObject *)noticeType.tp_alloc(&noticeType, 0))) {
+        return NULL;
+    }
+
+    if (data->buf) {
+        if (!(self->data.buf = malloc(data->size))) {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+        memcpy(self->data.buf, data->buf, data->size);
+        self->data.size = data->size;
+    }
+    memcpy(self->data.fields, data->fields, sizeof(data->fields));
+
+    Py_XINCREF(pydecoder);
+    self->pydecoder = pydecoder;
+
+    return (PyObject *)self;
+}
+
+
+/* Decode a field of the notice on access; None if not available. */
+static PyObject *
+notice_get_field(noticeObject *self, void *closure)
+{
+    int offset = self->data.buf
+        ? self->data.fields[(int)(Py_intptr_t)closure] : -1;
+
+    if (offset < 0) {
+        Py_RETURN_NONE;
+    }
+    return psyco_text_from_chars_safe(
+        self->data.buf + offset, -1, self->pydecoder);
+}
+
+static PyObject *
+notice_str(noticeObject *self)
+{
+    PyObject *rv = notice_get_field(self, (void *)0);
+
+    if (rv == Py_None) {
+        Py_DECREF(rv);
+        rv = Text_FromUTF8("");
+    }
+    return rv;
+}
+
+static PyObject *
+notice_repr(noticeObject *self)
+{
+    PyObject *rv = NULL, *severity = NULL, *primary = NULL;
+
+    if (!(severity = notice_get_field(self, (void *)1))) { goto exit; }
+    if (!(primary = notice_get_field(self, (void *)4))) { goto exit; }
+    rv = PyUnicode_FromFormat("<Notice %S: %R>", severity, primary);
+
+exit:
+    Py_XDECREF(severity);
+    Py_XDECREF(primary);
+    return rv;
+}
+
+
+/* object calculated member list; the closure is the index in the fields */
+static struct PyGetSetDef noticeObject_getsets[] = {
+    { "message", (getter)notice_get_field, NULL,
+      "The full text of the notice, as stored in `connection.notices`.",
+      (void*) 0 },
+    { "severity", (getter)notice_get_field, NULL, NULL, (void*) 1 },
+    { "severity_nonlocalized", (getter)notice_get_field, NULL,
+      NULL, (void*) 2 },
+    { "sqlstate", (getter)notice_get_field, NULL, NULL, (void*) 3 },
+    { "message_primary", (getter)notice_get_field, NULL, NULL, (void*) 4 },
+    { "message_detail", (getter)notice_get_field, NULL, NULL, (void*) 5 },
+    { "message_hint", (getter)notice_get_field, NULL, NULL, (void*) 6 },
+    { "statement_position", (getter)notice_get_field, NULL,
+      NULL, (void*) 7 },
+    { "internal_position", (getter)notice_get_field, NULL, NULL, (void*) 8 },
+    { "internal_query", (getter)notice_get_field, NULL, NULL, (void*) 9 },
+    { "context", (getter)notice_get_field, NULL, NULL, (void*) 10 },
+    { "schema_name", (getter)notice_get_field, NULL, NULL, (void*) 11 },
+    { "table_name", (getter)notice_get_field, NULL, NULL, (void*) 12 },
+    { "column_name", (getter)notice_get_field, NULL, NULL, (void*) 13 },
+    { "datatype_name", (getter)notice_get_field, NULL, NULL, (void*) 14 },
+    { "constraint_name", (getter)notice_get_field, NULL, NULL, (void*) 15 },
+    { "source_file", (getter)notice_get_field, NULL, NULL, (void*) 16 },
+    { "source_line", (getter)notice_get_field, NULL, NULL, (void*) 17 },
+    { "source_function", (getter)notice_get_field, NULL, NULL, (void*) 18 },
+    {NULL}
+};
+
+static void
+notice_dealloc(noticeObject *self)
+{
+    notice_data_free(&self->data);
+    Py_CLEAR(self->pydecoder);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* object type */
+
+static const char noticeType_doc[] =
+    "A notice or warning message received from the server.\n\n"
+    "The object is passed to the handlers registered by\n"
+    "`~connection.add_notice_handler()`. It exposes the same attributes\n"
+    "of `Diagnostics`, plus the `!message` text; `!str()` returns the\n"
+    "message too.";
+
+PyTypeObject noticeType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2.extensions.Notice",
+    sizeof(noticeObject), 0,
+    (destructor)notice_dealloc, /*tp_dealloc*/
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    (reprfunc)notice_repr, /*tp_repr*/
+    0,          /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    (reprfunc)notice_str, /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT, /*tp_flags*/
+    noticeType_doc, /*tp_doc*/
+    0,          /*tp_traverse*/
+    0,          /*tp_clear*/
+    0,          /*tp_richcompare*/
+    0,          /*tp_weaklistoffset*/
+    0,          /*tp_iter*/
+    0,          /*tp_iternext*/
+    0,          /*tp_methods*/
+    0,          /*tp_members*/
+    noticeObject_getsets, /*tp_getset*/
+};
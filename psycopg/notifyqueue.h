@@ -0,0 +1,64 @@
+/* notifyqueue.h - definition for the NotifyQueue type
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#ifndef PSYCOPG_NOTIFYQUEUE_H
+#define PSYCOPG_NOTIFYQUEUE_H 1
+
+#include "psycopg/connection.h"
+
+extern HIDDEN PyTypeObject notifyQueueType;
+
+/* overflow policies */
+#define NOTIFYQUEUE_DROP    0   /* discard the oldest notification */
+#define NOTIFYQUEUE_RAISE   1   /* discard the new one, raise on the next get */
+
+/* A bounded queue of notifications.
+ *
+ * The items are stored in a ring buffer of 'maxsize' slots, starting from
+ * 'head'. When the queue is the notifies of a connection, 'conn' refers to
+ * it (borrowed: the connection unbinds the queue before going away) and
+ * get() can wait on its socket.
+ */
+typedef struct {
+    PyObject_HEAD
+
+    connectionObject *conn;
+
+    PyObject **items;
+    Py_ssize_t maxsize;
+    Py_ssize_t head;
+    Py_ssize_t len;
+
+    int overflow;
+    long dropped;   /* notifications discarded so far */
+    long lost;      /* discarded by NOTIFYQUEUE_RAISE and not reported yet */
+
+} notifyQueueObject;
+
+RAISES_NEG HIDDEN int notifyqueue_put(notifyQueueObject *self, PyObject *item);
+RAISES_NEG HIDDEN int notifyqueue_bind(PyObject *obj, connectionObject *conn);
+HIDDEN void notifyqueue_unbind(PyObject *obj, connectionObject *conn);
+
+#endif /* PSYCOPG_NOTIFYQUEUE_H */
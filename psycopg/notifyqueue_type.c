@@ -0,0 +1,597 @@
+/* notifyqueue_type.c - bounded queue of notifications
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#define PSYCOPG_MODULE
+#include "psycopg/psycopg.h"
+
+#include "psycopg/notifyqueue.h"
+
+#include <errno.h>
+#ifdef _WIN32
+/* WSAPoll() */
+#include <winsock2.h>
+/* gettimeofday() */
+#include "win32_support.h"
+#elif defined(__sun) && defined(__SVR4)
+#include "solaris_support.h"
+#elif defined(_AIX)
+#include "aix_support.h"
+#else
+#include <sys/time.h>
+#endif
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+
+/* Add an item to the queue, applying the overflow policy if full.
+ *
+ * The function is called by conn_notifies_process() for every notification
+ * received and doesn't call back into Python.
+ */
+RAISES_NEG int
+notifyqueue_put(notifyQueueObject *self, PyObject *item)
+{
+    PyObject *old = NULL;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->len < self->maxsize) {
+        Py_INCREF(item);
+        self->items[(self->head + self->len) % self->maxsize] = item;
+        self->len++;
+    }
+    else if (self->overflow == NOTIFYQUEUE_DROP) {
+        old = self->items[self->head];
+        Py_INCREF(item);
+        self->items[self->head] = item;
+        self->head = (self->head + 1) % self->maxsize;
+        self->dropped++;
+    }
+    else {
+        self->dropped++;
+        self->lost++;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    Py_XDECREF(old);
+    return 0;
+}
+
+/* Remove and return the item in position 'index' of the queue.
+ *
+ * Return NULL without setting an exception if 'index' is out of range.
+ * The caller must hold the critical section on the queue.
+ */
+static PyObject *
+_notifyqueue_pop(notifyQueueObject *self, Py_ssize_t index)
+{
+    PyObject *rv;
+    Py_ssize_t i;
+
+    if (index < 0) {
+        index += self->len;
+    }
+    if (index < 0 || index >= self->len) {
+        return NULL;
+    }
+
+    rv = self->items[(self->head + index) % self->maxsize];
+    if (index == 0) {
+        self->head = (self->head + 1) % self->maxsize;
+    }
+    else {
+        for (i = index; i < self->len - 1; i++) {
+            self->items[(self->head + i) % self->maxsize] =
+                self->items[(self->head + i + 1) % self->maxsize];
+        }
+    }
+    self->len--;
+    return rv;
+}
+
+/* Raise an exception if notifications were lost by the RAISE policy. */
+RAISES_NEG static int
+_notifyqueue_check_lost(notifyQueueObject *self)
+{
+    long lost;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    lost = self->lost;
+    self->lost = 0;
+    Py_END_CRITICAL_SECTION();
+
+    if (lost) {
+        PyErr_Format(OperationalError,
+            "notification queue full: %ld notifications lost", lost);
+        return -1;
+    }
+    return 0;
+}
+
+/* Make the queue the notifies of a connection.
+ *
+ * Do nothing if obj is not a NotifyQueue.
+ */
+RAISES_NEG int
+notifyqueue_bind(PyObject *obj, connectionObject *conn)
+{
+    notifyQueueObject *self;
+    int rv = 0;
+
+    if (!PyObject_TypeCheck(obj, &notifyQueueType)) {
+        return 0;
+    }
+    self = (notifyQueueObject *)obj;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->conn && self->conn != conn) {
+        PyErr_SetString(PyExc_ValueError,
+            "the queue is already used by another connection");
+        rv = -1;
+    }
+    else {
+        self->conn = conn;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    return rv;
+}
+
+/* Detach the queue from the connection it was bound to.
+ *
+ * Called when the connection notifies are replaced and when the connection
+ * is deleted, so that the queue never refers to a dead connection.
+ */
+void
+notifyqueue_unbind(PyObject *obj, connectionObject *conn)
+{
+    notifyQueueObject *self;
+
+    if (!obj || !PyObject_TypeCheck(obj, &notifyQueueType)) {
+        return;
+    }
+    self = (notifyQueueObject *)obj;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->conn == conn) {
+        self->conn = NULL;
+    }
+    Py_END_CRITICAL_SECTION();
+}
+
+
+/* Longest wait on the socket before checking the connection again (msec).
+ *
+ * Closing the connection in another thread doesn't wake up poll(). */
+#define NOTIFYQUEUE_WAIT_SLICE 1000
+
+/* Wait until the socket is readable or the deadline expires.
+ *
+ * Return 1 if the socket is ready, a signal arrived or the wait slice
+ * expired, 0 on timeout, -1 on error. A NULL deadline means no timeout.
+ */
+RAISES_NEG static int
+_notifyqueue_wait(int fd, struct timeval *deadline)
+{
+    struct pollfd pfd;
+    struct timeval now, tv;
+    int msec = NOTIFYQUEUE_WAIT_SLICE, res;
+
+    if (deadline) {
+        gettimeofday(&now, NULL);
+        timersub(deadline, &now, &tv);
+        if (tv.tv_sec < 0) {
+            return 0;
+        }
+        if (tv.tv_sec < NOTIFYQUEUE_WAIT_SLICE / 1000) {
+            msec = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+        }
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    Py_BEGIN_ALLOW_THREADS;
+    res = poll(&pfd, 1, msec);
+    Py_END_ALLOW_THREADS;
+
+    if (res < 0) {
+        if (errno == EINTR) {
+            return 0 > PyErr_CheckSignals() ? -1 : 1;
+        }
+        PyErr_SetFromErrno(OperationalError);
+        return -1;
+    }
+    if (res == 0 && msec == NOTIFYQUEUE_WAIT_SLICE) {
+        return 1;
+    }
+    return res;
+}
+
+
+/** public methods **/
+
+#define notifyqueue_append_doc \
+"append(notify) -- Add a notification to the queue, as the connection does."
+
+static PyObject *
+notifyqueue_append(notifyQueueObject *self, PyObject *item)
+{
+    if (0 > notifyqueue_put(self, item)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+#define notifyqueue_pop_doc \
+"pop(index=-1) -> Notify -- Remove and return a notification.\n\n" \
+"Raise `IndexError` if the queue is empty."
+
+static PyObject *
+notifyqueue_pop(notifyQueueObject *self, PyObject *args)
+{
+    PyObject *rv;
+    Py_ssize_t index = -1;
+
+    if (!PyArg_ParseTuple(args, "|n", &index)) {
+        return NULL;
+    }
+    if (0 > _notifyqueue_check_lost(self)) {
+        return NULL;
+    }
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    rv = _notifyqueue_pop(self, index);
+    Py_END_CRITICAL_SECTION();
+
+    if (!rv) {
+        PyErr_SetString(PyExc_IndexError, "pop from empty queue or bad index");
+    }
+    return rv;
+}
+
+
+#define notifyqueue_get_doc \
+"get(timeout=None) -> Notify -- Return the oldest notification, waiting for it.\n\n" \
+"If the queue is empty, wait on the connection socket until a notification\n" \
+"is received. Return None if *timeout* seconds pass without notifications."
+
+static PyObject *
+notifyqueue_get(notifyQueueObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *pytimeout = Py_None, *rv = NULL;
+    connectionObject *conn = NULL;
+    struct timeval deadline, tv;
+    double timeout = -1.0;
+    int res, fd;
+
+    static char *kwlist[] = {"timeout", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &pytimeout)) {
+        return NULL;
+    }
+
+    if (pytimeout != Py_None) {
+        timeout = PyFloat_AsDouble(pytimeout);
+        if (timeout == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return NULL;
+        }
+        gettimeofday(&deadline, NULL);
+        tv.tv_sec = (long)timeout;
+        tv.tv_usec = (long)((timeout - (long)timeout) * 1.0e6);
+        timeradd(&deadline, &tv, &deadline);
+    }
+
+    for (;;) {
+        if (0 > _notifyqueue_check_lost(self)) { goto exit; }
+
+        Py_CLEAR(conn);
+        Py_BEGIN_CRITICAL_SECTION(self);
+        rv = _notifyqueue_pop(self, 0);
+        if (!rv && self->conn) {
+            conn = self->conn;
+            Py_INCREF(conn);
+        }
+        Py_END_CRITICAL_SECTION();
+        if (rv) { goto exit; }
+
+        /* the connection is looked up again at every round in case the
+         * queue was replaced in the connection notifies meanwhile. */
+        if (!conn) {
+            PyErr_SetString(ProgrammingError,
+                "the queue is not the notifies of a connection");
+            goto exit;
+        }
+        if (conn->closed) {
+            PyErr_SetString(InterfaceError, "connection already closed");
+            goto exit;
+        }
+        if (conn->async_status != ASYNC_DONE) {
+            PyErr_SetString(ProgrammingError,
+                "get() cannot be used while an asynchronous query is underway");
+            goto exit;
+        }
+
+        /* Read what is available on the socket without blocking. */
+        if (PSYCO_POLL_ERROR == conn_poll(conn)) {
+            if (!PyErr_Occurred()) {
+                PyErr_SetString(OperationalError,
+                    PQerrorMessage(conn->pgconn));
+            }
+            goto exit;
+        }
+        if (self->len) { continue; }
+
+        /* the connection may have been closed by another thread */
+        if (conn->closed || (fd = PQsocket(conn->pgconn)) < 0) {
+            PyErr_SetString(InterfaceError, "connection already closed");
+            goto exit;
+        }
+
+        res = _notifyqueue_wait(fd, timeout >= 0 ? &deadline : NULL);
+        if (res < 0) { goto exit; }
+        if (res == 0) {
+            Py_INCREF(Py_None);
+            rv = Py_None;
+            goto exit;
+        }
+    }
+
+exit:
+    Py_XDECREF(conn);
+    return rv;
+}
+
+
+#define notifyqueue_clear_doc \
+"clear() -- Remove all the notifications from the queue."
+
+static PyObject *
+notifyqueue_clear_items(notifyQueueObject *self, PyObject *dummy)
+{
+    PyObject *item;
+
+    for (;;) {
+        Py_BEGIN_CRITICAL_SECTION(self);
+        item = _notifyqueue_pop(self, 0);
+        Py_END_CRITICAL_SECTION();
+        if (!item) { break; }
+        Py_DECREF(item);
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+notifyqueue_overflow_get(notifyQueueObject *self)
+{
+    return Text_FromUTF8(
+        self->overflow == NOTIFYQUEUE_DROP ? "drop" : "raise");
+}
+
+
+/** sequence protocol, for compatibility with a list **/
+
+static Py_ssize_t
+notifyqueue_len(notifyQueueObject *self)
+{
+    return self->len;
+}
+
+static PyObject *
+notifyqueue_getitem(notifyQueueObject *self, Py_ssize_t index)
+{
+    PyObject *rv = NULL;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (index >= 0 && index < self->len) {
+        rv = self->items[(self->head + index) % self->maxsize];
+        Py_INCREF(rv);
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (!rv) {
+        PyErr_SetString(PyExc_IndexError, "queue index out of range");
+    }
+    return rv;
+}
+
+static PySequenceMethods notifyqueue_sequence = {
+    (lenfunc)notifyqueue_len,       /* sq_length */
+    0,                              /* sq_concat */
+    0,                              /* sq_repeat */
+    (ssizeargfunc)notifyqueue_getitem, /* sq_item */
+    0,                              /* sq_slice */
+    0,                              /* sq_ass_item */
+    0,                              /* sq_ass_slice */
+    0,                              /* sq_contains */
+    0,                              /* sq_inplace_concat */
+    0,                              /* sq_inplace_repeat */
+};
+
+
+/** the NotifyQueue object **/
+
+static struct PyMethodDef notifyqueue_methods[] = {
+    {"append", (PyCFunction)notifyqueue_append,
+     METH_O, notifyqueue_append_doc},
+    {"pop", (PyCFunction)notifyqueue_pop,
+     METH_VARARGS, notifyqueue_pop_doc},
+    {"get", (PyCFunction)notifyqueue_get,
+     METH_VARARGS|METH_KEYWORDS, notifyqueue_get_doc},
+    {"clear", (PyCFunction)notifyqueue_clear_items,
+     METH_NOARGS, notifyqueue_clear_doc},
+    {NULL}
+};
+
+static struct PyMemberDef notifyqueue_members[] = {
+    {"maxsize", T_PYSSIZET, offsetof(notifyQueueObject, maxsize), READONLY,
+        "The maximum number of notifications in the queue."},
+    {"dropped", T_LONG, offsetof(notifyQueueObject, dropped), READONLY,
+        "The number of notifications discarded because the queue was full."},
+    {NULL}
+};
+
+static struct PyGetSetDef notifyqueue_getsets[] = {
+    { "overflow", (getter)notifyqueue_overflow_get, NULL,
+      "The policy applied when the queue is full: 'drop' or 'raise'." },
+    {NULL}
+};
+
+static int
+notifyqueue_init(notifyQueueObject *self, PyObject *args, PyObject *kwargs)
+{
+    Py_ssize_t maxsize;
+    const char *overflow = "drop";
+
+    static char *kwlist[] = {"maxsize", "overflow", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|s", kwlist,
+            &maxsize, &overflow)) {
+        return -1;
+    }
+
+    if (maxsize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "maxsize must be positive");
+        return -1;
+    }
+    if (0 == strcmp(overflow, "drop")) {
+        self->overflow = NOTIFYQUEUE_DROP;
+    }
+    else if (0 == strcmp(overflow, "raise")) {
+        self->overflow = NOTIFYQUEUE_RAISE;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+            "overflow must be 'drop' or 'raise', got '%s'", overflow);
+        return -1;
+    }
+
+    if (self->items) {
+        PyErr_SetString(ProgrammingError, "the queue is already initialized");
+        return -1;
+    }
+    if (!(self->items = PyMem_New(PyObject *, maxsize))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->maxsize = maxsize;
+
+    return 0;
+}
+
+static int
+notifyqueue_traverse(notifyQueueObject *self, visitproc visit, void *arg)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < self->len; i++) {
+        Py_VISIT(self->items[(self->head + i) % self->maxsize]);
+    }
+    return 0;
+}
+
+static int
+notifyqueue_clear(notifyQueueObject *self)
+{
+    PyObject *item;
+
+    while (self->len) {
+        item = _notifyqueue_pop(self, 0);
+        Py_DECREF(item);
+    }
+    return 0;
+}
+
+static void
+notifyqueue_dealloc(notifyQueueObject *self)
+{
+    PyObject_GC_UnTrack((PyObject *)self);
+    notifyqueue_clear(self);
+    PyMem_Free(self->items);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+notifyqueue_repr(notifyQueueObject *self)
+{
+    return PyUnicode_FromFormat(
+        "<psycopg2.extensions.NotifyQueue object at %p; len: %zd, maxsize: %zd>",
+        self, self->len, self->maxsize);
+}
+
+
+/* object type */
+
+#define notifyQueueType_doc \
+"NotifyQueue(maxsize, overflow='drop') -> bounded queue of notifications.\n\n" \
+"Assign it to `connection.notifies` to receive the notifications. If the\n" \
+"queue is full *overflow* 'drop' discards the oldest notification; 'raise'\n" \
+"discards the new ones and makes the next `!get()` or `!pop()` raise."
+
+PyTypeObject notifyQueueType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2.extensions.NotifyQueue",
+    sizeof(notifyQueueObject), 0,
+    (destructor)notifyqueue_dealloc, /* tp_dealloc */
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    (reprfunc)notifyqueue_repr, /*tp_repr*/
+    0,          /*tp_as_number*/
+    &notifyqueue_sequence, /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_HAVE_GC, /*tp_flags*/
+    notifyQueueType_doc, /*tp_doc*/
+    (traverseproc)notifyqueue_traverse, /*tp_traverse*/
+    (inquiry)notifyqueue_clear, /*tp_clear*/
+    0,          /*tp_richcompare*/
+    0,          /*tp_weaklistoffset*/
+    0,          /*tp_iter*/
+    0,          /*tp_iternext*/
+    notifyqueue_methods, /*tp_methods*/
+    notifyqueue_members, /*tp_members*/
+    notifyqueue_getsets, /*tp_getset*/
+    0,          /*tp_base*/
+    0,          /*tp_dict*/
+    0,          /*tp_descr_get*/
+    0,          /*tp_descr_set*/
+    0,          /*tp_dictoffset*/
+    (initproc)notifyqueue_init, /*tp_init*/
+    0,          /*tp_alloc*/
+    PyType_GenericNew, /*tp_new*/
+};
@@ -0,0 +1,60 @@
+/* pgoutput.h - definition for the pgoutput logical decoding messages parser
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#ifndef PSYCOPG_PGOUTPUT_H
+#define PSYCOPG_PGOUTPUT_H 1
+
+#include "psycopg/cursor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern HIDDEN PyTypeObject pgoutputDecoderType;
+
+/* Parser of the messages of the pgoutput logical decoding plugin.
+ *
+ * The Relation messages received are kept in 'relations', by relation oid,
+ * together with the typecasters of their columns in 'casts': the following
+ * Insert/Update/Delete messages only refer to the relation by oid.
+ */
+typedef struct {
+    PyObject_HEAD
+
+    cursorObject *cursor;   /* the cursor whose typecasters to use */
+    PyObject *relations;    /* relation oid -> Relation message */
+    PyObject *casts;        /* relation oid -> tuple of typecasters */
+
+    char *buf;              /* scratch space to zero-terminate values */
+    size_t bufsize;
+} pgoutputDecoderObject;
+
+RAISES_NEG HIDDEN int pgoutput_init_module(PyObject *module);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !defined(PSYCOPG_PGOUTPUT_H) */
@@ -0,0 +1,952 @@
+/* pgoutput_type.c - parser of the pgoutput logical decoding messages
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#define PSYCOPG_MODULE
+#include "psycopg/psycopg.h"
+
+#include "psycopg/pgoutput.h"
+#include "psycopg/replication_message.h"
+#include "psycopg/typecast.h"
+#include "psycopg/libpq_support.h"
+
+#include "datetime.h"
+
+#include <string.h>
+
+
+/* The messages returned by the parser are struct sequences: the pgoutput
+ * protocol is described in the "Logical Replication Message Formats"
+ * section of the PostgreSQL docs. */
+
+static PyTypeObject *pgoutputBeginType;
+static PyTypeObject *pgoutputCommitType;
+static PyTypeObject *pgoutputOriginType;
+static PyTypeObject *pgoutputRelationType;
+static PyTypeObject *pgoutputColumnType;
+static PyTypeObject *pgoutputTypeType;
+static PyTypeObject *pgoutputInsertType;
+static PyTypeObject *pgoutputUpdateType;
+static PyTypeObject *pgoutputDeleteType;
+static PyTypeObject *pgoutputTruncateType;
+static PyTypeObject *pgoutputMessageType;
+
+static PyStructSequence_Field begin_fields[] = {
+    {"final_lsn", "The final LSN of the transaction."},
+    {"commit_time", "The commit timestamp of the transaction."},
+    {"xid", "The id of the transaction."},
+    {NULL}
+};
+
+static PyStructSequence_Field commit_fields[] = {
+    {"flags", "Flags of the message (currently unused)."},
+    {"commit_lsn", "The LSN of the commit."},
+    {"end_lsn", "The end LSN of the transaction."},
+    {"commit_time", "The commit timestamp of the transaction."},
+    {NULL}
+};
+
+static PyStructSequence_Field origin_fields[] = {
+    {"commit_lsn", "The LSN of the commit on the origin server."},
+    {"name", "The name of the origin."},
+    {NULL}
+};
+
+static PyStructSequence_Field relation_fields[] = {
+    {"oid", "The oid of the relation."},
+    {"namespace", "The schema of the relation."},
+    {"name", "The name of the relation."},
+    {"replica_identity", "The replica identity setting of the relation."},
+    {"columns", "The columns of the relation, as PgoutputColumn."},
+    {NULL}
+};
+
+static PyStructSequence_Field column_fields[] = {
+    {"name", "The name of the column."},
+    {"type_oid", "The oid of the data type of the column."},
+    {"type_modifier", "The type modifier of the column."},
+    {"key", "True if the column is part of the key."},
+    {NULL}
+};
+
+static PyStructSequence_Field type_fields[] = {
+    {"oid", "The oid of the data type."},
+    {"namespace", "The schema of the data type."},
+    {"name", "The name of the data type."},
+    {NULL}
+};
+
+static PyStructSequence_Field insert_fields[] = {
+    {"relation", "The PgoutputRelation the record belongs to."},
+    {"new", "The values of the new record."},
+    {NULL}
+};
+
+static PyStructSequence_Field update_fields[] = {
+    {"relation", "The PgoutputRelation the record belongs to."},
+    {"key", "The key values of the old record, or None."},
+    {"old", "The values of the old record, or None."},
+    {"new", "The values of the new record."},
+    {NULL}
+};
+
+static PyStructSequence_Field delete_fields[] = {
+    {"relation", "The PgoutputRelation the record belongs to."},
+    {"key", "The key values of the deleted record, or None."},
+    {"old", "The values of the deleted record, or None."},
+    {NULL}
+};
+
+static PyStructSequence_Field truncate_fields[] = {
+    {"relations", "The PgoutputRelation truncated."},
+    {"cascade", "True if the truncate was CASCADE."},
+    {"restart_identity", "True if the truncate was RESTART IDENTITY."},
+    {NULL}
+};
+
+static PyStructSequence_Field message_fields[] = {
+    {"transactional", "True if the message is transactional."},
+    {"lsn", "The LSN of the message."},
+    {"prefix", "The prefix of the message."},
+    {"content", "The content of the message, as bytes."},
+    {NULL}
+};
+
+static struct {
+    char *name;
+    PyTypeObject **type;
+    PyStructSequence_Desc desc;
+} pgoutput_types[] = {
+    { "PgoutputBegin", &pgoutputBeginType,
+      { "psycopg2.extensions.PgoutputBegin",
+        "A pgoutput Begin message.", begin_fields, 3 } },
+    { "PgoutputCommit", &pgoutputCommitType,
+      { "psycopg2.extensions.PgoutputCommit",
+        "A pgoutput Commit message.", commit_fields, 4 } },
+    { "PgoutputOrigin", &pgoutputOriginType,
+      { "psycopg2.extensions.PgoutputOrigin",
+        "A pgoutput Origin message.", origin_fields, 2 } },
+    { "PgoutputRelation", &pgoutputRelationType,
+      { "psycopg2.extensions.PgoutputRelation",
+        "A pgoutput Relation message.", relation_fields, 5 } },
+    { "PgoutputColumn", &pgoutputColumnType,
+      { "psycopg2.extensions.PgoutputColumn",
+        "A column of a pgoutput Relation message.", column_fields, 4 } },
+    { "PgoutputType", &pgoutputTypeType,
+      { "psycopg2.extensions.PgoutputType",
+        "A pgoutput Type message.", type_fields, 3 } },
+    { "PgoutputInsert", &pgoutputInsertType,
+      { "psycopg2.extensions.PgoutputInsert",
+        "A pgoutput Insert message.", insert_fields, 2 } },
+    { "PgoutputUpdate", &pgoutputUpdateType,
+      { "psycopg2.extensions.PgoutputUpdate",
+        "A pgoutput Update message.", update_fields, 4 } },
+    { "PgoutputDelete", &pgoutputDeleteType,
+      { "psycopg2.extensions.PgoutputDelete",
+        "A pgoutput Delete message.", delete_fields, 3 } },
+    { "PgoutputTruncate", &pgoutputTruncateType,
+      { "psycopg2.extensions.PgoutputTruncate",
+        "A pgoutput Truncate message.", truncate_fields, 3 } },
+    { "PgoutputMessage", &pgoutputMessageType,
+      { "psycopg2.extensions.PgoutputMessage",
+        "A pgoutput logical decoding Message.", message_fields, 4 } },
+    {NULL}
+};
+
+
+/* The value of the TOASTed columns not changed by an update */
+
+static PyObject *unchanged_toast;
+
+static PyObject *
+unchanged_toast_repr(PyObject *self)
+{
+    return PyUnicode_FromString("UNCHANGED_TOAST");
+}
+
+static PyTypeObject unchangedToastType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2.extensions.UnchangedToast",
+    sizeof(PyObject), 0,
+    0,          /*tp_dealloc*/
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    unchanged_toast_repr, /*tp_repr*/
+    0,          /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT, /*tp_flags*/
+    "The value of a TOASTed column not changed by an update.", /*tp_doc*/
+};
+
+
+/* Reading the message fields */
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} pgoutputReader;
+
+RAISES_NEG static int
+_read_check(pgoutputReader *r, Py_ssize_t size)
+{
+    if (r->end - r->p < size) {
+        PyErr_SetString(OperationalError, "pgoutput message truncated");
+        return -1;
+    }
+    return 0;
+}
+
+RAISES_NEG static int
+_read_int8(pgoutputReader *r, int *val)
+{
+    if (0 > _read_check(r, 1)) { return -1; }
+    *val = r->p[0];
+    r->p += 1;
+    return 0;
+}
+
+RAISES_NEG static int
+_read_int16(pgoutputReader *r, int *val)
+{
+    if (0 > _read_check(r, 2)) { return -1; }
+    *val = (int16_t)((uint16_t)r->p[0] << 8 | r->p[1]);
+    r->p += 2;
+    return 0;
+}
+
+RAISES_NEG static int
+_read_int32(pgoutputReader *r, uint32_t *val)
+{
+    if (0 > _read_check(r, 4)) { return -1; }
+    *val = (uint32_t)r->p[0] << 24 | (uint32_t)r->p[1] << 16
+        | (uint32_t)r->p[2] << 8 | r->p[3];
+    r->p += 4;
+    return 0;
+}
+
+RAISES_NEG static int
+_read_int64(pgoutputReader *r, uint64_t *val)
+{
+    uint32_t hi, lo;
+
+    if (0 > _read_int32(r, &hi)) { return -1; }
+    if (0 > _read_int32(r, &lo)) { return -1; }
+    *val = (uint64_t)hi << 32 | lo;
+    return 0;
+}
+
+/* Read a zero-terminated string and decode it in the connection encoding */
+static PyObject *
+_read_string(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    const unsigned char *z;
+    PyObject *rv;
+
+    if (!(z = memchr(r->p, '\0', r->end - r->p))) {
+        PyErr_SetString(OperationalError, "pgoutput message truncated");
+        return NULL;
+    }
+    rv = conn_decode(self->cursor->conn, (const char *)r->p, z - r->p);
+    r->p = z + 1;
+    return rv;
+}
+
+static PyObject *
+_read_lsn(pgoutputReader *r)
+{
+    uint64_t val;
+
+    if (0 > _read_int64(r, &val)) { return NULL; }
+    return PyLong_FromUnsignedLongLong(val);
+}
+
+/* Read a timestamp, in microseconds since 2000-01-01, as a datetime */
+static PyObject *
+_read_timestamp(pgoutputReader *r)
+{
+    uint64_t val;
+    PyObject *tval, *res = NULL;
+    double t;
+
+    if (0 > _read_int64(r, &val)) { return NULL; }
+
+    t = (double)(int64_t)val / USECS_PER_SEC +
+        ((POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY);
+
+    tval = Py_BuildValue("(d)", t);
+    if (tval) {
+        res = PyDateTime_FromTimestamp(tval);
+        Py_DECREF(tval);
+    }
+
+    return res;
+}
+
+/* Read a TupleData structure and convert the values with the typecasters */
+static PyObject *
+_read_tuple(pgoutputDecoderObject *self, pgoutputReader *r, PyObject *casts)
+{
+    PyObject *rv = NULL;
+    PyObject *val;
+    typecast_function ccast;
+    int ncols, i, kind;
+    uint32_t len;
+
+    if (0 > _read_int16(r, &ncols)) { goto exit; }
+    if (ncols != PyTuple_GET_SIZE(casts)) {
+        PyErr_Format(OperationalError,
+            "pgoutput tuple has %d columns, the relation has %d",
+            ncols, (int)PyTuple_GET_SIZE(casts));
+        goto exit;
+    }
+    if (!(rv = PyTuple_New(ncols))) { goto exit; }
+
+    for (i = 0; i < ncols; i++) {
+        if (0 > _read_int8(r, &kind)) { goto error; }
+
+        switch (kind) {
+        case 'n':
+            Py_INCREF(Py_None);
+            val = Py_None;
+            break;
+
+        case 'u':
+            Py_INCREF(unchanged_toast);
+            val = unchanged_toast;
+            break;
+
+        case 't':
+            if (0 > _read_int32(r, &len)) { goto error; }
+            if (0 > _read_check(r, len)) { goto error; }
+
+            /* the typecasters expect zero-terminated strings */
+            if (self->bufsize < (size_t)len + 1) {
+                char *tmp;
+                if (!(tmp = PyMem_Realloc(self->buf, (size_t)len + 1))) {
+                    PyErr_NoMemory();
+                    goto error;
+                }
+                self->buf = tmp;
+                self->bufsize = (size_t)len + 1;
+            }
+            memcpy(self->buf, r->p, len);
+            self->buf[len] = '\0';
+            r->p += len;
+
+            if ((ccast = typecast_get_ccast(PyTuple_GET_ITEM(casts, i)))) {
+                val = ccast(self->buf, len, (PyObject *)self->cursor);
+            }
+            else {
+                val = typecast_cast(PyTuple_GET_ITEM(casts, i),
+                    self->buf, len, (PyObject *)self->cursor);
+            }
+            break;
+
+        case 'b':
+            if (0 > _read_int32(r, &len)) { goto error; }
+            if (0 > _read_check(r, len)) { goto error; }
+            val = Bytes_FromStringAndSize((const char *)r->p, len);
+            r->p += len;
+            break;
+
+        default:
+            PyErr_Format(OperationalError,
+                "unexpected pgoutput tuple value kind: 0x%02x", kind);
+            goto error;
+        }
+
+        if (!val) { goto error; }
+        PyTuple_SET_ITEM(rv, i, val);
+    }
+
+exit:
+    return rv;
+
+error:
+    Py_CLEAR(rv);
+    goto exit;
+}
+
+/* Read a relation oid and return the relation and its typecasters */
+RAISES_NEG static int
+_read_relation_ref(pgoutputDecoderObject *self, pgoutputReader *r,
+    PyObject **rel, PyObject **casts)
+{
+    int rv = -1;
+    uint32_t oid;
+    PyObject *key = NULL;
+
+    if (0 > _read_int32(r, &oid)) { goto exit; }
+    if (!(key = PyLong_FromUnsignedLong(oid))) { goto exit; }
+
+    if (0 > PyDict_GetItemRef(self->relations, key, rel)) { goto exit; }
+    if (0 > PyDict_GetItemRef(self->casts, key, casts)) { goto exit; }
+    if (!(*rel && *casts)) {
+        Py_CLEAR(*rel);
+        Py_CLEAR(*casts);
+        PyErr_Format(OperationalError,
+            "pgoutput message refers to the unknown relation %u", oid);
+        goto exit;
+    }
+
+    rv = 0;
+
+exit:
+    Py_XDECREF(key);
+    return rv;
+}
+
+/* Read an optional old tuple, marked 'K' or 'O', into key or old */
+RAISES_NEG static int
+_read_old_tuple(pgoutputDecoderObject *self, pgoutputReader *r,
+    PyObject *casts, PyObject **key, PyObject **old)
+{
+    int kind;
+
+    if (0 > _read_check(r, 1)) { return -1; }
+    kind = r->p[0];
+    if (kind != 'K' && kind != 'O') { return 0; }
+    r->p += 1;
+
+    if (kind == 'K') {
+        if (!(*key = _read_tuple(self, r, casts))) { return -1; }
+    }
+    else {
+        if (!(*old = _read_tuple(self, r, casts))) { return -1; }
+    }
+    return 0;
+}
+
+
+/* Parsing the single messages */
+
+/* Create a struct sequence setting its items, stealing the references */
+static PyObject *
+_make_message(PyTypeObject *type, int n, PyObject **items)
+{
+    PyObject *rv = NULL;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (!items[i]) { goto exit; }
+    }
+    if (!(rv = PyStructSequence_New(type))) { goto exit; }
+    for (i = 0; i < n; i++) {
+        PyStructSequence_SET_ITEM(rv, i, items[i]);
+        items[i] = NULL;
+    }
+
+exit:
+    for (i = 0; i < n; i++) {
+        Py_CLEAR(items[i]);
+    }
+    return rv;
+}
+
+static PyObject *
+_parse_begin(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[3] = {NULL};
+    uint32_t xid;
+
+    if (!(items[0] = _read_lsn(r))) { goto exit; }
+    if (!(items[1] = _read_timestamp(r))) { goto exit; }
+    if (0 > _read_int32(r, &xid)) { goto exit; }
+    items[2] = PyLong_FromUnsignedLong(xid);
+
+exit:
+    return _make_message(pgoutputBeginType, 3, items);
+}
+
+static PyObject *
+_parse_commit(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[4] = {NULL};
+    int flags;
+
+    if (0 > _read_int8(r, &flags)) { goto exit; }
+    if (!(items[0] = PyLong_FromLong(flags))) { goto exit; }
+    if (!(items[1] = _read_lsn(r))) { goto exit; }
+    if (!(items[2] = _read_lsn(r))) { goto exit; }
+    items[3] = _read_timestamp(r);
+
+exit:
+    return _make_message(pgoutputCommitType, 4, items);
+}
+
+static PyObject *
+_parse_origin(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[2] = {NULL};
+
+    if (!(items[0] = _read_lsn(r))) { goto exit; }
+    items[1] = _read_string(self, r);
+
+exit:
+    return _make_message(pgoutputOriginType, 2, items);
+}
+
+static PyObject *
+_parse_column(pgoutputDecoderObject *self, pgoutputReader *r,
+    PyObject **cast)
+{
+    PyObject *items[4] = {NULL};
+    PyObject *oid = NULL;
+    int flags;
+    uint32_t typoid, typmod;
+
+    if (0 > _read_int8(r, &flags)) { goto exit; }
+    if (!(items[0] = _read_string(self, r))) { goto exit; }
+    if (0 > _read_int32(r, &typoid)) { goto exit; }
+    if (0 > _read_int32(r, &typmod)) { goto exit; }
+    if (!(oid = PyLong_FromUnsignedLong(typoid))) { goto exit; }
+    if (!(*cast = curs_get_cast(self->cursor, oid))) { goto exit; }
+    items[1] = oid; oid = NULL;
+    if (!(items[2] = PyLong_FromLong((int32_t)typmod))) { goto exit; }
+    items[3] = PyBool_FromLong(flags & 1);
+
+exit:
+    Py_XDECREF(oid);
+    return _make_message(pgoutputColumnType, 4, items);
+}
+
+/* Parse a Relation message and store it in the relations cache */
+static PyObject *
+_parse_relation(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[5] = {NULL};
+    PyObject *rv = NULL;
+    PyObject *casts = NULL;
+    PyObject *col, *cast = NULL;
+    uint32_t relid;
+    int replident, ncols, i;
+
+    if (0 > _read_int32(r, &relid)) { goto exit; }
+    if (!(items[0] = PyLong_FromUnsignedLong(relid))) { goto exit; }
+    if (!(items[1] = _read_string(self, r))) { goto exit; }
+    if (!(items[2] = _read_string(self, r))) { goto exit; }
+    if (0 > _read_int8(r, &replident)) { goto exit; }
+    if (!(items[3] = PyUnicode_FromOrdinal(replident))) { goto exit; }
+    if (0 > _read_int16(r, &ncols) || ncols < 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(OperationalError,
+                "negative number of columns in pgoutput message");
+        }
+        goto exit;
+    }
+
+    if (!(items[4] = PyTuple_New(ncols))) { goto exit; }
+    if (!(casts = PyTuple_New(ncols))) { goto exit; }
+    for (i = 0; i < ncols; i++) {
+        if (!(col = _parse_column(self, r, &cast))) {
+            Py_CLEAR(cast);
+            goto exit;
+        }
+        PyTuple_SET_ITEM(items[4], i, col);
+        PyTuple_SET_ITEM(casts, i, cast);
+        cast = NULL;
+    }
+
+    if (!(rv = _make_message(pgoutputRelationType, 5, items))) { goto exit; }
+
+    /* the relation is sent again if it changes: replace the cached one */
+    if (0 > PyDict_SetItem(self->relations,
+            PyStructSequence_GET_ITEM(rv, 0), rv)) {
+        Py_CLEAR(rv);
+        goto exit;
+    }
+    if (0 > PyDict_SetItem(self->casts,
+            PyStructSequence_GET_ITEM(rv, 0), casts)) {
+        Py_CLEAR(rv);
+        goto exit;
+    }
+
+exit:
+    for (i = 0; i < 5; i++) { Py_XDECREF(items[i]); }
+    Py_XDECREF(casts);
+    return rv;
+}
+
+static PyObject *
+_parse_type(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[3] = {NULL};
+    uint32_t typoid;
+
+    if (0 > _read_int32(r, &typoid)) { goto exit; }
+    if (!(items[0] = PyLong_FromUnsignedLong(typoid))) { goto exit; }
+    if (!(items[1] = _read_string(self, r))) { goto exit; }
+    items[2] = _read_string(self, r);
+
+exit:
+    return _make_message(pgoutputTypeType, 3, items);
+}
+
+static PyObject *
+_parse_insert(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[2] = {NULL};
+    PyObject *casts = NULL;
+    int kind;
+
+    if (0 > _read_relation_ref(self, r, &items[0], &casts)) { goto exit; }
+    if (0 > _read_int8(r, &kind)) { goto exit; }
+    if (kind != 'N') {
+        PyErr_SetString(OperationalError,
+            "unexpected data in pgoutput Insert message");
+        goto exit;
+    }
+    items[1] = _read_tuple(self, r, casts);
+
+exit:
+    Py_XDECREF(casts);
+    return _make_message(pgoutputInsertType, 2, items);
+}
+
+static PyObject *
+_parse_update(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[4] = {NULL};
+    PyObject *casts = NULL;
+    int kind;
+
+    if (0 > _read_relation_ref(self, r, &items[0], &casts)) { goto exit; }
+    if (0 > _read_old_tuple(self, r, casts, &items[1], &items[2])) {
+        goto exit;
+    }
+    if (!items[1]) { Py_INCREF(Py_None); items[1] = Py_None; }
+    if (!items[2]) { Py_INCREF(Py_None); items[2] = Py_None; }
+    if (0 > _read_int8(r, &kind)) { goto exit; }
+    if (kind != 'N') {
+        PyErr_SetString(OperationalError,
+            "unexpected data in pgoutput Update message");
+        goto exit;
+    }
+    items[3] = _read_tuple(self, r, casts);
+
+exit:
+    Py_XDECREF(casts);
+    return _make_message(pgoutputUpdateType, 4, items);
+}
+
+static PyObject *
+_parse_delete(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[3] = {NULL};
+    PyObject *casts = NULL;
+
+    if (0 > _read_relation_ref(self, r, &items[0], &casts)) { goto exit; }
+    if (0 > _read_old_tuple(self, r, casts, &items[1], &items[2])) {
+        goto exit;
+    }
+    if (!(items[1] || items[2])) {
+        PyErr_SetString(OperationalError,
+            "unexpected data in pgoutput Delete message");
+        goto exit;
+    }
+    if (!items[1]) { Py_INCREF(Py_None); items[1] = Py_None; }
+    if (!items[2]) { Py_INCREF(Py_None); items[2] = Py_None; }
+
+exit:
+    Py_XDECREF(casts);
+    return _make_message(pgoutputDeleteType, 3, items);
+}
+
+static PyObject *
+_parse_truncate(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[3] = {NULL};
+    PyObject *rel, *casts;
+    uint32_t nrels, i;
+    int options;
+
+    if (0 > _read_int32(r, &nrels)) { goto exit; }
+    if (0 > _read_int8(r, &options)) { goto exit; }
+    if (0 > _read_check(r, (Py_ssize_t)nrels * 4)) { goto exit; }
+    if (!(items[0] = PyTuple_New(nrels))) { goto exit; }
+    for (i = 0; i < nrels; i++) {
+        if (0 > _read_relation_ref(self, r, &rel, &casts)) { goto exit; }
+        Py_DECREF(casts);
+        PyTuple_SET_ITEM(items[0], i, rel);
+    }
+    if (!(items[1] = PyBool_FromLong(options & 1))) { goto exit; }
+    items[2] = PyBool_FromLong(options & 2);
+
+exit:
+    return _make_message(pgoutputTruncateType, 3, items);
+}
+
+static PyObject *
+_parse_message(pgoutputDecoderObject *self, pgoutputReader *r)
+{
+    PyObject *items[4] = {NULL};
+    int flags;
+    uint32_t len;
+
+    if (0 > _read_int8(r, &flags)) { goto exit; }
+    if (!(items[0] = PyBool_FromLong(flags & 1))) { goto exit; }
+    if (!(items[1] = _read_lsn(r))) { goto exit; }
+    if (!(items[2] = _read_string(self, r))) { goto exit; }
+    if (0 > _read_int32(r, &len)) { goto exit; }
+    if (0 > _read_check(r, len)) { goto exit; }
+    items[3] = Bytes_FromStringAndSize((const char *)r->p, len);
+    r->p += len;
+
+exit:
+    return _make_message(pgoutputMessageType, 4, items);
+}
+
+
+/* PgoutputDecoder methods */
+
+#define pgoutput_decode_doc \
+"decode(data) -> the message parsed from a pgoutput payload.\n\n" \
+"*data* can be a `ReplicationMessage` or its `!payload`, which must\n" \
+"not be decoded."
+
+static PyObject *
+pgoutput_decode(pgoutputDecoderObject *self, PyObject *data)
+{
+    PyObject *rv = NULL;
+    Py_buffer view;
+    pgoutputReader r;
+    int kind;
+
+    if (PyObject_TypeCheck(data, &replicationMessageType)) {
+        data = ((replicationMessageObject *)data)->payload;
+    }
+    if (0 > PyObject_GetBuffer(data, &view, PyBUF_SIMPLE)) {
+        return NULL;
+    }
+
+    r.p = (const unsigned char *)view.buf;
+    r.end = r.p + view.len;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (0 <= _read_int8(&r, &kind)) {
+        Dprintf("pgoutput_decode: message '%c', " FORMAT_CODE_PY_SSIZE_T
+            " bytes", kind, view.len);
+
+        switch (kind) {
+        case 'B': rv = _parse_begin(self, &r); break;
+        case 'C': rv = _parse_commit(self, &r); break;
+        case 'O': rv = _parse_origin(self, &r); break;
+        case 'R': rv = _parse_relation(self, &r); break;
+        case 'Y': rv = _parse_type(self, &r); break;
+        case 'I': rv = _parse_insert(self, &r); break;
+        case 'U': rv = _parse_update(self, &r); break;
+        case 'D': rv = _parse_delete(self, &r); break;
+        case 'T': rv = _parse_truncate(self, &r); break;
+        case 'M': rv = _parse_message(self, &r); break;
+        default:
+            PyErr_Format(NotSupportedError,
+                "unsupported pgoutput message type: 0x%02x", kind);
+        }
+    }
+    Py_END_CRITICAL_SECTION();
+
+    PyBuffer_Release(&view);
+    return rv;
+}
+
+
+/** the PgoutputDecoder object **/
+
+/* object method list */
+
+static struct PyMethodDef pgoutput_methods[] = {
+    {"decode", (PyCFunction)pgoutput_decode,
+     METH_O, pgoutput_decode_doc},
+    {NULL}
+};
+
+/* object member list */
+
+#define OFFSETOF(x) offsetof(pgoutputDecoderObject, x)
+
+static struct PyMemberDef pgoutput_members[] = {
+    {"cursor", T_OBJECT, OFFSETOF(cursor), READONLY,
+        "The cursor whose typecasters are used to convert the values."},
+    {"relations", T_OBJECT, OFFSETOF(relations), READONLY,
+        "The Relation messages received, by relation oid."},
+    {NULL}
+};
+
+/* initialization and finalization methods */
+
+static int
+pgoutput_init(pgoutputDecoderObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *cursor, *tmp;
+    static char *kwlist[] = {"cursor", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!", kwlist,
+            &cursorType, &cursor)) {
+        return -1;
+    }
+
+    tmp = (PyObject *)self->cursor;
+    Py_INCREF(cursor);
+    self->cursor = (cursorObject *)cursor;
+    Py_XDECREF(tmp);
+
+    if (!self->relations && !(self->relations = PyDict_New())) {
+        return -1;
+    }
+    if (!self->casts && !(self->casts = PyDict_New())) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+pgoutput_traverse(pgoutputDecoderObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT((PyObject *)self->cursor);
+    Py_VISIT(self->relations);
+    Py_VISIT(self->casts);
+    return 0;
+}
+
+static int
+pgoutput_clear(pgoutputDecoderObject *self)
+{
+    Py_CLEAR(self->cursor);
+    Py_CLEAR(self->relations);
+    Py_CLEAR(self->casts);
+    return 0;
+}
+
+static void
+pgoutput_dealloc(pgoutputDecoderObject *self)
+{
+    PyObject_GC_UnTrack((PyObject *)self);
+    pgoutput_clear(self);
+    PyMem_Free(self->buf);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* object type */
+
+#define pgoutputDecoderType_doc \
+"PgoutputDecoder(cursor) -> parser of the pgoutput plugin messages.\n\n" \
+"Convert the payloads of a replication stream into Pgoutput* messages.\n" \
+"The values of the records are converted by the typecasters of *cursor*."
+
+PyTypeObject pgoutputDecoderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2.extensions.PgoutputDecoder",
+    sizeof(pgoutputDecoderObject), 0,
+    (destructor)pgoutput_dealloc, /* tp_dealloc */
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    0,          /*tp_repr*/
+    0,          /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_HAVE_GC, /*tp_flags*/
+    pgoutputDecoderType_doc, /*tp_doc*/
+    (traverseproc)pgoutput_traverse, /*tp_traverse*/
+    (inquiry)pgoutput_clear, /*tp_clear*/
+    0,          /*tp_richcompare*/
+    0,          /*tp_weaklistoffset*/
+    0,          /*tp_iter*/
+    0,          /*tp_iternext*/
+    pgoutput_methods, /*tp_methods*/
+    pgoutput_members, /*tp_members*/
+    0,          /*tp_getset*/
+    0,          /*tp_base*/
+    0,          /*tp_dict*/
+    0,          /*tp_descr_get*/
+    0,          /*tp_descr_set*/
+    0,          /*tp_dictoffset*/
+    (initproc)pgoutput_init, /*tp_init*/
+    0,          /*tp_alloc*/
+    PyType_GenericNew, /*tp_new*/
+};
+
+
+/* Create the message types and add them to the module */
+
+RAISES_NEG int
+pgoutput_init_module(PyObject *module)
+{
+    int i;
+
+    Dprintf("psycopgmodule: initializing pgoutput types");
+
+    PyDateTime_IMPORT;
+    if (!PyDateTimeAPI) {
+        PyErr_SetString(PyExc_ImportError, "datetime initialization failed");
+        return -1;
+    }
+
+    for (i = 0; pgoutput_types[i].name; i++) {
+        PyTypeObject *type;
+
+        if (!(type = PyStructSequence_NewType(&pgoutput_types[i].desc))) {
+            return -1;
+        }
+        *pgoutput_types[i].type = type;
+
+        Py_INCREF(type);
+        if (0 > PyModule_AddObject(
+                module, pgoutput_types[i].name, (PyObject *)type)) {
+            Py_DECREF(type);
+            return -1;
+        }
+    }
+
+    if (0 > PyType_Ready(&unchangedToastType)) { return -1; }
+    if (!(unchanged_toast = PyType_GenericAlloc(&unchangedToastType, 0))) {
+        return -1;
+    }
+    Py_INCREF(unchanged_toast);
+    if (0 > PyModule_AddObject(module, "UNCHANGED_TOAST", unchanged_toast)) {
+        Py_DECREF(unchanged_toast);
+        return -1;
+    }
+
+    return 0;
+}
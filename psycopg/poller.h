@@ -0,0 +1,54 @@
+/* poller.h - definition for the asyncio poller type
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+
+#ifndef PSYCOPG_POLLER_H
+#define PSYCOPG_POLLER_H 1
+
+#include "psycopg/connection.h"
+
+extern HIDDEN PyTypeObject pollerType;
+
+/* Drive an async connection from an asyncio event loop.
+ *
+ * The poller is registered in the loop as reader or writer of the connection
+ * socket and calls conn_poll() every time the socket is ready, until the
+ * operation is complete and the future is resolved.
+ */
+typedef struct {
+    PyObject_HEAD
+
+    connectionObject *conn;
+    PyObject *loop;
+    PyObject *future;
+
+    int fd;         /* file descriptor registered in the loop */
+    int events;     /* PSYCO_POLL_READ/WRITE if registered, else 0 */
+
+} pollerObject;
+
+HIDDEN PyObject *poller_start(connectionObject *conn, PyObject *loop);
+
+#endif /* PSYCOPG_POLLER_H */
@@ -0,0 +1,259 @@
+/* poller_type.c - drive async connections from an asyncio loop
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+
+#define PSYCOPG_MODULE
+#include "psycopg/psycopg.h"
+
+#include "psycopg/poller.h"
+
+
+/* Stop listening to the connection socket. */
+RAISES_NEG static int
+poller_unregister(pollerObject *self)
+{
+    PyObject *tmp;
+    const char *meth;
+
+    if (!self->events) {
+        return 0;
+    }
+
+    meth = self->events == PSYCO_POLL_READ ? "remove_reader" : "remove_writer";
+    Dprintf("poller_unregister: %s(%d)", meth, self->fd);
+    self->events = 0;
+    if (!(tmp = PyObject_CallMethod(self->loop, meth, "i", self->fd))) {
+        return -1;
+    }
+    Py_DECREF(tmp);
+    return 0;
+}
+
+/* Listen to the connection socket to become readable or writable.
+ *
+ * Nothing is done if the poller is already waiting for the same event: the
+ * socket may change during the connection, when more hosts are tried.
+ */
+RAISES_NEG static int
+poller_register(pollerObject *self, int fd, int events)
+{
+    PyObject *tmp;
+    const char *meth;
+
+    if (fd == self->fd && events == self->events) {
+        return 0;
+    }
+    if (0 > poller_unregister(self)) {
+        return -1;
+    }
+
+    meth = events == PSYCO_POLL_READ ? "add_reader" : "add_writer";
+    Dprintf("poller_register: %s(%d)", meth, fd);
+    if (!(tmp = PyObject_CallMethod(self->loop, meth, "iO", fd, self))) {
+        return -1;
+    }
+    Py_DECREF(tmp);
+    self->fd = fd;
+    self->events = events;
+    return 0;
+}
+
+/* Resolve the future with the exception currently set.
+ *
+ * Return 0 if the exception was passed to the future, else -1 with an
+ * exception set, which will be reported by the loop.
+ */
+RAISES_NEG static int
+poller_fail(pollerObject *self)
+{
+    PyObject *type, *value, *tb, *tmp;
+    int rv = -1;
+
+    PyErr_Fetch(&type, &value, &tb);
+    PyErr_NormalizeException(&type, &value, &tb);
+    if (tb) {
+        PyException_SetTraceback(value, tb);
+    }
+
+    if (0 > poller_unregister(self)) { goto exit; }
+    if (!(tmp = PyObject_CallMethod(
+            self->future, "set_exception", "O", value))) {
+        goto exit;
+    }
+    Py_DECREF(tmp);
+    rv = 0;
+
+exit:
+    /* on error the new exception is reported instead of the original one */
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(tb);
+    return rv;
+}
+
+/* Advance the operation on the connection and wait for the next event.
+ *
+ * Errors in the operation are passed to the future. Return -1 only if the
+ * future couldn't be resolved.
+ */
+RAISES_NEG static int
+poller_step(pollerObject *self)
+{
+    PyObject *tmp;
+    int res;
+
+    /* The waiting task may have been cancelled */
+    if (!(tmp = PyObject_CallMethod(self->future, "done", NULL))) {
+        return -1;
+    }
+    res = PyObject_IsTrue(tmp);
+    Py_DECREF(tmp);
+    if (res) {
+        Dprintf("poller_step: future done: stopping");
+        return poller_unregister(self);
+    }
+
+    if (self->conn->closed) {
+        PyErr_SetString(InterfaceError, "connection already closed");
+        return poller_fail(self);
+    }
+
+    res = conn_poll(self->conn);
+    Dprintf("poller_step: conn_poll() = %d", res);
+
+    switch (res) {
+    case PSYCO_POLL_OK:
+        if (0 > poller_unregister(self)) { return -1; }
+        if (!(tmp = PyObject_CallMethod(
+                self->future, "set_result", "O", Py_None))) {
+            return -1;
+        }
+        Py_DECREF(tmp);
+        return 0;
+
+    case PSYCO_POLL_READ:
+    case PSYCO_POLL_WRITE:
+        if (0 > poller_register(self, conn_socket(self->conn), res)) {
+            return poller_fail(self);
+        }
+        return 0;
+
+    default:
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(OperationalError, PQerrorMessage(self->conn->pgconn));
+        }
+        return poller_fail(self);
+    }
+}
+
+
+/* Start polling a connection in a loop.
+ *
+ * Return a new reference to a future resolved when the current operation on
+ * the connection is complete, NULL on error.
+ */
+PyObject *
+poller_start(connectionObject *conn, PyObject *loop)
+{
+    pollerObject *self;
+    PyObject *rv = NULL;
+
+    if (!(self = PyObject_New(pollerObject, &pollerType))) {
+        return NULL;
+    }
+    Py_INCREF(conn);
+    self->conn = conn;
+    Py_INCREF(loop);
+    self->loop = loop;
+    self->future = NULL;
+    self->fd = -1;
+    self->events = 0;
+
+    if (!(self->future = PyObject_CallMethod(loop, "create_future", NULL))) {
+        goto exit;
+    }
+
+    /* The operation may be already complete, or fail straight away. */
+    if (0 > poller_step(self)) { goto exit; }
+
+    Py_INCREF(self->future);
+    rv = self->future;
+
+exit:
+    Py_DECREF(self);
+    return rv;
+}
+
+
+/* Called by the loop when the socket is ready. */
+static PyObject *
+poller_call(pollerObject *self, PyObject *args, PyObject *kwargs)
+{
+    if (0 > poller_step(self)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static void
+poller_dealloc(pollerObject *self)
+{
+    Py_CLEAR(self->conn);
+    Py_CLEAR(self->loop);
+    Py_CLEAR(self->future);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+poller_repr(pollerObject *self)
+{
+    return PyUnicode_FromFormat(
+        "<psycopg2._psycopg.Poller object at %p; fd: %d>", self, self->fd);
+}
+
+
+PyTypeObject pollerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2._psycopg.Poller",
+    sizeof(pollerObject), 0,
+    (destructor)poller_dealloc, /* tp_dealloc */
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    (reprfunc)poller_repr, /*tp_repr*/
+    0,          /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    (ternaryfunc)poller_call, /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT, /*tp_flags*/
+    "Driver of an async connection in an asyncio loop.", /*tp_doc*/
+};
@@ -0,0 +1,96 @@
+/* pool.h - definition for the connection pool core
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#ifndef PSYCOPG_POOL_H
+#define PSYCOPG_POOL_H 1
+
+#include "psycopg/connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern HIDDEN PyTypeObject connectionPoolType;
+
+/* An idle connection in the pool */
+typedef struct {
+    connectionObject *conn;
+    unsigned long thread;   /* ident of the thread that returned it */
+    int64_t expires;        /* monotonic time to replace it, 0 if never */
+    int64_t checked;        /* last monotonic time it was known usable */
+    int64_t idle_since;     /* monotonic time it was returned */
+    int dirty;              /* if it must be reset before use */
+} poolSlot;
+
+/* The core of a thread-safe connection pool.
+ *
+ * The idle connections are kept in the 'slots' stack, the most recently
+ * returned on top, the ones checked out in the 'used' dict, mapped to their
+ * expiry time. These structures are only changed holding the GIL (or in a
+ * critical section on the pool in free-threaded builds) and without calling
+ * back into Python, so no lock is needed. Connections are created, reset
+ * and closed outside the critical sections: 'nconns' counts the ones being
+ * opened too, so that 'maxconn' is never exceeded.
+ *
+ * Several connections can be opened in parallel by 'connect_async': they
+ * are completed together by conn_poll_many(), then made sync.
+ */
+typedef struct {
+    PyObject_HEAD
+
+    PyObject *connect;      /* callable returning a new connection */
+    PyObject *connect_async;    /* same, returning an async connection */
+    PyObject *used;         /* connections checked out -> expiry time */
+
+    poolSlot *slots;        /* idle connections, 'maxconn' allocated */
+    Py_ssize_t nslots;
+
+    Py_ssize_t minconn;
+    Py_ssize_t maxconn;
+    Py_ssize_t nconns;      /* connections open or being opened */
+    Py_ssize_t nopening;    /* connections being opened in background */
+
+    int64_t max_lifetime;   /* usec before replacing a connection, or 0 */
+    int64_t check_interval; /* usec before checking an idle connection, or 0 */
+    int64_t max_idle;       /* usec before closing an extra idle connection */
+    int64_t maint_due;      /* next maintenance scheduled, -1 if none */
+    int64_t connect_timeout;    /* usec to wait for async connections, or 0 */
+
+    int64_t connect_usec;   /* average time to open a connection */
+    double checkout_rate;   /* checkouts per second observed */
+    int64_t rate_since;     /* start of the current checkout rate sample */
+    Py_ssize_t ncheckouts;  /* checkouts in the current sample */
+
+    int deferred_reset;     /* reset returned connections on checkout */
+    int discard;            /* reset connections with DISCARD ALL */
+    int elastic;            /* open connections in background on demand */
+    int closed;
+} connectionPoolObject;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !defined(PSYCOPG_POOL_H) */
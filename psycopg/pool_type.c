@@ -0,0 +1,1131 @@
+/* pool_type.c - the connection pool core
+ *
+ * Copyright (C) 2020-2021 The Psycopg Team
+ *
+ * This file is part of psycopg.
+ *
+ * psycopg2 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link this program with the OpenSSL library (or with
+ * modified versions of OpenSSL that use the same license as OpenSSL),
+ * and distribute linked combinations including the two.
+ *
+ * You must obey the GNU Lesser General Public License in all respects for
+ * all of the code used other than OpenSSL.
+ *
+ * psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#define PSYCOPG_MODULE
+#include "psycopg/psycopg.h"
+
+#include "psycopg/pool.h"
+#include "psycopg/pqpath.h"
+#include "psycopg/libpq_support.h"
+
+#include <math.h>
+#include <string.h>
+
+
+/* Raise psycopg2.pool.PoolError with message 'msg' */
+static void
+pool_raise(const char *msg)
+{
+    PyObject *m, *exc;
+
+    if (!(m = PyImport_ImportModule("psycopg2.pool"))) { return; }
+    if ((exc = PyObject_GetAttrString(m, "PoolError"))) {
+        PyErr_SetString(exc, msg);
+        Py_DECREF(exc);
+    }
+    Py_DECREF(m);
+}
+
+
+/* Return the expiry time of a connection created at 'now'.
+ *
+ * Up to 5% of the lifetime is taken off, so that connections created
+ * together are not all replaced together.
+ */
+static int64_t
+pool_expiry(connectionPoolObject *self, int64_t now)
+{
+    if (!self->max_lifetime) {
+        return 0;
+    }
+    return now + self->max_lifetime - now % (self->max_lifetime / 20 + 1);
+}
+
+#define pool_expired(slot,now) \
+    ((slot)->expires && (now) >= (slot)->expires)
+
+#define pool_stale(self,slot,now) \
+    ((self)->check_interval \
+        && (now) - (slot)->checked >= (self)->check_interval)
+
+
+/* Put an idle connection on top of the stack, stealing the reference.
+ *
+ * Must be called in a critical section on the pool. There is always space
+ * on the stack, as there are never more than 'maxconn' connections.
+ */
+static void
+pool_push_locked(connectionPoolObject *self, const poolSlot *slot)
+{
+    self->slots[self->nslots++] = *slot;
+}
+
+/* Take an idle connection from the stack into 'slot'.
+ *
+ * Prefer the most recent clean connection returned by the current thread,
+ * then the most recent clean connection, finally one still to reset.
+ * Return 0 if the stack is empty. Must be called in a critical section on
+ * the pool.
+ */
+static int
+pool_pop_locked(connectionPoolObject *self, unsigned long thread,
+        poolSlot *slot)
+{
+    Py_ssize_t i, found = -1;
+
+    for (i = self->nslots - 1; i >= 0; i--) {
+        if (self->slots[i].dirty) { continue; }
+        if (self->slots[i].thread == thread) { found = i; break; }
+        if (found < 0) { found = i; }
+    }
+    if (found < 0) {
+        if (!self->nslots) { return 0; }
+        found = self->nslots - 1;
+    }
+
+    *slot = self->slots[found];
+    memmove(&self->slots[found], &self->slots[found + 1],
+        (self->nslots - found - 1) * sizeof(poolSlot));
+    self->nslots--;
+
+    return 1;
+}
+
+/* Mark a connection as checked out, remembering its expiry time */
+RAISES_NEG static int
+pool_use_locked(connectionPoolObject *self, connectionObject *conn,
+        int64_t expires)
+{
+    PyObject *t;
+    int rv;
+
+    if (!(t = PyLong_FromLongLong(expires))) { return -1; }
+    rv = PyDict_SetItem(self->used, (PyObject *)conn, t);
+    Py_DECREF(t);
+    return rv;
+}
+
+/* Stop accounting for a connection closed or never opened */
+static void
+pool_forget(connectionPoolObject *self, PyObject *conn)
+{
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (conn && 0 > PyDict_DelItem(self->used, conn)) {
+        PyErr_Clear();
+    }
+    self->nconns--;
+    Py_END_CRITICAL_SECTION();
+}
+
+/* Release 'n' connections reserved but not opened */
+static void
+pool_unreserve(connectionPoolObject *self, Py_ssize_t n)
+{
+    if (n <= 0) { return; }
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    self->nconns -= n;
+    Py_END_CRITICAL_SECTION();
+}
+
+/* Mark 'n' connections opened in background as done, opened or not */
+static void
+pool_opened(connectionPoolObject *self, Py_ssize_t n)
+{
+    Py_BEGIN_CRITICAL_SECTION(self);
+    self->nopening -= n;
+    Py_END_CRITICAL_SECTION();
+}
+
+/* Update the average time to open a connection with a new sample */
+static void
+pool_record_connect_locked(connectionPoolObject *self, int64_t usec)
+{
+    self->connect_usec = self->connect_usec ?
+        (3 * self->connect_usec + usec) / 4 : usec;
+}
+
+/* Return the exception currently set, clearing it */
+static PyObject *
+pool_fetch_error(void)
+{
+    PyObject *type, *value, *tb;
+
+    PyErr_Fetch(&type, &value, &tb);
+    PyErr_NormalizeException(&type, &value, &tb);
+    if (tb && value) {
+        PyException_SetTraceback(value, tb);
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(tb);
+    return value;
+}
+
+/* Bring a connection back to the idle state.
+ *
+ * Return 0 if the connection can be reused, else -1: the caller should
+ * close it. Errors are not reported: the connection is just discarded.
+ */
+static int
+pool_reset(connectionPoolObject *self, connectionObject *conn)
+{
+    if (conn->closed) {
+        return -1;
+    }
+
+    switch (PQtransactionStatus(conn->pgconn)) {
+    case PQTRANS_IDLE:
+        break;
+
+    case PQTRANS_INTRANS:
+    case PQTRANS_INERROR:
+        if (!conn->async && 0 == conn_rollback(conn)
+                && PQtransactionStatus(conn->pgconn) == PQTRANS_IDLE) {
+            break;
+        }
+        PyErr_Clear();
+        return -1;
+
+    default:
+        /* server connection lost, or a query still running */
+        return -1;
+    }
+
+    if (self->discard && !conn->async) {
+        if (0 > pq_reset(conn) || 0 > conn_setup(conn)) {
+            PyErr_Clear();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Add a new connection to the idle ones.
+ *
+ * 'start' is the time the connection attempt started.
+ */
+RAISES_NEG static int
+pool_add_idle(connectionPoolObject *self, connectionObject *conn,
+        int64_t start)
+{
+    poolSlot slot;
+    int closed;
+
+    slot.conn = conn;
+    slot.thread = 0;
+    slot.checked = slot.idle_since = fe_monotonic_usec();
+    slot.expires = pool_expiry(self, slot.checked);
+    slot.dirty = 0;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    pool_record_connect_locked(self, slot.checked - start);
+    if (!(closed = self->closed)) {
+        Py_INCREF(conn);
+        pool_push_locked(self, &slot);
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (closed) {
+        pool_raise("connection pool is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* Open a new connection, either checked out or idle in the pool.
+ *
+ * The connection must have been already accounted for in 'nconns'.
+ */
+static connectionObject *
+pool_connect(connectionPoolObject *self, int idle)
+{
+    PyObject *conn;
+    int64_t start = fe_monotonic_usec();
+    int closed = 0, rv = -1;
+
+    if (!(conn = PyObject_CallObject(self->connect, NULL))) { goto exit; }
+    if (!PyObject_TypeCheck(conn, &connectionType)) {
+        PyErr_Format(PyExc_TypeError,
+            "the pool connect function must return a connection, got %s",
+            Py_TYPE(conn)->tp_name);
+        goto exit;
+    }
+
+    if (idle) {
+        rv = pool_add_idle(self, (connectionObject *)conn, start);
+        goto exit;
+    }
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    pool_record_connect_locked(self, fe_monotonic_usec() - start);
+    if (!(closed = self->closed)) {
+        rv = pool_use_locked(
+            self, (connectionObject *)conn, pool_expiry(self, start));
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (closed) {
+        pool_raise("connection pool is closed");
+    }
+
+exit:
+    if (rv < 0) {
+        if (conn && PyObject_TypeCheck(conn, &connectionType)) {
+            conn_close((connectionObject *)conn);
+        }
+        Py_CLEAR(conn);
+        pool_forget(self, NULL);
+    }
+    return (connectionObject *)conn;
+}
+
+/* Open 'n' connections in parallel and add them to the idle ones.
+ *
+ * The connections must have been already accounted for in 'nconns'. They
+ * are started by 'connect_async' and completed together by conn_poll_many(),
+ * then they are made sync. Return the number of connections added, or -1
+ * if any failed: the connections opened successfully are added anyway.
+ */
+static Py_ssize_t
+pool_prewarm(connectionPoolObject *self, Py_ssize_t n)
+{
+    PyObject *pending = NULL, *done = NULL, *exc = NULL;
+    PyObject *conn, *err;
+    Py_ssize_t i, j, added = 0;
+    int64_t start = fe_monotonic_usec();
+    double timeout = -1.0;
+    int ok;
+
+    Dprintf("pool_prewarm: opening %d connections", (int)n);
+
+    if (!(pending = PyList_New(0))) { goto exit; }
+    for (i = 0; i < n; i++) {
+        if (!(conn = PyObject_CallObject(self->connect_async, NULL))) {
+            goto exit;
+        }
+        if (!PyObject_TypeCheck(conn, &connectionType)
+                || !((connectionObject *)conn)->async) {
+            PyErr_SetString(PyExc_TypeError, "the pool connect_async "
+                "function must return an async connection");
+            Py_DECREF(conn);
+            goto exit;
+        }
+        ok = PyList_Append(pending, conn);
+        Py_DECREF(conn);
+        if (ok < 0) { goto exit; }
+    }
+
+    while (PyList_GET_SIZE(pending)) {
+        if (self->connect_timeout) {
+            timeout = (start + self->connect_timeout - fe_monotonic_usec())
+                / 1e6;
+            if (timeout < 0.0) { timeout = 0.0; }
+        }
+        if (!(done = conn_poll_many(pending, timeout))) { goto exit; }
+        if (!PyList_GET_SIZE(done)) {
+            PyErr_SetString(OperationalError,
+                "timeout expired opening the pool connections");
+            goto exit;
+        }
+
+        for (i = 0; i < PyList_GET_SIZE(done); i++) {
+            conn = PyTuple_GET_ITEM(PyList_GET_ITEM(done, i), 0);
+            err = PyTuple_GET_ITEM(PyList_GET_ITEM(done, i), 1);
+
+            if (err == Py_None
+                    && 0 == conn_set_sync((connectionObject *)conn)
+                    && 0 == pool_add_idle(
+                        self, (connectionObject *)conn, start)) {
+                added++;
+            }
+            else {
+                if (err != Py_None) {
+                    Py_INCREF(err);
+                }
+                else {
+                    err = pool_fetch_error();
+                }
+                /* report the first error */
+                if (!exc) { exc = err; } else { Py_XDECREF(err); }
+                conn_close((connectionObject *)conn);
+            }
+
+            if (0 > (j = PySequence_Index(pending, conn))) { goto exit; }
+            if (0 > PySequence_DelItem(pending, j)) { goto exit; }
+        }
+        Py_CLEAR(done);
+    }
+
+exit:
+    if (PyErr_Occurred()) {
+        err = pool_fetch_error();
+        if (!exc) { exc = err; } else { Py_XDECREF(err); }
+    }
+    if (pending) {
+        for (i = 0; i < PyList_GET_SIZE(pending); i++) {
+            conn_close((connectionObject *)PyList_GET_ITEM(pending, i));
+        }
+    }
+    Py_XDECREF(pending);
+    Py_XDECREF(done);
+    pool_unreserve(self, n - added);
+
+    if (exc) {
+        PyErr_SetObject((PyObject *)Py_TYPE(exc), exc);
+        Py_DECREF(exc);
+        return -1;
+    }
+    return added;
+}
+
+/* Open 'n' connections, already accounted for, and add them to the idle ones.
+ *
+ * Return the number of connections added, -1 on error.
+ */
+static Py_ssize_t
+pool_open(connectionPoolObject *self, Py_ssize_t n)
+{
+    connectionObject *conn;
+    Py_ssize_t i;
+
+    if (self->connect_async) {
+        return pool_prewarm(self, n);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!(conn = pool_connect(self, 1))) {
+            pool_unreserve(self, n - i - 1);
+            return -1;
+        }
+        Py_DECREF(conn);
+    }
+    return n;
+}
+
+
+/** the ConnectionPoolBase object **/
+
+#define pool_getconn_doc \
+"_getconn() -> get a connection from the pool, None if exhausted."
+
+static PyObject *
+pool_getconn(connectionPoolObject *self, PyObject *dummy)
+{
+    connectionObject *conn;
+    poolSlot slot;
+    unsigned long thread = PyThread_get_thread_ident();
+    int64_t now;
+    int closed, create, failed, ok;
+
+    for (;;) {
+        conn = NULL;
+        create = failed = 0;
+
+        Py_BEGIN_CRITICAL_SECTION(self);
+        if (!(closed = self->closed)) {
+            if (pool_pop_locked(self, thread, &slot)) {
+                if (0 > pool_use_locked(self, slot.conn, slot.expires)) {
+                    pool_push_locked(self, &slot);
+                    failed = 1;
+                }
+                else {
+                    conn = slot.conn;
+                    self->ncheckouts++;
+                }
+            }
+            else if (self->nconns < self->maxconn && !self->elastic) {
+                self->nconns++;
+                self->ncheckouts++;
+                create = 1;
+            }
+        }
+        Py_END_CRITICAL_SECTION();
+
+        if (closed) {
+            pool_raise("connection pool is closed");
+            return NULL;
+        }
+        if (failed) {
+            return NULL;
+        }
+        if (create) {
+            return (PyObject *)pool_connect(self, 0);
+        }
+        if (!conn) {
+            /* pool exhausted, or growing in background: the caller may wait
+             * for a connection */
+            Py_RETURN_NONE;
+        }
+
+        now = fe_monotonic_usec();
+        if (pool_expired(&slot, now)) {
+            ok = 0;
+        }
+        else if (slot.dirty) {
+            ok = (0 == pool_reset(self, conn));
+        }
+        else if (pool_stale(self, &slot, now)) {
+            ok = pq_is_alive(conn);
+        }
+        else {
+            ok = 1;
+        }
+        if (ok) {
+            return (PyObject *)conn;
+        }
+
+        /* the connection is not usable: try with another one */
+        Dprintf("pool_getconn: discarding connection at %p", conn);
+        conn_close(conn);
+        pool_forget(self, (PyObject *)conn);
+        Py_DECREF(conn);
+    }
+}
+
+
+#define pool_putconn_doc \
+"_putconn(conn, close=False) -> return a connection to the pool.\n\n" \
+"Return True if the pool needs maintenance, i.e. if the connection was\n" \
+"put away to reset or it was discarded."
+
+static PyObject *
+pool_putconn(connectionPoolObject *self, PyObject *args, PyObject *kwargs)
+{
+    connectionObject *conn;
+    PyObject *pyclose = Py_False, *t = NULL;
+    poolSlot slot;
+    int64_t due;
+    int close, found, status, keep = 0, closed = 0, wake;
+    static char *kwlist[] = {"conn", "close", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|O", kwlist,
+            &connectionType, &conn, &pyclose)) {
+        return NULL;
+    }
+    if (0 > (close = PyObject_IsTrue(pyclose))) {
+        return NULL;
+    }
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (0 < (found = PyDict_GetItemRef(self->used, (PyObject *)conn, &t))) {
+        if (0 > PyDict_DelItem(self->used, (PyObject *)conn)) {
+            found = -1;
+        }
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (t) {
+        slot.expires = PyLong_AsLongLong(t);
+        Py_DECREF(t);
+    }
+    if (found < 0) {
+        return NULL;
+    }
+    if (!found) {
+        pool_raise("trying to put a connection not taken from the pool");
+        return NULL;
+    }
+
+    slot.conn = conn;
+    slot.thread = PyThread_get_thread_ident();
+    slot.checked = slot.idle_since = fe_monotonic_usec();
+    slot.dirty = 0;
+    wake = 0;
+
+    if (!close && !self->closed && !pool_expired(&slot, slot.checked)) {
+        status = conn->closed ?
+            PQTRANS_UNKNOWN : PQtransactionStatus(conn->pgconn);
+        if (status == PQTRANS_IDLE && !self->discard) {
+            keep = 1;
+        }
+        else if (self->deferred_reset && !conn->async && (
+                status == PQTRANS_IDLE || status == PQTRANS_INTRANS
+                || status == PQTRANS_INERROR)) {
+            /* reset on checkout or in background */
+            keep = slot.dirty = 1;
+        }
+        else {
+            keep = (0 == pool_reset(self, conn));
+        }
+    }
+
+    if (keep) {
+        Py_BEGIN_CRITICAL_SECTION(self);
+        if (!(closed = self->closed)) {
+            Py_INCREF(conn);
+            pool_push_locked(self, &slot);
+
+            /* the connection may be closed before the next maintenance */
+            due = slot.idle_since + self->max_idle;
+            if (self->max_idle && self->nconns > self->minconn
+                    && (self->maint_due < 0 || self->maint_due > due)) {
+                self->maint_due = due;
+                wake = 1;
+            }
+        }
+        Py_END_CRITICAL_SECTION();
+    }
+
+    if (!keep || closed) {
+        conn_close(conn);
+        pool_forget(self, NULL);
+        Py_RETURN_TRUE;
+    }
+
+    return PyBool_FromLong(slot.dirty || wake);
+}
+
+
+/* Update the checkout rate, once a sample is long enough */
+static void
+pool_update_rate_locked(connectionPoolObject *self, int64_t now)
+{
+    if (now - self->rate_since >= 1000000) {
+        self->checkout_rate =
+            self->ncheckouts * 1e6 / (now - self->rate_since);
+        self->rate_since = now;
+        self->ncheckouts = 0;
+    }
+}
+
+
+#define pool_maintain_doc \
+"_maintain() -> reset, check, replace the idle connections if needed.\n\n" \
+"Return the seconds before maintenance is needed again, None if never."
+
+static PyObject *
+pool_maintain(connectionPoolObject *self, PyObject *dummy)
+{
+    poolSlot *todo = NULL;
+    Py_ssize_t ntodo = 0, excess, nopen = 0, i, j;
+    PyObject *rv = NULL;
+    int64_t now, due = -1;
+    int closed, ok;
+
+    if (!(todo = PyMem_New(poolSlot, self->maxconn))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+
+    /* take out the connections to work on: they are unavailable meanwhile */
+    now = fe_monotonic_usec();
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!(closed = self->closed)) {
+        /* the oldest connections are at the bottom of the stack */
+        excess = self->nconns - self->minconn;
+        for (i = j = 0; i < self->nslots; i++) {
+            poolSlot *slot = &self->slots[i];
+            if (self->max_idle && excess > 0
+                    && now - slot->idle_since >= self->max_idle) {
+                /* make it expire to close it */
+                todo[ntodo] = *slot;
+                todo[ntodo++].expires = now;
+                excess--;
+            }
+            else if (slot->dirty || pool_expired(slot, now)
+                    || pool_stale(self, slot, now)) {
+                todo[ntodo++] = *slot;
+            }
+            else {
+                self->slots[j++] = *slot;
+            }
+        }
+        self->nslots = j;
+        pool_update_rate_locked(self, now);
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (closed) {
+        pool_raise("connection pool is closed");
+        goto exit;
+    }
+
+    for (i = 0; i < ntodo; i++) {
+        poolSlot *slot = &todo[i];
+
+        if (pool_expired(slot, now)) {
+            ok = 0;
+        }
+        else if (slot->dirty) {
+            ok = (0 == pool_reset(self, slot->conn));
+        }
+        else {
+            ok = pq_is_alive(slot->conn);
+        }
+
+        if (ok) {
+            slot->checked = fe_monotonic_usec();
+            slot->dirty = 0;
+            Py_BEGIN_CRITICAL_SECTION(self);
+            if (!(closed = self->closed)) {
+                pool_push_locked(self, slot);
+            }
+            Py_END_CRITICAL_SECTION();
+        }
+        if (!ok || closed) {
+            Dprintf("pool_maintain: discarding connection at %p", slot->conn);
+            conn_close(slot->conn);
+            pool_forget(self, NULL);
+            Py_DECREF(slot->conn);
+        }
+    }
+
+    /* open new connections to replace the ones discarded */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!self->closed && (nopen = self->minconn - self->nconns) > 0) {
+        self->nconns += nopen;
+        self->nopening += nopen;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (nopen > 0) {
+        ok = (0 <= pool_open(self, nopen));
+        pool_opened(self, nopen);
+        if (!ok) { goto exit; }
+    }
+
+    /* find when the next connection will need attention */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    for (i = 0; i < self->nslots; i++) {
+        poolSlot *slot = &self->slots[i];
+        int64_t t;
+
+        if (slot->dirty) {
+            due = now;
+            break;
+        }
+        if (slot->expires && (due < 0 || slot->expires < due)) {
+            due = slot->expires;
+        }
+        t = slot->checked + self->check_interval;
+        if (self->check_interval && (due < 0 || t < due)) {
+            due = t;
+        }
+        t = slot->idle_since + self->max_idle;
+        if (self->max_idle && self->nconns > self->minconn
+                && (due < 0 || t < due)) {
+            due = t;
+        }
+    }
+    self->maint_due = due;
+    Py_END_CRITICAL_SECTION();
+
+    if (due < 0) {
+        Py_INCREF(Py_None);
+        rv = Py_None;
+    }
+    else {
+        now = fe_monotonic_usec();
+        rv = PyFloat_FromDouble(due > now ? (due - now) / 1e6 : 0.0);
+    }
+
+exit:
+    PyMem_Free(todo);
+    return rv;
+}
+
+
+#define pool_reserve_doc \
+"_reserve(waiting) -> reserve the connections to open for waiting callers.\n\n" \
+"Return the number of connections to open with `_prewarm()`."
+
+static PyObject *
+pool_reserve(connectionPoolObject *self, PyObject *args)
+{
+    Py_ssize_t waiting, n = 0;
+    int closed;
+
+    if (!PyArg_ParseTuple(args, "n", &waiting)) {
+        return NULL;
+    }
+
+    /* One connection for each caller waiting, plus the ones expected to be
+     * requested while the new connections are being opened; minus the ones
+     * idle or already being opened. */
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!(closed = self->closed)) {
+        pool_update_rate_locked(self, fe_monotonic_usec());
+        n = waiting - self->nslots - self->nopening + (Py_ssize_t)ceil(
+            self->checkout_rate * self->connect_usec / 1e6);
+        if (n > self->maxconn - self->nconns) {
+            n = self->maxconn - self->nconns;
+        }
+        if (n > 0) {
+            self->nconns += n;
+            self->nopening += n;
+        }
+        else {
+            n = 0;
+        }
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (closed) {
+        pool_raise("connection pool is closed");
+        return NULL;
+    }
+
+    return PyInt_FromSsize_t(n);
+}
+
+
+#define pool_prewarm_doc \
+"_prewarm(n) -> open *n* connections reserved by `_reserve()`.\n\n" \
+"The connections are opened in parallel if possible and added to the\n" \
+"idle ones. Return the number of connections added."
+
+static PyObject *
+pool_prewarm_meth(connectionPoolObject *self, PyObject *args)
+{
+    Py_ssize_t n, added;
+
+    if (!PyArg_ParseTuple(args, "n", &n)) {
+        return NULL;
+    }
+
+    added = pool_open(self, n);
+    pool_opened(self, n);
+    if (added < 0) {
+        return NULL;
+    }
+    return PyInt_FromSsize_t(added);
+}
+
+
+#define pool_closeall_doc \
+"_closeall() -> close all the connections, including the ones in use."
+
+static PyObject *
+pool_closeall(connectionPoolObject *self, PyObject *dummy)
+{
+    poolSlot *slots = NULL;
+    Py_ssize_t nslots = 0, i;
+    PyObject *used = NULL;
+    int closed;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!(closed = self->closed)) {
+        self->closed = 1;
+        slots = self->slots;
+        nslots = self->nslots;
+        self->slots = NULL;
+        self->nslots = 0;
+        self->nconns -= nslots;
+    }
+    Py_END_CRITICAL_SECTION();
+
+    if (closed) {
+        pool_raise("connection pool is closed");
+        return NULL;
+    }
+
+    for (i = 0; i < nslots; i++) {
+        conn_close(slots[i].conn);
+        Py_DECREF(slots[i].conn);
+    }
+    PyMem_Free(slots);
+
+    /* the connections in use are forgotten when returned */
+    if (!(used = PySequence_List(self->used))) {
+        return NULL;
+    }
+    for (i = 0; i < PyList_GET_SIZE(used); i++) {
+        conn_close((connectionObject *)PyList_GET_ITEM(used, i));
+    }
+    Py_DECREF(used);
+
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+pool_closed_get(connectionPoolObject *self)
+{
+    return PyBool_FromLong(self->closed);
+}
+
+/* Return a time in usec as seconds, None if 0 */
+static PyObject *
+pool_usec_get(connectionPoolObject *self, void *closure)
+{
+    int64_t usec = *(int64_t *)((char *)self + (Py_ssize_t)closure);
+
+    if (!usec) {
+        Py_RETURN_NONE;
+    }
+    return PyFloat_FromDouble(usec / 1e6);
+}
+
+/* Parse a time in seconds into usec, None meaning 0 */
+RAISES_NEG static int
+pool_usec_parse(PyObject *obj, const char *name, int64_t *usec)
+{
+    double secs;
+
+    *usec = 0;
+    if (obj == Py_None) {
+        return 0;
+    }
+    if (-1.0 == (secs = PyFloat_AsDouble(obj)) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (secs <= 0.0) {
+        PyErr_Format(PyExc_ValueError, "%s must be positive or None", name);
+        return -1;
+    }
+    *usec = (int64_t)(secs * 1e6);
+    return 0;
+}
+
+
+/* object method list */
+
+static struct PyMethodDef pool_methods[] = {
+    {"_getconn", (PyCFunction)pool_getconn,
+     METH_NOARGS, pool_getconn_doc},
+    {"_putconn", (PyCFunction)pool_putconn,
+     METH_VARARGS|METH_KEYWORDS, pool_putconn_doc},
+    {"_maintain", (PyCFunction)pool_maintain,
+     METH_NOARGS, pool_maintain_doc},
+    {"_reserve", (PyCFunction)pool_reserve,
+     METH_VARARGS, pool_reserve_doc},
+    {"_prewarm", (PyCFunction)pool_prewarm_meth,
+     METH_VARARGS, pool_prewarm_doc},
+    {"_closeall", (PyCFunction)pool_closeall,
+     METH_NOARGS, pool_closeall_doc},
+    {NULL}
+};
+
+/* object member list */
+
+#define OFFSETOF(x) offsetof(connectionPoolObject, x)
+
+static struct PyMemberDef pool_members[] = {
+    {"minconn", T_PYSSIZET, OFFSETOF(minconn), READONLY,
+        "The number of connections opened on creation."},
+    {"maxconn", T_PYSSIZET, OFFSETOF(maxconn), READONLY,
+        "The maximum number of connections managed by the pool."},
+    {"size", T_PYSSIZET, OFFSETOF(nconns), READONLY,
+        "The number of connections currently managed by the pool."},
+    {"idle", T_PYSSIZET, OFFSETOF(nslots), READONLY,
+        "The number of connections ready to be used."},
+    {NULL}
+};
+
+/* object getset list */
+
+static struct PyGetSetDef pool_getsets[] = {
+    { "closed", (getter)pool_closed_get, NULL,
+        "True if `closeall()` was called on the pool.", NULL },
+    { "max_lifetime", (getter)pool_usec_get, NULL,
+        "Seconds after which a connection is replaced.",
+        (void *)OFFSETOF(max_lifetime) },
+    { "check_interval", (getter)pool_usec_get, NULL,
+        "Seconds after which an idle connection is checked before use.",
+        (void *)OFFSETOF(check_interval) },
+    { "max_idle", (getter)pool_usec_get, NULL,
+        "Seconds after which an idle connection over minconn is closed.",
+        (void *)OFFSETOF(max_idle) },
+    {NULL}
+};
+
+/* initialization and finalization methods */
+
+static int
+pool_init(connectionPoolObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *connect, *connect_async = Py_None;
+    PyObject *pydeferred = Py_False, *pydiscard = Py_False;
+    PyObject *pyelastic = Py_False, *pytimeout = Py_None;
+    PyObject *pylifetime = Py_None, *pyinterval = Py_None, *pyidle = Py_None;
+    Py_ssize_t minconn, maxconn;
+    static char *kwlist[] = {
+        "connect", "minconn", "maxconn", "deferred_reset", "discard",
+        "max_lifetime", "check_interval", "connect_async", "connect_timeout",
+        "max_idle", "elastic", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Onn|OOOOOOOO", kwlist,
+            &connect, &minconn, &maxconn, &pydeferred, &pydiscard,
+            &pylifetime, &pyinterval, &connect_async, &pytimeout,
+            &pyidle, &pyelastic)) {
+        return -1;
+    }
+
+    if (self->connect) {
+        PyErr_SetString(PyExc_TypeError, "the pool is already initialized");
+        return -1;
+    }
+    if (!PyCallable_Check(connect)) {
+        PyErr_SetString(PyExc_TypeError, "connect must be a callable");
+        return -1;
+    }
+    if (connect_async != Py_None && !PyCallable_Check(connect_async)) {
+        PyErr_SetString(PyExc_TypeError,
+            "connect_async must be a callable or None");
+        return -1;
+    }
+    if (minconn < 0 || maxconn < 1 || minconn > maxconn) {
+        PyErr_Format(PyExc_ValueError,
+            "invalid pool size: minconn=%zd, maxconn=%zd", minconn, maxconn);
+        return -1;
+    }
+    if (0 > (self->deferred_reset = PyObject_IsTrue(pydeferred))) {
+        return -1;
+    }
+    if (0 > (self->discard = PyObject_IsTrue(pydiscard))) {
+        return -1;
+    }
+    if (0 > (self->elastic = PyObject_IsTrue(pyelastic))) {
+        return -1;
+    }
+    if (0 > pool_usec_parse(pylifetime, "max_lifetime", &self->max_lifetime)) {
+        return -1;
+    }
+    if (0 > pool_usec_parse(
+            pyinterval, "check_interval", &self->check_interval)) {
+        return -1;
+    }
+    if (0 > pool_usec_parse(pyidle, "max_idle", &self->max_idle)) {
+        return -1;
+    }
+    if (0 > pool_usec_parse(
+            pytimeout, "connect_timeout", &self->connect_timeout)) {
+        return -1;
+    }
+
+    if (!(self->used = PyDict_New())) { return -1; }
+    if (!(self->slots = PyMem_New(poolSlot, maxconn))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    Py_INCREF(connect);
+    self->connect = connect;
+    if (connect_async != Py_None) {
+        Py_INCREF(connect_async);
+        self->connect_async = connect_async;
+    }
+    self->minconn = minconn;
+    self->maxconn = maxconn;
+    self->rate_since = fe_monotonic_usec();
+    self->maint_due = -1;
+
+    /* open the first connections, in parallel if possible */
+    if (minconn) {
+        self->nconns = minconn;
+        if (0 > pool_open(self, minconn)) { return -1; }
+    }
+
+    return 0;
+}
+
+static int
+pool_traverse(connectionPoolObject *self, visitproc visit, void *arg)
+{
+    Py_ssize_t i;
+
+    Py_VISIT(self->connect);
+    Py_VISIT(self->connect_async);
+    Py_VISIT(self->used);
+    for (i = 0; i < self->nslots; i++) {
+        Py_VISIT((PyObject *)self->slots[i].conn);
+    }
+    return 0;
+}
+
+static int
+pool_clear(connectionPoolObject *self)
+{
+    Py_ssize_t i;
+
+    Py_CLEAR(self->connect);
+    Py_CLEAR(self->connect_async);
+    Py_CLEAR(self->used);
+    for (i = 0; i < self->nslots; i++) {
+        Py_CLEAR(self->slots[i].conn);
+    }
+    self->nslots = 0;
+    return 0;
+}
+
+static void
+pool_dealloc(connectionPoolObject *self)
+{
+    PyObject_GC_UnTrack((PyObject *)self);
+    pool_clear(self);
+    PyMem_Free(self->slots);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* object type */
+
+#define connectionPoolType_doc \
+"ConnectionPoolBase(connect, minconn, maxconn, deferred_reset=False,\n" \
+"    discard=False, max_lifetime=None, check_interval=None,\n" \
+"    connect_async=None, connect_timeout=None, max_idle=None,\n" \
+"    elastic=False)\n\n" \
+"Core of a thread-safe pool of the connections returned by *connect*."
+
+PyTypeObject connectionPoolType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "psycopg2._psycopg.ConnectionPoolBase",
+    sizeof(connectionPoolObject), 0,
+    (destructor)pool_dealloc, /* tp_dealloc */
+    0,          /*tp_print*/
+    0,          /*tp_getattr*/
+    0,          /*tp_setattr*/
+    0,          /*tp_compare*/
+    0,          /*tp_repr*/
+    0,          /*tp_as_number*/
+    0,          /*tp_as_sequence*/
+    0,          /*tp_as_mapping*/
+    0,          /*tp_hash */
+    0,          /*tp_call*/
+    0,          /*tp_str*/
+    0,          /*tp_getattro*/
+    0,          /*tp_setattro*/
+    0,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_HAVE_GC, /*tp_flags*/
+    connectionPoolType_doc, /*tp_doc*/
+    (traverseproc)pool_traverse, /*tp_traverse*/
+    (inquiry)pool_clear, /*tp_clear*/
+    0,          /*tp_richcompare*/
+    0,          /*tp_weaklistoffset*/
+    0,          /*tp_iter*/
+    0,          /*tp_iternext*/
+    pool_methods, /*tp_methods*/
+    pool_members, /*tp_members*/
+    pool_getsets, /*tp_getset*/
+    0,          /*tp_base*/
+    0,          /*tp_dict*/
+    0,          /*tp_descr_get*/
+    0,          /*tp_descr_set*/
+    0,          /*tp_dictoffset*/
+    (initproc)pool_init, /*tp_init*/
+    0,          /*tp_alloc*/
+    PyType_GenericNew, /*tp_new*/
+};
@@ -48,6 +48,7 @@
 #include "libpq-fe.h"
 
 #include <stdlib.h>
+#include <ctype.h>
 #ifdef _WIN32
 /* select() */
 #include <winsock2.h>
@@ -60,6 +61,9 @@
 #else
 #include <sys/time.h>
 #endif
+#ifndef _WIN32
+#include <poll.h>
+#endif
 
 extern HIDDEN PyObject *psyco_DescriptionType;
 extern HIDDEN const char *srv_isolevels[];
@@ -333,24 +337,17 @@ pq_complete_error(connectionObject *conn)
 }
 
 
-/* pq_begin_locked - begin a transaction, if necessary
+/* _pq_begin_statement - write the statement to begin a transaction
 
-   This function should only be called on a locked connection without
-   holding the global interpreter lock.
+   Write into buf the BEGIN statement to run according to the connection
+   transaction characteristics. Return 0 if no transaction must be started,
+   1 if buf was filled.
 
-   On error, -1 is returned, and the conn->pgres argument will hold the
-   relevant result structure.
+   This function should only be called on a locked connection.
  */
-int
-pq_begin_locked(connectionObject *conn, PyThreadState **tstate)
+static int
+_pq_begin_statement(connectionObject *conn, char *buf, size_t bufsize)
 {
-    const size_t bufsize = 256;
-    char buf[256];  /* buf size must be same as bufsize */
-    int result;
-
-    Dprintf("pq_begin_locked: pgconn = %p, %d, status = %d",
-            conn->pgconn, conn->autocommit, conn->status);
-
     if (conn->status != CONN_STATUS_READY) {
         Dprintf("pq_begin_locked: transaction in progress");
         return 0;
@@ -364,7 +361,7 @@ pq_begin_locked(connectionObject *conn, PyThreadState **tstate)
     if (conn->isolevel == ISOLATION_LEVEL_DEFAULT
             && conn->readonly == STATE_DEFAULT
             && conn->deferrable == STATE_DEFAULT) {
-        strcpy(buf, "BEGIN");
+        snprintf(buf, bufsize, "BEGIN");
     }
     else {
         snprintf(buf, bufsize,
@@ -378,6 +375,30 @@ pq_begin_locked(connectionObject *conn, PyThreadState **tstate)
             srv_deferrable[conn->deferrable]);
     }
 
+    return 1;
+}
+
+/* pq_begin_locked - begin a transaction, if necessary
+
+   This function should only be called on a locked connection without
+   holding the global interpreter lock.
+
+   On error, -1 is returned, and the conn->pgres argument will hold the
+   relevant result structure.
+ */
+int
+pq_begin_locked(connectionObject *conn, PyThreadState **tstate)
+{
+    char buf[256];
+    int result;
+
+    Dprintf("pq_begin_locked: pgconn = %p, %d, status = %d",
+            conn->pgconn, conn->autocommit, conn->status);
+
+    if (!_pq_begin_statement(conn, buf, sizeof(buf))) {
+        return 0;
+    }
+
     result = pq_execute_command_locked(conn, buf, tstate);
     if (result == 0)
         conn->status = CONN_STATUS_BEGIN;
@@ -556,6 +577,58 @@ pq_reset(connectionObject *conn)
 }
 
 
+/* pq_is_alive - check if an idle connection is still usable
+
+   Return 1 if the connection is idle and looks alive, 0 otherwise. No query
+   is sent: data readable on the socket of an idle connection is either an
+   asynchronous message (a notification, a notice, a parameter change) or
+   the server closing the connection, so it is consumed to find out which.
+
+   This function should be called while holding the global interpreter
+   lock. It doesn't block.
+*/
+
+int
+pq_is_alive(connectionObject *conn)
+{
+    struct pollfd pfd;
+    int i, rv = 0;
+
+    if (conn->closed || conn->async_cursor
+            || PQstatus(conn->pgconn) != CONNECTION_OK
+            || PQtransactionStatus(conn->pgconn) != PQTRANS_IDLE) {
+        return 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    pthread_mutex_lock(&conn->lock);
+
+    pfd.fd = PQsocket(conn->pgconn);
+    pfd.events = POLLIN;
+
+    /* the end of the stream may come after a final error message */
+    for (i = 0; i < 8; i++) {
+        pfd.revents = 0;
+        if (0 >= poll(&pfd, 1, 0)) { break; }
+        if (!PQconsumeInput(conn->pgconn)) { break; }
+        PQisBusy(conn->pgconn);     /* parse the messages received */
+    }
+    rv = (PQstatus(conn->pgconn) == CONNECTION_OK
+        && PQtransactionStatus(conn->pgconn) == PQTRANS_IDLE);
+
+    Py_BLOCK_THREADS;
+    conn_notifies_process(conn);
+    conn_notice_process(conn);
+    Py_UNBLOCK_THREADS;
+
+    pthread_mutex_unlock(&conn->lock);
+    Py_END_ALLOW_THREADS;
+
+    Dprintf("pq_is_alive: pgconn = %p, alive = %d", conn->pgconn, rv);
+    return rv;
+}
+
+
 /* Get a session parameter.
  *
  * The function should be called on a locked connection without
@@ -622,23 +695,49 @@ pq_set_guc_locked(
     connectionObject *conn, const char *param, const char *value,
     PyThreadState **tstate)
 {
-    char query[256];
-    int size;
-    int rv = -1;
+    return pq_set_gucs_locked(conn, 1, &param, &value, tstate);
+}
 
-    Dprintf("pq_set_guc_locked: setting %s to %s", param, value);
+/* Set several session parameters with a single command.
+ *
+ * 'params' and 'values' are arrays of 'n' elements. All the SET are sent to
+ * the server in one message, so they take a single round trip and, running
+ * in the same implicit transaction, either all of them or none is applied.
+ *
+ * The function should be called on a locked connection without
+ * holding the GIL
+ */
 
-    if (0 == strcmp(value, "default")) {
-        size = PyOS_snprintf(query, sizeof(query),
-            "SET %s TO DEFAULT", param);
-    }
-    else {
-        size = PyOS_snprintf(query, sizeof(query),
-            "SET %s TO '%s'", param, value);
+int
+pq_set_gucs_locked(
+    connectionObject *conn, int n, const char *params[],
+    const char *values[], PyThreadState **tstate)
+{
+    char query[1024];
+    size_t len = 0;
+    int i, size;
+    int rv = -1;
+
+    if (n <= 0) {
+        return 0;
     }
-    if (size < 0 || (size_t)size >= sizeof(query)) {
-        conn_set_error(conn, "SET: query too large");
-        goto exit;
+
+    for (i = 0; i < n; i++) {
+        Dprintf("pq_set_gucs_locked: setting %s to %s", params[i], values[i]);
+
+        if (0 == strcmp(values[i], "default")) {
+            size = PyOS_snprintf(query + len, sizeof(query) - len,
+                "%sSET %s TO DEFAULT", i ? ";" : "", params[i]);
+        }
+        else {
+            size = PyOS_snprintf(query + len, sizeof(query) - len,
+                "%sSET %s TO '%s'", i ? ";" : "", params[i], values[i]);
+        }
+        if (size < 0 || (size_t)size >= sizeof(query) - len) {
+            conn_set_error(conn, "SET: query too large");
+            goto exit;
+        }
+        len += size;
     }
 
     rv = pq_execute_command_locked(conn, query, tstate);
@@ -815,34 +914,132 @@ pq_flush(connectionObject *conn)
  * This function call Py_*_ALLOW_THREADS macros
 */
 
+/* _pq_query_with_begin - prepend the BEGIN statement to a query
+
+   Return a new string on the Python heap with the statement to begin a
+   transaction, if one is needed, followed by the query, so that both can
+   be sent to the server in a single message. Return NULL if no transaction
+   needs to be started or, with an exception set, in case of error.
+
+   The connection status is checked again when the connection is locked:
+   the string is only a guess made holding the GIL.
+ */
+static char *
+_pq_query_with_begin(connectionObject *conn, const char *query)
+{
+    char begin[256];
+    char *rv;
+    const char *c;
+    size_t blen, qlen;
+
+    /* A query with no statement (e.g. only a comment) would make the
+     * BEGIN result look like its own: only send together queries starting
+     * with a keyword. */
+    for (c = query; *c == ' ' || *c == '\t' || *c == '\n' || *c == '\r'; c++) {}
+    if (!(isalpha((unsigned char)*c) || *c == '(')) {
+        return NULL;
+    }
+
+    if (!_pq_begin_statement(conn, begin, sizeof(begin))) {
+        return NULL;
+    }
+
+    blen = strlen(begin);
+    qlen = strlen(query);
+    if (!(rv = PyMem_Malloc(blen + qlen + 2))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memcpy(rv, begin, blen);
+    rv[blen] = ';';
+    memcpy(rv + blen + 1, query, qlen + 1);
+
+    return rv;
+}
+
 RAISES_NEG int
 _pq_execute_sync(cursorObject *curs, const char *query, int no_result, int no_begin)
 {
     connectionObject *conn = curs->conn;
+    char *query_begin = NULL;
+    const char *command = query;
 
     CLEARPGRES(curs->pgres);
 
+    if (!no_begin && conn->begin_with_query
+            && !(query_begin = _pq_query_with_begin(conn, query))
+            && PyErr_Occurred()) {
+        return -1;
+    }
+
     Py_BEGIN_ALLOW_THREADS;
     pthread_mutex_lock(&(conn->lock));
 
-    if (!no_begin && pq_begin_locked(conn, &_save) < 0) {
-        pthread_mutex_unlock(&(conn->lock));
-        Py_BLOCK_THREADS;
-        pq_complete_error(conn);
-        return -1;
+    if (!no_begin) {
+        if (query_begin && conn->status == CONN_STATUS_READY) {
+            /* send the BEGIN together with the query */
+            command = query_begin;
+        }
+        else if (pq_begin_locked(conn, &_save) < 0) {
+            pthread_mutex_unlock(&(conn->lock));
+            Py_BLOCK_THREADS;
+            PyMem_Free(query_begin);
+            pq_complete_error(conn);
+            return -1;
+        }
     }
 
+execute:
     Dprintf("pq_execute: executing SYNC query: pgconn = %p", conn->pgconn);
-    Dprintf("    %-.200s", query);
+    Dprintf("    %-.200s", command);
     if (!psyco_green()) {
-        conn_set_result(conn, PQexec(conn->pgconn, query));
+        conn_set_result(conn, PQexec(conn->pgconn, command));
     }
     else {
         Py_BLOCK_THREADS;
-        conn_set_result(conn, psyco_exec_green(conn, query));
+        conn_set_result(conn, psyco_exec_green(conn, command));
         Py_UNBLOCK_THREADS;
     }
 
+    /* If the BEGIN was sent with the query, the server tells whether it
+     * was executed. The server idle after an error doesn't mean that
+     * nothing was executed: the query may have committed the transaction
+     * itself before failing. Only a syntax error proves it, because the
+     * server parses the whole message before running any statement: in
+     * this case send the two statements separately, as without
+     * begin_with_query, so that the error is attributed to the right
+     * statement and the transaction is left in the same state. Any other
+     * error is reported as it is. */
+    if (command == query_begin && conn->pgres) {
+        const char *code;
+
+        switch (PQtransactionStatus(conn->pgconn)) {
+        case PQTRANS_ACTIVE:    /* e.g. in COPY */
+        case PQTRANS_INTRANS:
+        case PQTRANS_INERROR:
+            conn->status = CONN_STATUS_BEGIN;
+            break;
+        default:
+            if (PQresultStatus(conn->pgres) == PGRES_FATAL_ERROR
+                    && (code = PQresultErrorField(
+                        conn->pgres, PG_DIAG_SQLSTATE))
+                    && 0 == strcmp(code, "42601")) {
+                Dprintf("pq_execute: BEGIN with query failed, "
+                    "sending them apart");
+                command = query;
+                if (pq_begin_locked(conn, &_save) < 0) {
+                    pthread_mutex_unlock(&(conn->lock));
+                    Py_BLOCK_THREADS;
+                    PyMem_Free(query_begin);
+                    pq_complete_error(conn);
+                    return -1;
+                }
+                goto execute;
+            }
+            break;
+        }
+    }
+
     /* don't let pgres = NULL go to pq_fetch() */
     if (!conn->pgres) {
         if (CONNECTION_BAD == PQstatus(conn->pgconn)) {
@@ -850,6 +1047,7 @@ _pq_execute_sync(cursorObject *curs, const char *query, int no_result, int no_be
         }
         pthread_mutex_unlock(&(conn->lock));
         Py_BLOCK_THREADS;
+        PyMem_Free(query_begin);
         if (!PyErr_Occurred()) {
             PyErr_SetString(OperationalError,
                             PQerrorMessage(conn->pgconn));
@@ -859,6 +1057,8 @@ _pq_execute_sync(cursorObject *curs, const char *query, int no_result, int no_be
 
     Py_BLOCK_THREADS;
 
+    PyMem_Free(query_begin);
+
     /* assign the result back to the cursor now that we have the GIL */
     curs_set_result(curs, conn->pgres);
     conn->pgres = NULL;
@@ -1019,13 +1219,14 @@ _get_cast(cursorObject *curs, PGresult *pgres, int i)
     if (cast == psyco_default_binary_cast && PQbinaryTuples(pgres)) {
         Dprintf("_pq_fetch_tuples: Binary cursor and "
                 "binary field: %u using default cast", ftype);
+        Py_DECREF(cast);
         cast = psyco_default_cast;
+        Py_INCREF(cast);
     }
 
     Dprintf("_pq_fetch_tuples: using cast at %p for type %u", cast, ftype);
 
     /* success */
-    Py_INCREF(cast);
     rv = cast;
 
 exit:
@@ -1138,6 +1339,7 @@ _pq_fetch_tuples(cursorObject *curs)
     int rv = -1;
     PyObject *description = NULL;
     PyObject *casts = NULL;
+    typecast_function *ccasts = NULL;
 
     Py_BEGIN_ALLOW_THREADS;
     pthread_mutex_lock(&(curs->conn->lock));
@@ -1150,8 +1352,14 @@ _pq_fetch_tuples(cursorObject *curs)
     /* create the tuple for description and typecasting */
     Py_CLEAR(curs->description);
     Py_CLEAR(curs->casts);
+    PyMem_Free(curs->ccasts);
+    curs->ccasts = NULL;
     if (!(description = PyTuple_New(pgnfields))) { goto exit; }
     if (!(casts = PyTuple_New(pgnfields))) { goto exit; }
+    if (!(ccasts = PyMem_New(typecast_function, pgnfields))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
     curs->columns = pgnfields;
 
     /* calculate each field's parameters and typecasters */
@@ -1168,6 +1376,9 @@ _pq_fetch_tuples(cursorObject *curs)
             goto exit;
         }
         PyTuple_SET_ITEM(casts, i, cast);
+
+        /* resolve once here the typecasters not requiring a full dispatch */
+        ccasts[i] = typecast_get_ccast(cast);
     }
 
     curs->description = description;
@@ -1176,11 +1387,15 @@ _pq_fetch_tuples(cursorObject *curs)
     curs->casts = casts;
     casts = NULL;
 
+    curs->ccasts = ccasts;
+    ccasts = NULL;
+
     rv = 0;
 
 exit:
     Py_XDECREF(description);
     Py_XDECREF(casts);
+    PyMem_Free(ccasts);
 
     Py_BEGIN_ALLOW_THREADS;
     pthread_mutex_unlock(&(curs->conn->lock));
@@ -1444,41 +1659,64 @@ exit:
     return ret;
 }
 
-/* Tries to read the next message from the replication stream, without
-   blocking, in both sync and async connection modes.  If no message
-   is ready in the CopyData buffer, tries to read from the server,
-   again without blocking.  If that doesn't help, returns Py_None.
-   The caller is then supposed to block on the socket(s) and call this
-   function again.
+/* Return how long (in usec) before a feedback message is due, <= 0 if it is.
 
-   Any keepalive messages from the server are silently consumed and
-   are never returned to the caller.
+   The monotonic clock is used, so that changes of the system time don't
+   stop the keepalives or flood the server.
  */
-int
-pq_read_replication_message(replicationCursorObject *repl, replicationMessageObject **msg)
+static int64_t
+_pq_replication_feedback_wait(replicationCursorObject *repl)
+{
+    int64_t interval;
+
+    interval = (int64_t)repl->status_interval.tv_sec * USECS_PER_SEC
+        + repl->status_interval.tv_usec;
+    return repl->last_feedback_mono + interval - fe_monotonic_usec();
+}
+
+/* Send a feedback message to the server if the status interval elapsed
+   or if send_feedback() asked for one while the consume loop was running.
+ */
+static int
+_pq_replication_feedback_if_due(replicationCursorObject *repl)
+{
+    int request;
+
+    request = flags_atomic_take(&repl->feedback_request);
+    if (request) {
+        return pq_send_replication_feedback(
+            repl, request & REPL_FEEDBACK_REPLY);
+    }
+
+    if (_pq_replication_feedback_wait(repl) <= 0) {
+        return pq_send_replication_feedback(repl, 0);
+    }
+    return 0;
+}
+
+/* Read the next message from the replication stream without blocking.
+
+   If consume_input is set and no message is ready in the CopyData buffer,
+   read from the server, again without blocking, otherwise only consider
+   the data already received.  Set *io if anything was read from the
+   stream: keeping the io timestamp is left to the caller.
+ */
+static int
+_pq_read_replication_message(replicationCursorObject *repl,
+    replicationMessageObject **msg, int consume_input, int *io)
 {
     cursorObject *curs = &repl->cur;
     connectionObject *conn = curs->conn;
     PGconn *pgconn = conn->pgconn;
     char *buffer = NULL;
     int len, data_size, consumed, hdr, reply;
-    XLogRecPtr data_start, wal_end;
+    XLogRecPtr data_start, wal_end, flushed_lsn;
     int64_t send_time;
-    PyObject *str = NULL, *result = NULL;
+    PyObject *str = NULL;
     int ret = -1;
-    struct timeval curr_time, feedback_time;
-
-    Dprintf("pq_read_replication_message");
 
     *msg = NULL;
-    consumed = 0;
-
-    /* Is it a time to send the next feedback message? */
-    gettimeofday(&curr_time, NULL);
-    timeradd(&repl->last_feedback, &repl->status_interval, &feedback_time);
-    if (timercmp(&curr_time, &feedback_time, >=) && pq_send_replication_feedback(repl, 0) < 0) {
-        goto exit;
-    }
+    consumed = !consume_input;
 
 retry:
     len = PQgetCopyData(pgconn, &buffer, 1 /* async */);
@@ -1531,8 +1769,8 @@ retry:
        will trigger read condition in select() in the calling code anyway. */
     consumed = 1;
 
-    /* ok, we did really read something: update the io timestamp */
-    gettimeofday(&repl->last_io, NULL);
+    /* ok, we did really read something */
+    *io = 1;
 
     Dprintf("pq_read_replication_message: msg=%c, len=%d", buffer[0], len);
     if (buffer[0] == 'w') {
@@ -1555,17 +1793,19 @@ retry:
 
         if (repl->decode) {
             str = conn_decode(conn, buffer + hdr, data_size);
+        } else if (repl->zero_copy) {
+            /* the payload takes over the buffer, which is not copied */
+            str = typecast_binary_from_pqmem(buffer, hdr, data_size);
+            buffer = NULL;
         } else {
             str = Bytes_FromStringAndSize(buffer + hdr, data_size);
         }
         if (!str) { goto exit; }
 
-        result = PyObject_CallFunctionObjArgs((PyObject *)&replicationMessageType,
-                                              curs, str, NULL);
+        *msg = replmsg_new(curs, str);
         Py_DECREF(str);
-        if (!result) { goto exit; }
+        if (!*msg) { goto exit; }
 
-        *msg = (replicationMessageObject *)result;
         (*msg)->data_size  = data_size;
         (*msg)->data_start = data_start;
         (*msg)->wal_end    = wal_end;
@@ -1588,10 +1828,10 @@ retry:
 
         /* We can safely forward flush_lsn to the wal_end from the server keepalive message
          * if we know that the client already processed (confirmed) the last XLogData message */
-        if (repl->explicitly_flushed_lsn >= repl->last_msg_data_start
-                && wal_end > repl->explicitly_flushed_lsn
-                && wal_end > repl->flush_lsn) {
-            repl->flush_lsn = wal_end;
+        flushed_lsn = lsn_atomic_load(&repl->explicitly_flushed_lsn);
+        if (flushed_lsn >= repl->last_msg_data_start
+                && wal_end > flushed_lsn) {
+            lsn_atomic_advance(&repl->flush_lsn, wal_end);
         }
 
         reply = buffer[hdr];
@@ -1618,6 +1858,90 @@ exit:
     return ret;
 }
 
+/* Tries to read the next message from the replication stream, without
+   blocking, in both sync and async connection modes.  If no message
+   is ready in the CopyData buffer, tries to read from the server,
+   again without blocking.  If that doesn't help, returns Py_None.
+   The caller is then supposed to block on the socket(s) and call this
+   function again.
+
+   Any keepalive messages from the server are silently consumed and
+   are never returned to the caller.
+ */
+int
+pq_read_replication_message(replicationCursorObject *repl, replicationMessageObject **msg)
+{
+    int io = 0;
+
+    Dprintf("pq_read_replication_message");
+
+    *msg = NULL;
+
+    /* Is it a time to send the next feedback message? */
+    if (_pq_replication_feedback_if_due(repl) < 0) {
+        return -1;
+    }
+
+    if (_pq_read_replication_message(repl, msg, 1, &io) < 0) {
+        return -1;
+    }
+    if (io) {
+        gettimeofday(&repl->last_io, NULL);
+    }
+
+    return 0;
+}
+
+/* Read a batch of messages from the replication stream, without blocking.
+
+   Append to the list the messages already received, reading from the
+   server only if there are none, until max_count messages or max_bytes of
+   payload are read (0 means no limit). The feedback and io timestamps are
+   only checked once per batch.
+
+   Return the number of messages read, -1 on error.
+ */
+Py_ssize_t
+pq_read_replication_messages(replicationCursorObject *repl, PyObject *list,
+    Py_ssize_t max_count, Py_ssize_t max_bytes)
+{
+    replicationMessageObject *msg = NULL;
+    Py_ssize_t count = 0, size = 0;
+    int io = 0;
+    int rv;
+
+    Dprintf("pq_read_replication_messages: max_count=" FORMAT_CODE_PY_SSIZE_T
+        ", max_bytes=" FORMAT_CODE_PY_SSIZE_T, max_count, max_bytes);
+
+    if (_pq_replication_feedback_if_due(repl) < 0) {
+        return -1;
+    }
+
+    while ((max_count <= 0 || count < max_count)
+            && (max_bytes <= 0 || size < max_bytes)) {
+        if (_pq_read_replication_message(repl, &msg, count == 0, &io) < 0) {
+            count = -1;
+            break;
+        }
+        if (!msg) { break; }
+
+        size += msg->data_size;
+        rv = PyList_Append(list, (PyObject *)msg);
+        Py_DECREF(msg);
+        if (rv < 0) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+
+    if (io) {
+        gettimeofday(&repl->last_io, NULL);
+    }
+
+    return count;
+}
+
 int
 pq_send_replication_feedback(replicationCursorObject *repl, int reply_requested)
 {
@@ -1626,16 +1950,21 @@ pq_send_replication_feedback(replicationCursorObject *repl, int reply_requested)
     PGconn *pgconn = conn->pgconn;
     char replybuf[1 + 8 + 8 + 8 + 8 + 1];
     int len = 0;
+    XLogRecPtr write_lsn, flush_lsn, apply_lsn;
+
+    write_lsn = lsn_atomic_load(&repl->write_lsn);
+    flush_lsn = lsn_atomic_load(&repl->flush_lsn);
+    apply_lsn = lsn_atomic_load(&repl->apply_lsn);
 
     Dprintf("pq_send_replication_feedback: write="XLOGFMTSTR", flush="XLOGFMTSTR", apply="XLOGFMTSTR,
-            XLOGFMTARGS(repl->write_lsn),
-            XLOGFMTARGS(repl->flush_lsn),
-            XLOGFMTARGS(repl->apply_lsn));
+            XLOGFMTARGS(write_lsn),
+            XLOGFMTARGS(flush_lsn),
+            XLOGFMTARGS(apply_lsn));
 
     replybuf[len] = 'r'; len += 1;
-    fe_sendint64(repl->write_lsn, &replybuf[len]); len += 8;
-    fe_sendint64(repl->flush_lsn, &replybuf[len]); len += 8;
-    fe_sendint64(repl->apply_lsn, &replybuf[len]); len += 8;
+    fe_sendint64(write_lsn, &replybuf[len]); len += 8;
+    fe_sendint64(flush_lsn, &replybuf[len]); len += 8;
+    fe_sendint64(apply_lsn, &replybuf[len]); len += 8;
     fe_sendint64(feGetCurrentTimestamp(), &replybuf[len]); len += 8;
     replybuf[len] = reply_requested ? 1 : 0; len += 1;
 
@@ -1644,6 +1973,7 @@ pq_send_replication_feedback(replicationCursorObject *repl, int reply_requested)
         return -1;
     }
     gettimeofday(&repl->last_feedback, NULL);
+    repl->last_feedback_mono = fe_monotonic_usec();
     repl->last_io = repl->last_feedback;
 
     return 0;
@@ -1664,9 +1994,10 @@ pq_copy_both(replicationCursorObject *repl, PyObject *consume)
     PGconn *pgconn = conn->pgconn;
     replicationMessageObject *msg = NULL;
     PyObject *tmp = NULL;
-    int fd, sel, ret = -1;
-    fd_set fds;
-    struct timeval curr_time, feedback_time, timeout;
+    int sel, ret = -1;
+    struct pollfd pfds[2];
+    int npfds, msec;
+    int64_t wait;
 
     if (!PyCallable_Check(consume)) {
         Dprintf("pq_copy_both: expected callable consume object");
@@ -1680,26 +2011,35 @@ pq_copy_both(replicationCursorObject *repl, PyObject *consume)
             goto exit;
         }
         else if (msg == NULL) {
-            fd = PQsocket(pgconn);
-            if (fd < 0) {
+            pfds[0].fd = PQsocket(pgconn);
+            if (pfds[0].fd < 0) {
                 pq_raise(conn, curs, NULL);
                 goto exit;
             }
-
-            FD_ZERO(&fds);
-            FD_SET(fd, &fds);
+            pfds[0].events = POLLIN;
+            npfds = 1;
+
+            /* send_feedback() from another thread wakes us up */
+            if ((pfds[1].fd = repl_curs_wakeup_fd(repl)) >= 0) {
+                pfds[1].events = POLLIN;
+                pfds[1].revents = 0;
+                npfds = 2;
+            }
 
             /* how long can we wait before we need to send a feedback? */
-            gettimeofday(&curr_time, NULL);
+            wait = _pq_replication_feedback_wait(repl);
 
-            timeradd(&repl->last_feedback, &repl->status_interval, &feedback_time);
-            timersub(&feedback_time, &curr_time, &timeout);
-
-            if (timeout.tv_sec >= 0) {
+            if (wait >= 0) {
+                msec = wait >= (int64_t)INT_MAX * 1000
+                    ? INT_MAX : (int)((wait + 999) / 1000);
                 Py_BEGIN_ALLOW_THREADS;
-                sel = select(fd + 1, &fds, NULL, NULL, &timeout);
+                sel = poll(pfds, npfds, msec);
                 Py_END_ALLOW_THREADS;
 
+                if (sel > 0 && npfds > 1 && pfds[1].revents) {
+                    repl_curs_wakeup_drain(repl);
+                }
+
                 if (sel < 0) {
                     if (errno != EINTR) {
                         PyErr_SetFromErrno(PyExc_OSError);
@@ -1729,6 +2069,137 @@ exit:
     return ret;
 }
 
+/* Consume the replication stream in batches, until stop_replication is
+   called or a fatal error occurs.
+
+   Wait with a single poll() on the connection socket and on the file
+   descriptors in the 'fds' sequence (ints or objects with a fileno()
+   method, NULL or None if there are none). Every time messages are received or some of the 'fds' are ready
+   to read, call consume(messages, ready) with the list of the messages read
+   (at most max_count messages or max_bytes of payload, 0 meaning no limit)
+   and the list of the 'fds' items ready.  The poll timeout is computed on
+   the monotonic clock to send the keepalive messages in time.
+*/
+int
+pq_copy_both_poll(replicationCursorObject *repl, PyObject *consume,
+    PyObject *fds, Py_ssize_t max_count, Py_ssize_t max_bytes)
+{
+    cursorObject *curs = &repl->cur;
+    connectionObject *conn = curs->conn;
+    PyObject *seq = NULL, *msgs = NULL, *ready = NULL, *tmp = NULL;
+    struct pollfd *pfds = NULL;
+    Py_ssize_t i, n, npfds, count;
+    int64_t wait;
+    int msec = 0, res, ret = -1;
+
+    if (!PyCallable_Check(consume)) {
+        PyErr_SetString(PyExc_TypeError, "the consumer must be callable");
+        goto exit;
+    }
+
+    if (fds && fds != Py_None) {
+        if (!(seq = PySequence_Fast(fds, "fds must be a sequence"))) {
+            goto exit;
+        }
+        n = PySequence_Fast_GET_SIZE(seq);
+    }
+    else {
+        n = 0;
+    }
+    /* the connection, the fds and the wakeup from send_feedback() */
+    if (!(pfds = PyMem_New(struct pollfd, n + 2))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    pfds[0].events = POLLIN;
+    for (i = 0; i < n; i++) {
+        pfds[i + 1].fd = PyObject_AsFileDescriptor(
+            PySequence_Fast_GET_ITEM(seq, i));
+        if (pfds[i + 1].fd < 0) { goto exit; }
+        pfds[i + 1].events = POLLIN;
+    }
+    npfds = n + 1;
+    if ((pfds[n + 1].fd = repl_curs_wakeup_fd(repl)) >= 0) {
+        pfds[n + 1].events = POLLIN;
+        npfds++;
+    }
+
+    CLEARPGRES(curs->pgres);
+
+    while (1) {
+        if ((pfds[0].fd = PQsocket(conn->pgconn)) < 0) {
+            pq_raise(conn, curs, NULL);
+            goto exit;
+        }
+
+        /* After a batch only check what is ready, without waiting. */
+        Py_BEGIN_ALLOW_THREADS;
+        res = poll(pfds, npfds, msec);
+        Py_END_ALLOW_THREADS;
+
+        if (res < 0) {
+            if (errno != EINTR) {
+                PyErr_SetFromErrno(PyExc_OSError);
+                goto exit;
+            }
+            if (PyErr_CheckSignals()) {
+                goto exit;
+            }
+            continue;
+        }
+
+        if (res > 0 && npfds > n + 1 && pfds[n + 1].revents) {
+            repl_curs_wakeup_drain(repl);
+        }
+
+        if (!(ready = PyList_New(0))) { goto exit; }
+        for (i = 0; res > 0 && i < n; i++) {
+            if (pfds[i + 1].revents
+                    && 0 > PyList_Append(ready, PySequence_Fast_GET_ITEM(seq, i))) {
+                goto exit;
+            }
+        }
+
+        if (!(msgs = PyList_New(0))) { goto exit; }
+        count = pq_read_replication_messages(repl, msgs, max_count, max_bytes);
+        if (count < 0) { goto exit; }
+
+        if (count || PyList_GET_SIZE(ready)) {
+            if (!(tmp = PyObject_CallFunctionObjArgs(consume, msgs, ready, NULL))) {
+                Dprintf("pq_copy_both_poll: consume returned NULL");
+                goto exit;
+            }
+            Py_CLEAR(tmp);
+            msec = 0;
+        }
+        else {
+            /* how long can we wait before we need to send a feedback? */
+            wait = _pq_replication_feedback_wait(repl);
+            if (wait <= 0) {
+                msec = 0;
+            }
+            else if (wait >= (int64_t)INT_MAX * 1000) {
+                msec = INT_MAX;
+            }
+            else {
+                msec = (int)((wait + 999) / 1000);
+            }
+        }
+
+        Py_CLEAR(msgs);
+        Py_CLEAR(ready);
+    }
+
+    ret = 1;
+
+exit:
+    Py_XDECREF(msgs);
+    Py_XDECREF(ready);
+    PyMem_Free(pfds);
+    Py_XDECREF(seq);
+    return ret;
+}
+
 int
 pq_fetch(cursorObject *curs, int no_result)
 {
@@ -47,10 +47,14 @@ RAISES_NEG HIDDEN int pq_abort_locked(connectionObject *conn,
 RAISES_NEG HIDDEN int pq_abort(connectionObject *conn);
 HIDDEN int pq_reset_locked(connectionObject *conn, PyThreadState **tstate);
 RAISES_NEG HIDDEN int pq_reset(connectionObject *conn);
+HIDDEN int pq_is_alive(connectionObject *conn);
 HIDDEN char *pq_get_guc_locked(connectionObject *conn, const char *param,
                                PyThreadState **tstate);
 HIDDEN int pq_set_guc_locked(connectionObject *conn, const char *param,
                              const char *value, PyThreadState **tstate);
+HIDDEN int pq_set_gucs_locked(connectionObject *conn, int n,
+                              const char *params[], const char *values[],
+                              PyThreadState **tstate);
 HIDDEN int pq_tpc_command_locked(connectionObject *conn,
                                  const char *cmd, const char *tid,
                                  PyThreadState **tstate);
@@ -67,8 +71,12 @@ RAISES HIDDEN void pq_complete_error(connectionObject *conn);
 
 /* replication protocol support */
 HIDDEN int pq_copy_both(replicationCursorObject *repl, PyObject *consumer);
+HIDDEN int pq_copy_both_poll(replicationCursorObject *repl, PyObject *consume,
+    PyObject *fds, Py_ssize_t max_count, Py_ssize_t max_bytes);
 HIDDEN int pq_read_replication_message(replicationCursorObject *repl,
                                        replicationMessageObject **msg);
+HIDDEN Py_ssize_t pq_read_replication_messages(replicationCursorObject *repl,
+    PyObject *list, Py_ssize_t max_count, Py_ssize_t max_bytes);
 HIDDEN int pq_send_replication_feedback(replicationCursorObject *repl, int reply_requested);
 
 #endif /* !defined(PSYCOPG_PQPATH_H) */
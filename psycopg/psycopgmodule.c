@@ -36,6 +36,10 @@
 #include "psycopg/column.h"
 #include "psycopg/lobject.h"
 #include "psycopg/notify.h"
+#include "psycopg/notifyqueue.h"
+#include "psycopg/pgoutput.h"
+#include "psycopg/pool.h"
+#include "psycopg/poller.h"
 #include "psycopg/xid.h"
 #include "psycopg/typecast.h"
 #include "psycopg/microprotocols.h"
@@ -75,20 +79,22 @@ HIDDEN PyObject *psyco_null = NULL;
 
 /** connect module-level function **/
 #define psyco_connect_doc \
-"_connect(dsn, [connection_factory], [async]) -- New database connection.\n\n"
+"_connect(dsn, [connection_factory], [async], [parallel_hosts]) -- New database connection.\n\n"
 
 static PyObject *
 psyco_connect(PyObject *self, PyObject *args, PyObject *keywds)
 {
     PyObject *conn = NULL;
     PyObject *factory = NULL;
+    PyObject *fargs = NULL, *fkwargs = NULL;
     const char *dsn = NULL;
-    int async = 0, async_ = 0;
+    int async = 0, async_ = 0, parallel_hosts = 0;
 
-    static char *kwlist[] = {"dsn", "connection_factory", "async", "async_", NULL};
+    static char *kwlist[] = {"dsn", "connection_factory", "async", "async_",
+        "parallel_hosts", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|Oii", kwlist,
-            &dsn, &factory, &async, &async_)) {
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|Oiip", kwlist,
+            &dsn, &factory, &async, &async_, &parallel_hosts)) {
         return NULL;
     }
 
@@ -109,11 +115,23 @@ psyco_connect(PyObject *self, PyObject *args, PyObject *keywds)
      * to further subclass) Another dsn parameter (but is not really
      * a connection parameter that can be configured) */
     if (!async) {
-        conn = PyObject_CallFunction(factory, "s", dsn);
+        if (!(fargs = Py_BuildValue("(s)", dsn))) { goto exit; }
     } else {
-        conn = PyObject_CallFunction(factory, "si", dsn, async);
+        if (!(fargs = Py_BuildValue("(si)", dsn, async))) { goto exit; }
     }
 
+    /* Same for the parallel_hosts parameter. */
+    if (parallel_hosts) {
+        if (!(fkwargs = Py_BuildValue("{s:O}", "parallel_hosts", Py_True))) {
+            goto exit;
+        }
+    }
+
+    conn = PyObject_Call(factory, fargs, fkwargs);
+
+exit:
+    Py_XDECREF(fargs);
+    Py_XDECREF(fkwargs);
     return conn;
 }
 
@@ -157,6 +175,39 @@ exit:
 }
 
 
+#define poll_many_doc \
+"poll_many(conns, timeout=None) -> list -- poll many async connections at once\n\n" \
+"Wait until the operation in progress on at least one connection is\n" \
+"complete and return a list of ``(conn, error)`` tuples for them, with\n" \
+"*error* None or the exception raised. Return an empty list on timeout."
+
+static PyObject *
+poll_many(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *conns, *pytimeout = Py_None;
+    double timeout = -1.0;
+
+    static char *kwlist[] = {"conns", "timeout", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist,
+            &conns, &pytimeout)) {
+        return NULL;
+    }
+
+    if (pytimeout != Py_None) {
+        timeout = PyFloat_AsDouble(pytimeout);
+        if (timeout == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return NULL;
+        }
+    }
+
+    return conn_poll_many(conns, timeout);
+}
+
+
 #define quote_ident_doc \
 "quote_ident(str, conn_or_curs) -> str -- wrapper around PQescapeIdentifier\n\n" \
 ":Parameters:\n" \
@@ -850,9 +901,12 @@ static struct {
     { "ReplicationConnection", &replicationConnectionType },
     { "ReplicationCursor", &replicationCursorType },
     { "ReplicationMessage", &replicationMessageType },
+    { "PgoutputDecoder", &pgoutputDecoderType },
     { "ISQLQuote", &isqlquoteType },
     { "Column", &columnType },
     { "Notify", &notifyType },
+    { "Notice", &noticeType },
+    { "NotifyQueue", &notifyQueueType },
     { "Xid", &xidType },
     { "ConnectionInfo", &connInfoType },
     { "Diagnostics", &diagnosticsType },
@@ -865,6 +919,7 @@ static struct {
     { "List", &listType },
     { "QuotedString", &qstringType },
     { "lobject", &lobjectType },
+    { "ConnectionPoolBase", &connectionPoolType },
     {NULL}  /* Sentinel */
 };
 
@@ -923,6 +978,8 @@ static PyMethodDef psycopgMethods[] = {
      METH_VARARGS|METH_KEYWORDS, psyco_connect_doc},
     {"parse_dsn",  (PyCFunction)parse_dsn,
      METH_VARARGS|METH_KEYWORDS, parse_dsn_doc},
+    {"poll_many",  (PyCFunction)poll_many,
+     METH_VARARGS|METH_KEYWORDS, poll_many_doc},
     {"quote_ident", (PyCFunction)quote_ident,
      METH_VARARGS|METH_KEYWORDS, quote_ident_doc},
     {"adapt",  (PyCFunction)psyco_microprotocols_adapt,
@@ -1006,6 +1063,9 @@ INIT_MODULE(_psycopg)(void)
     Py_SET_TYPE(&chunkType, &PyType_Type);
     if (0 > PyType_Ready(&chunkType)) { goto error; }
 
+    Py_SET_TYPE(&pollerType, &PyType_Type);
+    if (0 > PyType_Ready(&pollerType)) { goto error; }
+
     Py_SET_TYPE(&errorType, &PyType_Type);
     errorType.tp_base = (PyTypeObject *)PyExc_StandardError;
     if (0 > PyType_Ready(&errorType)) { goto error; }
@@ -1016,9 +1076,17 @@ INIT_MODULE(_psycopg)(void)
     module = PyModule_Create(&psycopgmodule);
     if (!module) { goto error; }
 
+#ifdef Py_GIL_DISABLED
+    /* the shared state is protected by critical sections */
+    if (0 > PyUnstable_Module_SetGIL(module, Py_MOD_GIL_NOT_USED)) {
+        goto error;
+    }
+#endif
+
     if (0 > add_module_constants(module)) { goto error; }
     if (0 > add_module_types(module)) { goto error; }
     if (0 > datetime_init()) { goto error; }
+    if (0 > pgoutput_init_module(module)) { goto error; }
     if (0 > encodings_init(module)) { goto error; }
     if (0 > typecast_init(module)) { goto error; }
     if (0 > adapters_init(module)) { goto error; }
@@ -41,6 +41,40 @@
   #define Py_SET_TYPE(obj, type) ((Py_TYPE(obj) = (type)), (void)0)
 #endif
 
+/* Free-threaded Python support: the critical sections and the strong
+ * reference dict lookups were introduced in Python 3.13. On the default
+ * build the critical sections only open a block.
+ */
+#if PY_VERSION_HEX < 0x030D0000
+  #define Py_BEGIN_CRITICAL_SECTION(op) {
+  #define Py_END_CRITICAL_SECTION() }
+
+static inline int
+PyDict_GetItemRef(PyObject *mp, PyObject *key, PyObject **result)
+{
+    if ((*result = PyDict_GetItemWithError(mp, key))) {
+        Py_INCREF(*result);
+        return 1;
+    }
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+static inline int
+PyDict_GetItemStringRef(PyObject *mp, const char *key, PyObject **result)
+{
+    int rv;
+    PyObject *k;
+
+    if (!(k = PyUnicode_FromString(key))) {
+        *result = NULL;
+        return -1;
+    }
+    rv = PyDict_GetItemRef(mp, k, result);
+    Py_DECREF(k);
+    return rv;
+}
+#endif
+
 /* FORMAT_CODE_PY_SSIZE_T is for Py_ssize_t: */
 #define FORMAT_CODE_PY_SSIZE_T "%" PY_FORMAT_SIZE_T "d"
 
@@ -41,23 +41,38 @@ typedef struct replicationCursorObject {
 
     int         consuming:1;      /* if running the consume loop */
     int         decode:1;         /* if we should use character decoding on the messages */
+    int         zero_copy:1;      /* if the payloads should be views on the libpq buffers */
+    int         wakeup_open:1;    /* if wakeup_fds is open */
 
     struct timeval last_io;       /* timestamp of the last exchange with the server */
     struct timeval status_interval;   /* time between status packets sent to the server */
 
-    XLogRecPtr  write_lsn;        /* LSNs for replication feedback messages */
+    /* LSNs for replication feedback messages: they can be advanced by any
+     * thread, so they are only accessed with the lsn_atomic_* functions */
+    XLogRecPtr  write_lsn;
     XLogRecPtr  flush_lsn;
     XLogRecPtr  apply_lsn;
+    int         feedback_request; /* REPL_FEEDBACK_* flags, left for the read loop */
 
     XLogRecPtr  wal_end;          /* WAL end pointer from the last exchange with the server */
 
     XLogRecPtr  last_msg_data_start; /* WAL pointer to the last non-keepalive message from the server */
     struct timeval last_feedback; /* timestamp of the last feedback message to the server */
+    int64_t     last_feedback_mono; /* the same on the monotonic clock (usec), for the timers */
     XLogRecPtr  explicitly_flushed_lsn; /* the flush LSN explicitly set by the send_feedback call */ 
+
+    PyObject   *pending_error;    /* error met by read_messages() after returning part of a batch */
+    int         wakeup_fds[2];    /* pipe used by send_feedback() to wake up the consume loop */
 } replicationCursorObject;
 
+/* feedback_request flags */
+#define REPL_FEEDBACK_FORCE 1
+#define REPL_FEEDBACK_REPLY 2
+
 
 RAISES_NEG HIDDEN int repl_curs_datetime_init(void);
+HIDDEN int repl_curs_wakeup_fd(replicationCursorObject *self);
+HIDDEN void repl_curs_wakeup_drain(replicationCursorObject *self);
 
 #ifdef __cplusplus
 }
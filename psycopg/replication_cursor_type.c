@@ -36,6 +36,8 @@
 #include <stdlib.h>
 #ifndef _WIN32
 #include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
 #endif
 
 /* python */
@@ -49,7 +51,7 @@ static void set_status_interval(replicationCursorObject *self, double status_int
 }
 
 #define start_replication_expert_doc \
-"start_replication_expert(command, decode=False, status_interval=10) -- Start replication with a given command."
+"start_replication_expert(command, decode=False, status_interval=10, zero_copy=False) -- Start replication with a given command."
 
 static PyObject *
 start_replication_expert(replicationCursorObject *self,
@@ -61,10 +63,13 @@ start_replication_expert(replicationCursorObject *self,
     PyObject *command = NULL;
     double status_interval = 10;
     long int decode = 0;
-    static char *kwlist[] = {"command", "decode", "status_interval", NULL};
+    int zero_copy = 0;
+    static char *kwlist[] = {"command", "decode", "status_interval",
+                             "zero_copy", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ld", kwlist,
-                                     &command, &decode, &status_interval)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ldp", kwlist,
+                                     &command, &decode, &status_interval,
+                                     &zero_copy)) {
         return NULL;
     }
 
@@ -81,6 +86,12 @@ start_replication_expert(replicationCursorObject *self,
         return NULL;
     }
 
+    if (decode && zero_copy) {
+        psyco_set_error(ProgrammingError, curs,
+            "decode and zero_copy can't be used together");
+        goto exit;
+    }
+
     Dprintf("start_replication_expert: '%s'; decode: %ld",
         Bytes_AS_STRING(command), decode);
 
@@ -91,6 +102,7 @@ start_replication_expert(replicationCursorObject *self,
 
         set_status_interval(self, status_interval);
         self->decode = decode;
+        self->zero_copy = zero_copy;
         gettimeofday(&self->last_io, NULL);
     }
 
@@ -99,6 +111,146 @@ exit:
     return res;
 }
 
+/* Parse the keepalive_interval argument of the consume methods.
+ *
+ * Set *rv to 0 if the argument is None, meaning to keep the status_interval.
+ */
+RAISES_NEG static int
+parse_keepalive_interval(cursorObject *curs, PyObject *interval, double *rv)
+{
+    double keepalive_interval = 0;
+
+    if (interval && interval != Py_None) {
+
+        if (PyFloat_Check(interval)) {
+            keepalive_interval = PyFloat_AsDouble(interval);
+        } else if (PyLong_Check(interval)) {
+            keepalive_interval = PyLong_AsDouble(interval);
+        } else if (PyInt_Check(interval)) {
+            keepalive_interval = PyInt_AsLong(interval);
+        } else {
+            psyco_set_error(ProgrammingError, curs, "keepalive_interval must be int or float");
+            return -1;
+        }
+
+        if (keepalive_interval < 1.0) {
+            psyco_set_error(ProgrammingError, curs, "keepalive_interval must be >= 1 (sec)");
+            return -1;
+        }
+    }
+
+    *rv = keepalive_interval;
+    return 0;
+}
+
+/* Parse a max_count/max_bytes argument: set *rv to 0 (no limit) if None. */
+RAISES_NEG static int
+parse_batch_limit(PyObject *obj, const char *name, Py_ssize_t *rv)
+{
+    Py_ssize_t limit = 0;
+
+    if (obj && obj != Py_None) {
+        if (-1 == (limit = PyNumber_AsSsize_t(obj, NULL))
+                && PyErr_Occurred()) {
+            return -1;
+        }
+        if (limit < 1) {
+            PyErr_Format(PyExc_ValueError, "%s must be >= 1", name);
+            return -1;
+        }
+    }
+
+    *rv = limit;
+    return 0;
+}
+
+/* Open the pipe used by send_feedback() to wake up the consume loop.
+ *
+ * Not available on Windows: there a feedback requested from another thread
+ * is sent when the loop wakes up, at most a status interval later.
+ */
+RAISES_NEG static int
+wakeup_open(replicationCursorObject *self)
+{
+#ifndef _WIN32
+    int i;
+
+    if (self->wakeup_open) {
+        return 0;
+    }
+    if (0 > pipe(self->wakeup_fds)) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(self->wakeup_fds[i], F_SETFL, O_NONBLOCK);
+        fcntl(self->wakeup_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    self->wakeup_open = 1;
+#endif
+    return 0;
+}
+
+/* Return the fd the consume loop should wait on with the connection, or -1 */
+int
+repl_curs_wakeup_fd(replicationCursorObject *self)
+{
+    return self->wakeup_open ? self->wakeup_fds[0] : -1;
+}
+
+/* Consume the wakeups received by the consume loop. */
+void
+repl_curs_wakeup_drain(replicationCursorObject *self)
+{
+#ifndef _WIN32
+    char buf[64];
+
+    if (self->wakeup_open) {
+        while (read(self->wakeup_fds[0], buf, sizeof(buf)) > 0) {}
+    }
+#endif
+}
+
+/* Raise the error left by read_messages(), if any. */
+RAISES_NEG static int
+raise_pending_error(replicationCursorObject *self)
+{
+    PyObject *err;
+
+    if (!(err = self->pending_error)) {
+        return 0;
+    }
+    self->pending_error = NULL;
+    PyErr_SetObject((PyObject *)Py_TYPE(err), err);
+    Py_DECREF(err);
+    return -1;
+}
+
+/* Check that the consume loop can be entered. */
+RAISES_NEG static int
+check_consume(replicationCursorObject *self, const char *name)
+{
+    cursorObject *curs = &self->cur;
+
+    if (raise_pending_error(self) < 0) {
+        return -1;
+    }
+
+    if (self->consuming) {
+        PyErr_Format(ProgrammingError,
+                     "%s cannot be used when already in the consume loop", name);
+        return -1;
+    }
+
+    if (curs->pgres == NULL || PQresultStatus(curs->pgres) != PGRES_COPY_BOTH) {
+        PyErr_Format(ProgrammingError,
+                     "%s: not replicating, call start_replication first", name);
+        return -1;
+    }
+
+    return 0;
+}
+
 #define consume_stream_doc \
 "consume_stream(consumer, keepalive_interval=None) -- Consume replication stream."
 
@@ -123,34 +275,62 @@ consume_stream(replicationCursorObject *self,
 
     Dprintf("consume_stream");
 
-    if (interval && interval != Py_None) {
+    if (parse_keepalive_interval(curs, interval, &keepalive_interval) < 0
+            || check_consume(self, "consume_stream") < 0
+            || wakeup_open(self) < 0) {
+        return NULL;
+    }
+    CLEARPGRES(curs->pgres);
 
-        if (PyFloat_Check(interval)) {
-            keepalive_interval = PyFloat_AsDouble(interval);
-        } else if (PyLong_Check(interval)) {
-            keepalive_interval = PyLong_AsDouble(interval);
-        } else if (PyInt_Check(interval)) {
-            keepalive_interval = PyInt_AsLong(interval);
-        } else {
-            psyco_set_error(ProgrammingError, curs, "keepalive_interval must be int or float");
-            return NULL;
-        }
+    self->consuming = 1;
+    if (keepalive_interval > 0) {
+        set_status_interval(self, keepalive_interval);
+    }
 
-        if (keepalive_interval < 1.0) {
-            psyco_set_error(ProgrammingError, curs, "keepalive_interval must be >= 1 (sec)");
-            return NULL;
-        }
+    if (pq_copy_both(self, consume) >= 0) {
+        res = Py_None;
+        Py_INCREF(res);
     }
 
-    if (self->consuming) {
-        PyErr_SetString(ProgrammingError,
-                        "consume_stream cannot be used when already in the consume loop");
+    self->consuming = 0;
+
+    return res;
+}
+
+#define consume_stream_batches_doc \
+"consume_stream_batches(consumer, keepalive_interval=None, fds=(), max_count=None, max_bytes=None)\n" \
+" -- Consume replication stream in batches, also waiting on other files."
+
+static PyObject *
+consume_stream_batches(replicationCursorObject *self,
+                               PyObject *args, PyObject *kwargs)
+{
+    cursorObject *curs = &self->cur;
+    PyObject *consume = NULL, *interval = NULL, *fds = NULL, *res = NULL;
+    PyObject *omax_count = NULL, *omax_bytes = NULL;
+    Py_ssize_t max_count = 0, max_bytes = 0;
+    double keepalive_interval = 0;
+    static char *kwlist[] = {"consume", "keepalive_interval", "fds",
+                             "max_count", "max_bytes", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOOO", kwlist,
+                                     &consume, &interval, &fds,
+                                     &omax_count, &omax_bytes)) {
         return NULL;
     }
 
-    if (curs->pgres == NULL || PQresultStatus(curs->pgres) != PGRES_COPY_BOTH) {
-        PyErr_SetString(ProgrammingError,
-                        "consume_stream: not replicating, call start_replication first");
+    EXC_IF_CURS_CLOSED(curs);
+    EXC_IF_CURS_ASYNC(curs, consume_stream_batches);
+    EXC_IF_GREEN(consume_stream_batches);
+    EXC_IF_TPC_PREPARED(self->cur.conn, consume_stream_batches);
+
+    Dprintf("consume_stream_batches");
+
+    if (parse_keepalive_interval(curs, interval, &keepalive_interval) < 0
+            || parse_batch_limit(omax_count, "max_count", &max_count) < 0
+            || parse_batch_limit(omax_bytes, "max_bytes", &max_bytes) < 0
+            || check_consume(self, "consume_stream_batches") < 0
+            || wakeup_open(self) < 0) {
         return NULL;
     }
     CLEARPGRES(curs->pgres);
@@ -160,7 +340,7 @@ consume_stream(replicationCursorObject *self,
         set_status_interval(self, keepalive_interval);
     }
 
-    if (pq_copy_both(self, consume) >= 0) {
+    if (pq_copy_both_poll(self, consume, fds, max_count, max_bytes) >= 0) {
         res = Py_None;
         Py_INCREF(res);
     }
@@ -183,6 +363,10 @@ read_message(replicationCursorObject *self, PyObject *dummy)
     EXC_IF_GREEN(read_message);
     EXC_IF_TPC_PREPARED(self->cur.conn, read_message);
 
+    if (raise_pending_error(self) < 0) {
+        return NULL;
+    }
+
     if (pq_read_replication_message(self, &msg) < 0) {
         return NULL;
     }
@@ -193,6 +377,60 @@ read_message(replicationCursorObject *self, PyObject *dummy)
     Py_RETURN_NONE;
 }
 
+#define read_messages_doc \
+"read_messages(max_count=None, max_bytes=None) -- Read the replication messages\n" \
+"already received from the server (non-blocking), return them in a list.\n\n" \
+"If an error happens after some messages were read, the messages are\n" \
+"returned and the error is raised by the next read."
+
+static PyObject *
+read_messages(replicationCursorObject *self, PyObject *args, PyObject *kwargs)
+{
+    cursorObject *curs = &self->cur;
+    PyObject *omax_count = Py_None, *omax_bytes = Py_None;
+    Py_ssize_t max_count = 0, max_bytes = 0;
+    PyObject *rv = NULL;
+    PyObject *type, *value, *tb;
+    static char *kwlist[] = {"max_count", "max_bytes", NULL};
+
+    EXC_IF_CURS_CLOSED(curs);
+    EXC_IF_GREEN(read_messages);
+    EXC_IF_TPC_PREPARED(self->cur.conn, read_messages);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OO", kwlist,
+                                     &omax_count, &omax_bytes)) {
+        return NULL;
+    }
+
+    if (parse_batch_limit(omax_count, "max_count", &max_count) < 0
+            || parse_batch_limit(omax_bytes, "max_bytes", &max_bytes) < 0) {
+        return NULL;
+    }
+
+    if (raise_pending_error(self) < 0) {
+        return NULL;
+    }
+
+    if (!(rv = PyList_New(0))) { return NULL; }
+    if (pq_read_replication_messages(self, rv, max_count, max_bytes) < 0) {
+        if (!PyList_GET_SIZE(rv)) {
+            Py_CLEAR(rv);
+            return NULL;
+        }
+        /* the messages were already taken from libpq: don't lose them */
+        PyErr_Fetch(&type, &value, &tb);
+        PyErr_NormalizeException(&type, &value, &tb);
+        if (tb) {
+            PyException_SetTraceback(value, tb);
+        }
+        self->pending_error = value;
+        Py_XDECREF(type);
+        Py_XDECREF(tb);
+    }
+
+    return rv;
+}
+
 #define send_feedback_doc \
 "send_feedback(write_lsn=0, flush_lsn=0, apply_lsn=0, reply=False, force=False) -- Update a replication feedback, optionally request a reply or force sending a feedback message regardless of the timeout."
 
@@ -212,20 +450,28 @@ send_feedback(replicationCursorObject *self,
         return NULL;
     }
 
-    if (write_lsn > self->write_lsn)
-        self->write_lsn = write_lsn;
-
-    if (flush_lsn > self->explicitly_flushed_lsn)
-        self->explicitly_flushed_lsn = flush_lsn;
-
-    if (flush_lsn > self->flush_lsn)
-        self->flush_lsn = flush_lsn;
-
-    if (apply_lsn > self->apply_lsn)
-        self->apply_lsn = apply_lsn;
-
-    if ((force || reply) && pq_send_replication_feedback(self, reply) < 0) {
-        return NULL;
+    /* No lock is taken: the LSNs can be advanced by any thread, also while
+     * the consume loop is running, which will send them to the server. */
+    lsn_atomic_advance(&self->write_lsn, write_lsn);
+    lsn_atomic_advance(&self->explicitly_flushed_lsn, flush_lsn);
+    lsn_atomic_advance(&self->flush_lsn, flush_lsn);
+    lsn_atomic_advance(&self->apply_lsn, apply_lsn);
+
+    if (force || reply) {
+        if (self->consuming) {
+            /* Don't write on the connection under the feet of the consume
+             * loop: it will send the message as soon as it gets control. */
+            flags_atomic_set(&self->feedback_request, REPL_FEEDBACK_FORCE
+                | (reply ? REPL_FEEDBACK_REPLY : 0));
+#ifndef _WIN32
+            if (self->wakeup_open && write(self->wakeup_fds[1], "x", 1) < 0) {
+                /* the pipe is full: the loop is going to wake up anyway */
+            }
+#endif
+        }
+        else if (pq_send_replication_feedback(self, reply) < 0) {
+            return NULL;
+        }
     }
 
     Py_RETURN_NONE;
@@ -306,8 +552,12 @@ static struct PyMethodDef replicationCursorObject_methods[] = {
      METH_VARARGS|METH_KEYWORDS, start_replication_expert_doc},
     {"consume_stream", (PyCFunction)consume_stream,
      METH_VARARGS|METH_KEYWORDS, consume_stream_doc},
+    {"consume_stream_batches", (PyCFunction)consume_stream_batches,
+     METH_VARARGS|METH_KEYWORDS, consume_stream_batches_doc},
     {"read_message", (PyCFunction)read_message,
      METH_NOARGS, read_message_doc},
+    {"read_messages", (PyCFunction)read_messages,
+     METH_VARARGS|METH_KEYWORDS, read_messages_doc},
     {"send_feedback", (PyCFunction)send_feedback,
      METH_VARARGS|METH_KEYWORDS, send_feedback_doc},
     {NULL}
@@ -338,6 +588,7 @@ replicationCursor_init(PyObject *obj, PyObject *args, PyObject *kwargs)
     self->write_lsn = 0;
     self->flush_lsn = 0;
     self->apply_lsn = 0;
+    self->feedback_request = 0;
 
     return cursorType.tp_init(obj, args, kwargs);
 }
@@ -352,9 +603,33 @@ replicationCursor_repr(replicationCursorObject *self)
 static int
 replicationCursorType_traverse(PyObject *self, visitproc visit, void *arg)
 {
+    Py_VISIT(((replicationCursorObject *)self)->pending_error);
     return cursorType.tp_traverse(self, visit, arg);
 }
 
+static int
+replicationCursorType_clear(PyObject *self)
+{
+    Py_CLEAR(((replicationCursorObject *)self)->pending_error);
+    return cursorType.tp_clear(self);
+}
+
+static void
+replicationCursor_dealloc(PyObject *self)
+{
+    replicationCursorObject *repl = (replicationCursorObject *)self;
+
+    PyObject_GC_UnTrack(self);
+    Py_CLEAR(repl->pending_error);
+#ifndef _WIN32
+    if (repl->wakeup_open) {
+        close(repl->wakeup_fds[0]);
+        close(repl->wakeup_fds[1]);
+    }
+#endif
+    cursorType.tp_dealloc(self);
+}
+
 /* object type */
 
 #define replicationCursorType_doc \
@@ -364,7 +639,7 @@ PyTypeObject replicationCursorType = {
     PyVarObject_HEAD_INIT(NULL, 0)
     "psycopg2.extensions.ReplicationCursor",
     sizeof(replicationCursorObject), 0,
-    0,          /*tp_dealloc*/
+    replicationCursor_dealloc, /*tp_dealloc*/
     0,          /*tp_print*/
     0,          /*tp_getattr*/
     0,          /*tp_setattr*/
@@ -383,7 +658,7 @@ PyTypeObject replicationCursorType = {
       Py_TPFLAGS_HAVE_GC, /*tp_flags*/
     replicationCursorType_doc, /*tp_doc*/
     replicationCursorType_traverse, /*tp_traverse*/
-    0,          /*tp_clear*/
+    replicationCursorType_clear, /*tp_clear*/
     0,          /*tp_richcompare*/
     0,          /*tp_weaklistoffset*/
     0,          /*tp_iter*/
@@ -50,6 +50,8 @@ struct replicationMessageObject {
 };
 
 RAISES_NEG HIDDEN int replmsg_datetime_init(void);
+HIDDEN replicationMessageObject *replmsg_new(
+    cursorObject *cursor, PyObject *payload);
 
 #ifdef __cplusplus
 }
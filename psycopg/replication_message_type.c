@@ -77,6 +77,28 @@ replmsg_init(PyObject *obj, PyObject *args, PyObject *kwargs)
     return 0;
 }
 
+/* Create a new message without going through the type call.
+ *
+ * Used by the replication read loop: the caller fills in the LSNs.
+ */
+replicationMessageObject *
+replmsg_new(cursorObject *cursor, PyObject *payload)
+{
+    replicationMessageObject *self;
+
+    if (!(self = (replicationMessageObject *)replicationMessageType.tp_alloc(
+            &replicationMessageType, 0))) {
+        return NULL;
+    }
+
+    Py_INCREF(cursor);
+    self->cursor = cursor;
+    Py_INCREF(payload);
+    self->payload = payload;
+
+    return self;
+}
+
 static int
 replmsg_traverse(replicationMessageObject *self, visitproc visit, void *arg)
 {
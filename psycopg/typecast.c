@@ -618,3 +618,46 @@ typecast_cast(PyObject *obj, const char *str, Py_ssize_t len, PyObject *curs)
 
     return res;
 }
+
+/* typecast_get_ccast - return the C function to call for a typecaster
+ *
+ * Return the C casting function if it can be called directly on the values
+ * of a column, skipping the dispatch in typecast_cast(). Return NULL if the
+ * object is a Python typecaster or if the function needs cursor.typecaster
+ * to be set (the array typecasters, which look up their base type there).
+ *
+ * C functions returned can be called with a NULL string: they return None.
+ */
+typecast_function
+typecast_get_ccast(PyObject *obj)
+{
+    typecastObject *self = (typecastObject *)obj;
+
+    if (!PyObject_TypeCheck(obj, &typecastType)) {
+        return NULL;
+    }
+    if (self->ccast == typecast_GENERIC_ARRAY_cast) {
+        return NULL;
+    }
+    return self->ccast;
+}
+
+/* typecast_stage_kind - return how a C typecaster values can be staged
+ *
+ * Some of the conversion of the values of a column can be done without
+ * holding the GIL: return TYPECAST_STAGE_INT for the integer typecasters,
+ * whose values can be parsed with typecast_int_parse(), and
+ * TYPECAST_STAGE_BINARY for bytea, whose values can be decoded by
+ * typecast_binary_parse_hex(), if in hex format.
+ */
+int
+typecast_stage_kind(typecast_function ccast)
+{
+    if (ccast == typecast_LONGINTEGER_cast) {
+        return TYPECAST_STAGE_INT;
+    }
+    if (ccast == typecast_BINARY_cast) {
+        return TYPECAST_STAGE_BINARY;
+    }
+    return TYPECAST_STAGE_NONE;
+}
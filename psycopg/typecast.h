@@ -88,4 +88,21 @@ HIDDEN PyObject *typecast_array_from_python(
 HIDDEN PyObject *typecast_cast(
     PyObject *self, const char *str, Py_ssize_t len, PyObject *curs);
 
+/* return the C function that can be called bypassing typecast_cast */
+HIDDEN typecast_function typecast_get_ccast(PyObject *self);
+
+/* conversion of values in a separate phase, without holding the GIL */
+#define TYPECAST_STAGE_NONE 0
+#define TYPECAST_STAGE_INT 1
+#define TYPECAST_STAGE_BINARY 2
+
+HIDDEN int typecast_stage_kind(typecast_function ccast);
+HIDDEN int typecast_int_parse(const char *s, Py_ssize_t len, long long *val);
+HIDDEN Py_ssize_t typecast_binary_hex_size(const char *s, Py_ssize_t len);
+HIDDEN Py_ssize_t typecast_binary_parse_hex(
+    const char *s, Py_ssize_t len, char *buffer);
+HIDDEN PyObject *typecast_binary_from_buffer(char *buffer, Py_ssize_t len);
+HIDDEN PyObject *typecast_binary_from_pqmem(
+    char *pqmem, Py_ssize_t offset, Py_ssize_t len);
+
 #endif /* !defined(PSYCOPG_TYPECAST_H) */
@@ -43,6 +43,39 @@ typecast_LONGINTEGER_cast(const char *s, Py_ssize_t len, PyObject *curs)
     return PyLong_FromString((char *)s, NULL, 0);
 }
 
+/* Parse an integer as returned by the server into a long long.
+ *
+ * Return 1 on success, 0 if the value is too large or not in the expected
+ * format: in this case it must be converted by typecast_LONGINTEGER_cast.
+ * The function doesn't use the Python API, so it can be called without
+ * holding the GIL.
+ */
+int
+typecast_int_parse(const char *s, Py_ssize_t len, long long *val)
+{
+    const char *end = s + len;
+    long long v = 0;
+    int neg = 0;
+
+    if (len > 0 && *s == '-') {
+        neg = 1;
+        s++;
+    }
+    /* up to 18 digits can't overflow */
+    if (s == end || end - s > 18) {
+        return 0;
+    }
+    for (; s < end; s++) {
+        if (*s < '0' || *s > '9') {
+            return 0;
+        }
+        v = v * 10 + (*s - '0');
+    }
+
+    *val = neg ? -v : v;
+    return 1;
+}
+
 /** FLOAT - cast floating point numbers to python float **/
 
 static PyObject *
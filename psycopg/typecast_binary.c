@@ -41,7 +41,12 @@ chunk_dealloc(chunkObject *self)
         FORMAT_CODE_PY_SSIZE_T,
         self->base, self->len
       );
-    PyMem_Free(self->base);
+    if (self->pqmem) {
+        PQfreemem(self->pqmem);
+    }
+    else {
+        PyMem_Free(self->base);
+    }
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
@@ -107,7 +112,6 @@ static char *parse_escape(
 PyObject *
 typecast_BINARY_cast(const char *s, Py_ssize_t l, PyObject *curs)
 {
-    chunkObject *chunk = NULL;
     PyObject *res = NULL;
     char *buffer = NULL;
     Py_ssize_t len;
@@ -140,13 +144,34 @@ typecast_BINARY_cast(const char *s, Py_ssize_t l, PyObject *curs)
         }
     }
 
+    res = typecast_binary_from_buffer(buffer, len);
+    buffer = NULL;
+
+exit:
+    PyMem_Free(buffer);
+
+    return res;
+}
+
+/* Return a memoryview on a buffer of decoded binary data.
+ *
+ * The buffer, allocated by PyMem_Malloc, is stolen: it will be released
+ * together with the memoryview, or straight away on error.
+ */
+PyObject *
+typecast_binary_from_buffer(char *buffer, Py_ssize_t len)
+{
+    chunkObject *chunk = NULL;
+    PyObject *res = NULL;
+
     chunk = (chunkObject *) PyObject_New(chunkObject, &chunkType);
     if (chunk == NULL) goto exit;
 
     /* **Transfer** ownership of buffer's memory to the chunkObject: */
     chunk->base = buffer;
+    chunk->pqmem = NULL;
     buffer = NULL;
-    chunk->len = (Py_ssize_t)len;
+    chunk->len = len;
 
     if ((res = PyMemoryView_FromObject((PyObject*)chunk)) == NULL)
         goto exit;
@@ -158,6 +183,51 @@ exit:
     return res;
 }
 
+/* Return a memoryview on a memory block allocated by the libpq.
+ *
+ * The view starts at offset bytes from the start of the block. The block is
+ * stolen: it will be released by PQfreemem() together with the memoryview,
+ * or straight away on error.
+ */
+PyObject *
+typecast_binary_from_pqmem(char *pqmem, Py_ssize_t offset, Py_ssize_t len)
+{
+    chunkObject *chunk = NULL;
+    PyObject *res = NULL;
+
+    chunk = (chunkObject *) PyObject_New(chunkObject, &chunkType);
+    if (chunk == NULL) goto exit;
+
+    /* **Transfer** ownership of the libpq memory to the chunkObject: */
+    chunk->base = pqmem + offset;
+    chunk->pqmem = pqmem;
+    pqmem = NULL;
+    chunk->len = len;
+
+    res = PyMemoryView_FromObject((PyObject*)chunk);
+
+exit:
+    Py_XDECREF((PyObject *)chunk);
+    if (pqmem) {
+        PQfreemem(pqmem);
+    }
+
+    return res;
+}
+
+/* Return the size of the buffer needed to decode a bytea in hex format.
+ *
+ * Return -1 if the value is not in hex format.
+ */
+Py_ssize_t
+typecast_binary_hex_size(const char *s, Py_ssize_t l)
+{
+    if (!(s[0] == '\\' && s[1] == 'x')) {
+        return -1;
+    }
+    return (l - 2) >> 1;
+}
+
 
 static const char hex_lut[128] = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -182,18 +252,31 @@ static const char hex_lut[128] = {
 static char *
 parse_hex(const char *bufin, Py_ssize_t sizein, Py_ssize_t *sizeout)
 {
-    char *ret = NULL;
-    const char *bufend = bufin + sizein;
-    const char *pi = bufin + 2;     /* past the \x */
     char *bufout;
-    char *po;
 
-    po = bufout = PyMem_Malloc((sizein - 2) >> 1);   /* output size upper bound */
+    bufout = PyMem_Malloc((sizein - 2) >> 1);   /* output size upper bound */
     if (NULL == bufout) {
         PyErr_NoMemory();
-        goto exit;
+        return NULL;
     }
 
+    *sizeout = typecast_binary_parse_hex(bufin, sizein, bufout);
+    return bufout;
+}
+
+/* Decode a bytea in hex format into a buffer.
+ *
+ * The buffer must be at least typecast_binary_hex_size() long. Return the
+ * number of bytes written. The function doesn't use the Python API, so it
+ * can be called without holding the GIL.
+ */
+Py_ssize_t
+typecast_binary_parse_hex(const char *bufin, Py_ssize_t sizein, char *bufout)
+{
+    const char *bufend = bufin + sizein;
+    const char *pi = bufin + 2;     /* past the \x */
+    char *po = bufout;
+
     /* Implementation note: we call this function upon database response, not
      * user input (because we are parsing the output format of a buffer) so we
      * don't expect errors. On bad input we reserve the right to return a bad
@@ -213,11 +296,7 @@ parse_hex(const char *bufin, Py_ssize_t sizein, Py_ssize_t *sizeout)
     }
 endloop:
 
-    ret = bufout;
-    *sizeout = po - bufout;
-
-exit:
-    return ret;
+    return po - bufout;
 }
 
 /* Parse a bytea output buffer encoded in 'escape' format.
@@ -40,6 +40,7 @@ typedef struct {
 
     void *base;     /* Pointer to the memory chunk. */
     Py_ssize_t len;        /* Size in bytes of the memory chunk. */
+    void *pqmem;    /* If set, libpq memory to free with PQfreemem(). */
 
 } chunkObject;
 
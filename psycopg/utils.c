@@ -95,6 +95,112 @@ psyco_escape_string(connectionObject *conn, const char *from, Py_ssize_t len,
     return to;
 }
 
+/* Return true if quotes and backslashes can be found looking at single bytes.
+ *
+ * This is the case of the encodings where every byte of a multibyte
+ * character has the high bit set; in the other client encodings (SJIS, BIG5,
+ * GBK...) a quote byte may be part of a character, so we leave the escaping
+ * to libpq.
+ */
+static int
+psyco_escape_bytewise(PGconn *pgconn)
+{
+    const char *enc = pg_encoding_to_char(PQclientEncoding(pgconn));
+
+    return (0 == strcmp(enc, "UTF8")
+        || 0 == strcmp(enc, "SQL_ASCII")
+        || 0 == strncmp(enc, "LATIN", 5)
+        || 0 == strncmp(enc, "WIN", 3)
+        || 0 == strncmp(enc, "ISO_8859_", 9)
+        || 0 == strncmp(enc, "KOI8", 4)
+        || 0 == strncmp(enc, "EUC_", 4));
+}
+
+/* Escape a string for sql inclusion, returning a bytes object.
+ *
+ * Same result of psyco_escape_string(), but the literal is written directly
+ * into a bytes object of the right size. If the client encoding allows it
+ * the string is escaped here: it is only scanned and copied, doubling quotes
+ * and backslashes if there are any.
+ *
+ * `from` must be NUL-terminated at `len`, like the content of a bytes.
+ */
+PyObject *
+psyco_quote_string(connectionObject *conn, const char *from, Py_ssize_t len)
+{
+    PyObject *rv = NULL;
+    char *buf, *to;
+    const char *p, *end = from + len;
+    const char *scs, *special;
+    Py_ssize_t nquotes = 0, nslashes = 0, qlen;
+    int eq;
+
+    if (!(conn && conn->pgconn && psyco_escape_bytewise(conn->pgconn))) {
+        if ((buf = psyco_escape_string(conn, from, len, NULL, &qlen))) {
+            rv = Bytes_FromStringAndSize(buf, qlen);
+            PyMem_Free(buf);
+        }
+        return rv;
+    }
+
+    /* count the chars to escape, looking for NULs on the way */
+    for (p = from; (p += strcspn(p, "'\\")) < end; p++) {
+        if (*p == '\'') {
+            nquotes++;
+        }
+        else if (*p == '\\') {
+            nslashes++;
+        }
+        else {
+            PyErr_Format(PyExc_ValueError,
+                "A string literal cannot contain NUL (0x00) characters.");
+            return NULL;
+        }
+    }
+
+    /* backslashes are escaped as libpq would do */
+    scs = PQparameterStatus(conn->pgconn, "standard_conforming_strings");
+    if (scs && 0 == strcmp(scs, "on")) {
+        special = "'";
+        nslashes = 0;
+    }
+    else {
+        special = "'\\";
+    }
+
+    eq = conn->equote ? 1 : 0;
+    qlen = len + nquotes + nslashes + eq + 2;
+    if (!(rv = Bytes_FromStringAndSize(NULL, qlen))) {
+        return NULL;
+    }
+
+    to = Bytes_AS_STRING(rv);
+    if (eq) {
+        *to++ = 'E';
+    }
+    *to++ = '\'';
+
+    if (nquotes + nslashes == 0) {
+        memcpy(to, from, len);
+        to += len;
+    }
+    else {
+        for (p = from; p < end;) {
+            size_t n = strcspn(p, special);
+            memcpy(to, p, n);
+            to += n;
+            p += n;
+            if (p < end) {
+                *to++ = *p;
+                *to++ = *p++;
+            }
+        }
+    }
+    *to = '\'';
+
+    return rv;
+}
+
 /* Escape a string for inclusion in a query as identifier.
  *
  * 'len' is optional: if < 0 it will be calculated.
@@ -344,6 +450,32 @@ exit:
 }
 
 
+/* Return 1 if the string only contains ascii chars, else 0.
+ *
+ * Check a word at time: most of the strings we get from the database are
+ * ascii, and this is much faster than going through a codec.
+ */
+int
+psyco_is_ascii(const char *str, Py_ssize_t len)
+{
+    const unsigned char *p = (const unsigned char *)str;
+    const unsigned char *end = p + len;
+    size_t mask;
+    size_t w;
+
+    memset(&mask, 0x80, sizeof(mask));
+    while (end - p >= (Py_ssize_t)sizeof(w)) {
+        memcpy(&w, p, sizeof(w));
+        if (w & mask) { return 0; }
+        p += sizeof(w);
+    }
+    while (p < end) {
+        if (*p++ & 0x80) { return 0; }
+    }
+    return 1;
+}
+
+
 /* psyco_set_error
  *
  * Create a new error of the given type with extra attributes.
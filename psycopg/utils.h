@@ -36,6 +36,9 @@ HIDDEN char *psyco_escape_string(
     connectionObject *conn,
     const char *from, Py_ssize_t len, char *to, Py_ssize_t *tolen);
 
+HIDDEN PyObject *psyco_quote_string(
+    connectionObject *conn, const char *from, Py_ssize_t len);
+
 HIDDEN char *psyco_escape_identifier(
     connectionObject *conn, const char *str, Py_ssize_t len);
 
@@ -54,6 +57,8 @@ HIDDEN PyObject *psyco_make_dsn(PyObject *dsn, PyObject *kwargs);
 HIDDEN PyObject *psyco_text_from_chars_safe(
     const char *str, Py_ssize_t len, PyObject *decoder);
 
+HIDDEN int psyco_is_ascii(const char *str, Py_ssize_t len);
+
 HIDDEN RAISES BORROWED PyObject *psyco_set_error(
     PyObject *exc, cursorObject *curs, const char *msg);
 
@@ -45,6 +45,9 @@ extern HIDDEN void timeradd(struct timeval *a, struct timeval *b, struct timeval
 
 extern HIDDEN void timersub(struct timeval *a, struct timeval *b, struct timeval *c);
 
+/* poll() is called WSAPoll() in winsock2 */
+#define poll(fds, nfds, timeout) WSAPoll(fds, nfds, timeout)
+
 #ifndef timercmp
 #define timercmp(a, b, cmp)          \
   (((a)->tv_sec == (b)->tv_sec) ?    \
@@ -434,7 +434,8 @@ sources = [
     'replication_message_type.c',
     'diagnostics_type.c', 'error_type.c', 'conninfo_type.c',
     'lobject_int.c', 'lobject_type.c',
-    'notify_type.c', 'xid_type.c',
+    'notice_type.c', 'notify_type.c', 'notifyqueue_type.c', 'poller_type.c',
+    'pgoutput_type.c', 'pool_type.c', 'xid_type.c',
 
     'adapter_asis.c', 'adapter_binary.c', 'adapter_datetime.c',
     'adapter_list.c', 'adapter_pboolean.c', 'adapter_pdecimal.c',
@@ -450,7 +451,10 @@ depends = [
     'replication_connection.h',
     'replication_cursor.h',
     'replication_message.h',
-    'notify.h', 'pqpath.h', 'xid.h', 'column.h', 'conninfo.h',
+    'notice.h', 'notify.h', 'notifyqueue.h', 'pgoutput.h', 'pool.h',
+    'poller.h',
+    'pqpath.h', 'xid.h',
+    'column.h', 'conninfo.h',
     'libpq_support.h', 'win32_support.h', 'utils.h',
 
     'adapter_asis.h', 'adapter_binary.h', 'adapter_datetime.h',
@@ -25,13 +25,16 @@
 
 import gc
 import time
+import asyncio
 import unittest
 import warnings
 
 import psycopg2
 import psycopg2.errors
 from psycopg2 import extensions as ext
+from psycopg2 import extras
 
+from .testconfig import dsn
 from .testutils import (ConnectingTestCase, StringIO, skip_before_postgres,
     skip_if_crdb, crdb_version, slow)
 
@@ -537,6 +540,198 @@ class AsyncTests(ConnectingTestCase):
         self.assertTrue(self.conn.closed)
         self.assertTrue(self.conn.async_)
 
+    @skip_before_postgres(8, 2)
+    def test_poll_many(self):
+        conns = [self.connect(async_=True) for i in range(3)]
+        pending = list(conns)
+        while pending:
+            for conn, error in ext.poll_many(pending):
+                self.assertEqual(error, None)
+                pending.remove(conn)
+
+        curss = [conn.cursor() for conn in conns]
+        for i, curs in enumerate(curss):
+            curs.execute("select %s from pg_sleep(%s)", (i, 0.3 - i * 0.1))
+
+        results = []
+        for curs in extras.as_completed(curss, timeout=10):
+            results.append(curs.fetchone()[0])
+        self.assertEqual(results, [2, 1, 0])
+
+    def test_poll_many_error(self):
+        conns = [self.conn, self.connect(async_=True)]
+        self.wait(conns[1])
+        curss = [conn.cursor() for conn in conns]
+        curss[0].execute("select 1")
+        curss[1].execute("select nosuchcolumn")
+        errors = {}
+        pending = list(conns)
+        while pending:
+            for conn, error in ext.poll_many(pending):
+                errors[conn] = error
+                pending.remove(conn)
+
+        self.assertEqual(errors[conns[0]], None)
+        self.assert_(isinstance(
+            errors[conns[1]], psycopg2.errors.UndefinedColumn))
+        self.assertEqual(curss[0].fetchone(), (1,))
+
+    @slow
+    @skip_before_postgres(8, 2)
+    def test_poll_many_timeout(self):
+        curs = self.conn.cursor()
+        curs.execute("select pg_sleep(1)")
+        t0 = time.time()
+        self.assertEqual(ext.poll_many([self.conn], 0.2), [])
+        self.assert_(0.1 < time.time() - t0 < 0.9)
+        self.assertRaises(TimeoutError,
+            list, extras.as_completed([curs], timeout=0.1))
+        self.wait(curs)
+
+    def test_poll_many_sync(self):
+        self.assertRaises(psycopg2.ProgrammingError,
+            ext.poll_many, [self.sync_conn])
+        self.assertEqual(ext.poll_many([]), [])
+
+
+class AsyncioTests(ConnectingTestCase):
+
+    def run_async(self, coro):
+        return asyncio.run(coro)
+
+    def test_aconnect(self):
+        async def f():
+            conn = await extras.aconnect(dsn)
+            try:
+                self.assert_(isinstance(conn, extras.AsyncioConnection))
+                self.assertEqual(conn.status, ext.STATUS_READY)
+                curs = conn.cursor()
+                self.assert_(isinstance(curs, extras.AsyncioCursor))
+                await curs.execute("select %s, %s", (10, 'x'))
+                self.assertEqual(await curs.fetchone(), (10, 'x'))
+            finally:
+                conn.close()
+
+        self.run_async(f())
+
+    def test_aconnect_error(self):
+        async def f():
+            await extras.aconnect(dsn, port=1)
+
+        self.assertRaises(psycopg2.OperationalError, self.run_async, f())
+
+    def test_poll_future(self):
+        conn = self.connect(async_=True)
+
+        async def f():
+            loop = asyncio.get_running_loop()
+            await conn.poll_future(loop)
+            curs = conn.cursor()
+            curs.execute("select generate_series(1, 3)")
+            self.assert_(conn.isexecuting())
+            await conn.poll_future(loop)
+            self.assert_(not conn.isexecuting())
+            self.assertEqual(curs.fetchall(), [(1,), (2,), (3,)])
+
+            # nothing to do: the future is already done
+            fut = conn.poll_future(loop)
+            self.assert_(fut.done())
+
+        self.run_async(f())
+
+    def test_fetch(self):
+        conn = self.connect(
+            async_=True, connection_factory=extras.AsyncioConnection)
+
+        async def f():
+            await conn.wait()
+            curs = conn.cursor()
+            await curs.execute("select generate_series(1, 5)")
+            self.assertEqual(await curs.fetchone(), (1,))
+            self.assertEqual(await curs.fetchmany(2), [(2,), (3,)])
+            self.assertEqual(await curs.fetchall(), [(4,), (5,)])
+
+            await curs.execute("select generate_series(1, 3)")
+            self.assertEqual([r async for r in curs], [(1,), (2,), (3,)])
+
+            self.assertEqual(await curs.callproc("abs", (-5,)), (-5,))
+            self.assertEqual(await curs.fetchone(), (5,))
+
+        self.run_async(f())
+
+    def test_error(self):
+        conn = self.connect(
+            async_=True, connection_factory=extras.AsyncioConnection)
+
+        async def f():
+            await conn.wait()
+            curs = conn.cursor()
+            with self.assertRaises(psycopg2.errors.DivisionByZero):
+                await curs.execute("select 1 / 0")
+            await curs.execute("select 1")
+            self.assertEqual(await curs.fetchone(), (1,))
+
+        self.run_async(f())
+
+    @skip_if_crdb("create table")
+    def test_transaction(self):
+        conn = self.connect(
+            async_=True, connection_factory=extras.AsyncioConnection)
+
+        async def f():
+            await conn.wait()
+            curs = conn.cursor()
+            await curs.execute("create temp table asyncio_tx (id int)")
+            await curs.execute("begin")
+            await curs.execute("insert into asyncio_tx values (1)")
+            await conn.rollback()
+            await curs.execute("begin")
+            await curs.execute("insert into asyncio_tx values (2)")
+            await conn.commit()
+            await curs.execute("select id from asyncio_tx")
+            self.assertEqual(await curs.fetchall(), [(2,)])
+
+        self.run_async(f())
+
+    @slow
+    @skip_before_postgres(8, 2)
+    def test_concurrent(self):
+        async def query(i):
+            conn = await extras.aconnect(dsn)
+            try:
+                curs = conn.cursor()
+                await curs.execute("select pg_sleep(1), %s", (i,))
+                return (await curs.fetchone())[1]
+            finally:
+                conn.close()
+
+        async def f():
+            return await asyncio.gather(*[query(i) for i in range(4)])
+
+        t0 = time.time()
+        self.assertEqual(self.run_async(f()), [0, 1, 2, 3])
+        self.assert_(time.time() - t0 < 3)
+
+    @slow
+    @skip_if_crdb("cancel")
+    @skip_before_postgres(8, 2)
+    def test_cancel(self):
+        conn = self.connect(
+            async_=True, connection_factory=extras.AsyncioConnection)
+
+        async def f():
+            await conn.wait()
+            curs = conn.cursor()
+            with self.assertRaises(asyncio.TimeoutError):
+                await asyncio.wait_for(curs.execute("select pg_sleep(10)"), 0.5)
+            self.assert_(not conn.isexecuting())
+            await curs.execute("select 1")
+            self.assertEqual(await curs.fetchone(), (1,))
+
+        t0 = time.time()
+        self.run_async(f())
+        self.assert_(time.time() - t0 < 5)
+
 
 def test_suite():
     return unittest.TestLoader().loadTestsFromName(__name__)
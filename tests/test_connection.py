@@ -33,6 +33,7 @@ import shutil
 import tempfile
 import threading
 import subprocess as sp
+from datetime import date
 from collections import deque
 from operator import attrgetter
 from weakref import ref
@@ -159,6 +160,24 @@ class ConnectionTests(ConnectingTestCase):
         self.assertEqual(50, len(conn.notices))
         self.assert_('table99' in conn.notices[-1], conn.notices[-1])
 
+    @skip_if_crdb("notice")
+    def test_notices_references(self):
+        conn = self.conn
+        cur = conn.cursor()
+        if self.conn.info.server_version >= 90300:
+            cur.execute("set client_min_messages=debug1")
+
+        # lists taken before the notices arrive see them
+        notices = conn.notices
+        cur.execute("create temp table table1 (id serial);")
+        self.assert_('table1' in notices[-1], notices)
+
+        conn.notices = mylist = []
+        cur.execute("create temp table table2 (id serial);")
+        self.assertEqual(len(mylist), 1)
+        self.assert_('table2' in mylist[0], mylist)
+        self.assert_('table2' not in notices[-1], notices)
+
     @slow
     @skip_if_crdb("notice")
     def test_notices_deque(self):
@@ -203,6 +222,43 @@ class ConnectionTests(ConnectingTestCase):
 
         self.assertEqual(self.conn.notices, None)
 
+    @skip_if_crdb("notice")
+    @skip_before_postgres(9, 0)
+    def test_notice_handler(self):
+        conn = self.conn
+        notices = []
+        conn.add_notice_handler(notices.append)
+        cur = conn.cursor()
+        cur.execute("""
+            do $$begin raise notice 'hello %', 42 using hint = 'hi'; end$$
+            """)
+        self.assertEqual(len(notices), 1)
+        notice = notices[0]
+        self.assert_(isinstance(notice, ext.Notice))
+        self.assertEqual(notice.severity, 'NOTICE')
+        self.assertEqual(notice.sqlstate, '00000')
+        self.assertEqual(notice.message_primary, 'hello 42')
+        self.assertEqual(notice.message_hint, 'hi')
+        self.assertEqual(str(notice), conn.notices[-1])
+
+        conn.remove_notice_handler(notices.append)
+        cur.execute("do $$begin raise notice 'world'; end$$")
+        self.assertEqual(len(notices), 1)
+        self.assertEqual(len(conn.notices), 2)
+        self.assertRaises(ValueError, conn.remove_notice_handler, notices.append)
+
+    @skip_if_crdb("notice")
+    @skip_before_postgres(9, 0)
+    def test_notice_handler_error(self):
+        def handler(notice):
+            raise ZeroDivisionError
+
+        self.conn.add_notice_handler(handler)
+        cur = self.conn.cursor()
+        cur.execute("do $$begin raise notice 'hello'; end$$")
+        self.assertEqual(len(self.conn.notices), 1)
+        self.assertRaises(TypeError, self.conn.add_notice_handler, 42)
+
     def test_server_version(self):
         self.assert_(self.conn.server_version)
 
@@ -238,6 +294,45 @@ class ConnectionTests(ConnectingTestCase):
         self.assert_(time.time() - t0 < 7,
             "something broken in concurrency")
 
+    @skip_if_crdb("encoding")
+    def test_shared_connection_state(self):
+        # threads using the same connection, while another one changes the
+        # encoding and the adapters, shouldn't see the state half updated.
+        # The value encodes the same in both encodings: a query encoded just
+        # before the switch may be sent after it.
+        errors = []
+
+        class Wat(str):
+            pass
+
+        def worker():
+            try:
+                cur = self.conn.cursor()
+                for i in range(200):
+                    cur.execute("select %s, %s", (Wat("x'y"), i))
+                    self.assertEqual(cur.fetchone(), ("x'y", i))
+            except Exception as e:
+                errors.append(e)
+
+        def changer():
+            try:
+                for i in range(50):
+                    self.conn.set_client_encoding(
+                        i % 2 and 'LATIN1' or 'UTF8')
+                    self.assert_(self.conn.encoding in ('LATIN1', 'UTF8'))
+                    ext.register_adapter(Wat, ext.QuotedString)
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=worker) for i in range(4)]
+        threads.append(threading.Thread(target=changer))
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        del ext.adapters[Wat, ext.ISQLQuote]
+        self.assertEqual(errors, [])
+
     @skip_if_crdb("encoding")
     def test_encoding_name(self):
         self.conn.set_client_encoding("EUC_JP")
@@ -247,6 +342,69 @@ class ConnectionTests(ConnectingTestCase):
         cur.execute("select 'foo'::text;")
         self.assertEqual(cur.fetchone()[0], 'foo')
 
+    def test_datestyle_options(self):
+        conn = self.connect(options='-c DateStyle=ISO,DMY')
+        self.assertEqual(conn.info.parameter_status('DateStyle'), 'ISO, DMY')
+        cur = conn.cursor()
+        cur.execute("select '01/02/2003'::date")
+        self.assertEqual(cur.fetchone()[0], date(2003, 2, 1))
+
+    def test_parallel_hosts(self):
+        params = ext.parse_dsn(dsn)
+        host = params.get('host', '')
+        port = params.get('port', '5432')
+        params['host'] = f"{host},{host}"
+        params['port'] = f"1,{port}"
+        conn = self.connect(dsn=ext.make_dsn(**params), parallel_hosts=True)
+        self.assertEqual(conn.info.port, int(port))
+        cur = conn.cursor()
+        cur.execute("select 1")
+        self.assertEqual(cur.fetchone(), (1,))
+
+        params['port'] = "1,2"
+        self.assertRaises(psycopg2.OperationalError, self.connect,
+            dsn=ext.make_dsn(**params), parallel_hosts=True)
+
+    @unittest.skipIf(not sys.platform.startswith('linux'),
+        "async parallel connection only supported on Linux")
+    def test_parallel_hosts_async(self):
+        params = ext.parse_dsn(dsn)
+        host = params.get('host', '')
+        port = params.get('port', '5432')
+        params['host'] = f"{host},{host}"
+        params['port'] = f"1,{port}"
+        conn = self.connect(dsn=ext.make_dsn(**params),
+            parallel_hosts=True, async_=True)
+        psycopg2.extras.wait_select(conn)
+        self.assertEqual(conn.info.port, int(port))
+        cur = conn.cursor()
+        cur.execute("select 1")
+        psycopg2.extras.wait_select(conn)
+        self.assertEqual(cur.fetchone(), (1,))
+
+        params['port'] = "1,2"
+        conn = self.connect(dsn=ext.make_dsn(**params),
+            parallel_hosts=True, async_=True)
+        self.assertRaises(psycopg2.OperationalError,
+            psycopg2.extras.wait_select, conn)
+
+    def test_parallel_hosts_env(self):
+        params = ext.parse_dsn(dsn)
+        host = params.pop('host', '')
+        port = params.pop('port', '5432')
+        oldenv = {k: os.environ.get(k) for k in ('PGHOST', 'PGPORT')}
+        os.environ['PGHOST'] = f"{host},{host}"
+        os.environ['PGPORT'] = f"1,{port}"
+        try:
+            conn = self.connect(dsn=ext.make_dsn(**params), parallel_hosts=True)
+        finally:
+            for k, v in oldenv.items():
+                if v is None:
+                    os.environ.pop(k, None)
+                else:
+                    os.environ[k] = v
+        self.assertEqual(conn.info.port, int(port))
+
     def test_connect_nonnormal_envvar(self):
         # We must perform encoding normalization at connection time
         self.conn.close()
@@ -28,6 +28,7 @@ import sys
 import time
 import ctypes
 import pickle
+import subprocess as sp
 import psycopg2
 import psycopg2.extensions
 import unittest
@@ -37,6 +38,7 @@ from weakref import ref
 from .testutils import (ConnectingTestCase, skip_before_postgres,
     skip_if_no_getrefcount, slow, skip_if_no_superuser,
     skip_if_windows, skip_if_crdb, crdb_version)
+from .testconfig import dsn
 
 import psycopg2.extras
 
@@ -139,6 +141,64 @@ class CursorTests(ConnectingTestCase):
         self.assertRaises(psycopg2.ProgrammingError,
             cur.mogrify, "select %(foo, %(bar)", {'foo': 1, 'bar': 2})
 
+    def test_mogrify_repeated_query(self):
+        # the same query is merged with different arguments every time
+        cur = self.conn.cursor()
+        for i in range(3):
+            self.assertEqual(
+                cur.mogrify("select %s, '%%', %s", (i, None)),
+                b"select %d, '%%', NULL" % i)
+            self.assertEqual(
+                cur.mogrify("select %(a)s, %(b)s, %(a)s", {'a': i, 'b': 'x'}),
+                b"select %d, 'x', %d" % (i, i))
+            self.assertEqual(
+                cur.mogrify("select '%%s'", ()), b"select '%s'")
+            self.assertEqual(cur.mogrify("select '%%s'"), b"select '%%s'")
+            self.assertRaises(TypeError, cur.mogrify, "select %s", (1, 2))
+            self.assertRaises(KeyError, cur.mogrify, "select %(a)s", {})
+
+    def test_mogrify_trailing_percent(self):
+        cur = self.conn.cursor()
+        for q in ["select 1 %", "select %s, '%", "select '%%%"]:
+            self.assertRaises(psycopg2.ProgrammingError, cur.mogrify, q, (1,))
+            self.assertRaises(psycopg2.ProgrammingError, cur.execute, q, (1,))
+
+    def test_fetch_many_converted(self):
+        # int and bytea values are converted in blocks by fetchmany/fetchall
+        cur = self.conn.cursor()
+        query = """
+            select i::int4, i * 12345678901::int8,
+                i * -3689348814741910::int8, null::int8,
+                decode(repeat(lpad(to_hex(i %% 256), 2, '0'), i), 'hex'),
+                case when i %% 3 = 0 then null else ''::bytea end
+            from generate_series(0, %s) i"""
+        cur.execute(query, (2500,))
+        want = [cur.fetchone() for i in range(2501)]
+        cur.execute(query, (2500,))
+        got = cur.fetchmany(10) + cur.fetchmany(1500) + cur.fetchall()
+        self.assertEqual(len(got), len(want))
+        for r1, r2 in zip(got, want):
+            self.assertEqual(r1[:4], r2[:4])
+            self.assertEqual(r1[4].tobytes(), r2[4].tobytes())
+            self.assertEqual(r1[5] and r1[5].tobytes(), r2[5] and r2[5].tobytes())
+
+        self.assertEqual(got[2500][1], 2500 * 12345678901)
+        self.assertEqual(got[2500][2], -9223372036854775000)
+        self.assertEqual(got[255][4].tobytes(), b'\xff' * 255)
+
+    def test_mogrify_str_bytes_query(self):
+        # str and bytes queries with the same hash are cached apart: they
+        # are never compared, which would warn with python -bb
+        script = f"""\
+import psycopg2
+cur = psycopg2.connect({dsn!r}).cursor()
+for q in ["select %s", b"select %s"] * 2:
+    assert cur.mogrify(q, (1,)) == b"select 1"
+"""
+        out = sp.check_output(
+            [sys.executable, '-bb', '-c', script], stderr=sp.STDOUT)
+        self.assertEqual(out, b'', out)
+
     def test_bad_params_number(self):
         cur = self.conn.cursor()
         self.assertRaises(IndexError, cur.execute, "select %s, %s", [1])
@@ -170,6 +230,22 @@ class CursorTests(ConnectingTestCase):
         curs2 = self.conn.cursor()
         self.assertEqual("foofoo", curs2.cast(705, 'foo'))
 
+    def test_cast_mixed_row(self):
+        curs = self.conn.cursor()
+        seen = []
+
+        def cast_text(v, c):
+            seen.append(v)
+            return v and v.upper()
+
+        T = psycopg2.extensions.new_type((25,), "UPPER", cast_text)
+        psycopg2.extensions.register_type(T, curs)
+        curs.execute("""select 1, 'a'::text, null::int, null::text,
+            '{1,NULL,3}'::int4[], ''::text, '2011-01-02'::date""")
+        self.assertEqual(curs.fetchone(),
+            (1, 'A', None, None, [1, None, 3], '', date(2011, 1, 2)))
+        self.assertEqual(seen, ['a', None, ''])
+
     def test_weakref(self):
         curs = self.conn.cursor()
         w = ref(curs)
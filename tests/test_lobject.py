@@ -23,6 +23,7 @@
 # FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
 # License for more details.
 
+import io
 import os
 import shutil
 import tempfile
@@ -30,6 +31,7 @@ from functools import wraps
 
 import psycopg2
 import psycopg2.extensions
+from psycopg2.extras import LargeObjectIO, import_lobject, export_lobject
 import unittest
 from .testutils import (decorate_all_tests, skip_if_tpc_disabled,
     skip_before_postgres, ConnectingTestCase, skip_if_green, skip_if_crdb, slow)
@@ -161,6 +163,26 @@ class LargeObjectTests(LargeObjectTestCase):
         data = "data" * 1000000
         self.assertEqual(lo.write(data), len(data))
 
+    def test_write_buffer(self):
+        lo = self.conn.lobject()
+        self.assertEqual(lo.write(memoryview(b"some data")[:4]), 4)
+        self.assertEqual(lo.write(bytearray(b" data")), 5)
+        lo.close()
+
+        lo = self.conn.lobject(lo.oid, "rb")
+        self.assertEqual(lo.read(), b"some data")
+
+    @slow
+    def test_write_chunks(self):
+        # written in pipeline in several chunks
+        data = os.urandom(3 * 1024 * 1024 + 10)
+        lo = self.conn.lobject(mode="wb")
+        self.assertEqual(lo.write(data), len(data))
+        lo.close()
+
+        lo = self.conn.lobject(lo.oid, "rb")
+        self.assert_(lo.read() == data)
+
     def test_read(self):
         lo = self.conn.lobject()
         lo.write(b"some data")
@@ -195,6 +217,21 @@ class LargeObjectTests(LargeObjectTestCase):
         self.assertEqual(x, "some")
         self.assertEqual(lo.read(), " data " + snowman)
 
+    def test_readinto(self):
+        lo = self.conn.lobject()
+        lo.write("some data \u2603")
+        lo.close()
+
+        lo = self.conn.lobject(lo.oid, "rt")
+        buf = bytearray(4)
+        self.assertEqual(lo.readinto(buf), 4)
+        self.assertEqual(buf, b"some")
+        buf = bytearray(20)
+        self.assertEqual(lo.readinto(memoryview(buf)[1:]), 9)
+        self.assertEqual(buf[1:10], " data \u2603".encode())
+        self.assertEqual(lo.readinto(buf), 0)
+        self.assertRaises(TypeError, lo.readinto, b"data")
+
     @slow
     def test_read_large(self):
         lo = self.conn.lobject()
@@ -394,6 +431,81 @@ class LargeObjectTests(LargeObjectTestCase):
         self.assert_(isinstance(lo, lobject_subclass))
 
 
+@skip_if_no_lo
+class LargeObjectIOTests(LargeObjectTestCase):
+    def create_data(self):
+        data = os.urandom(100000)
+        lo = self.conn.lobject(mode="wb")
+        lo.write(data)
+        lo.close()
+        self.lo_oid = lo.oid
+        return data
+
+    def test_read(self):
+        data = self.create_data()
+        f = LargeObjectIO(self.conn.lobject(self.lo_oid, "rb"))
+        self.assert_(f.readable())
+        self.assert_(not f.writable())
+        self.assertEqual(f.read(10), data[:10])
+        self.assertEqual(f.readall(), data[10:])
+        f.close()
+        self.assert_(f.closed)
+
+    def test_readahead(self):
+        data = self.create_data()
+        for readahead in (0, 1000, 65536, 200000):
+            f = io.BufferedReader(LargeObjectIO(
+                self.conn.lobject(self.lo_oid, "rb"), readahead=readahead))
+            out = io.BytesIO()
+            shutil.copyfileobj(f, out, 3000)
+            self.assert_(out.getvalue() == data)
+            f.close()
+
+    def test_readall_chunks(self):
+        data = self.create_data()
+        f = LargeObjectIO(self.conn.lobject(self.lo_oid, "rb"), readahead=1000)
+        self.assertEqual(f.read(10), data[:10])
+        self.assert_(f.readall() == data[10:])
+        self.assertEqual(f.tell(), len(data))
+        f.close()
+
+    def test_seek_tell(self):
+        data = self.create_data()
+        f = LargeObjectIO(self.conn.lobject(self.lo_oid, "rb"), readahead=1000)
+        self.assertEqual(f.read(10), data[:10])
+        self.assertEqual(f.tell(), 10)
+        self.assertEqual(f.seek(5, os.SEEK_CUR), 15)
+        self.assertEqual(f.read(10), data[15:25])
+        self.assertEqual(f.seek(-10, os.SEEK_END), len(data) - 10)
+        self.assertEqual(f.read(), data[-10:])
+        self.assertEqual(f.tell(), len(data))
+        f.close()
+
+    def test_write(self):
+        f = LargeObjectIO(self.conn.lobject(mode="wb"))
+        self.lo_oid = f.lobj.oid
+        self.assertEqual(f.write(memoryview(b"some data")), 9)
+        self.assertEqual(f.truncate(4), 4)
+        f.close()
+
+        lo = self.conn.lobject(self.lo_oid, "rb")
+        self.assertEqual(lo.read(), b"some")
+
+    def test_import_export(self):
+        data = os.urandom(100000)
+        for src in (data, io.BytesIO(data)):
+            lo = import_lobject(self.conn, src, bufsize=30000)
+            self.lo_oid = lo.oid
+            lo.close()
+
+            lo = self.conn.lobject(self.lo_oid, "rb")
+            self.assertEqual(lo.read(10), data[:10])
+            out = io.BytesIO()
+            self.assertEqual(export_lobject(lo, out, bufsize=30000), len(data) - 10)
+            self.assert_(out.getvalue() == data[10:])
+            lo.unlink()
+
+
 @decorate_all_tests
 def skip_if_no_truncate(f):
     @wraps(f)
@@ -37,6 +37,7 @@ from .testconfig import dsn
 import sys
 import time
 import select
+import threading
 from subprocess import Popen, PIPE
 
 
@@ -237,6 +238,95 @@ conn.close()
         self.conn.poll()
         self.assertEqual(self.conn.notifies, None)
 
+    @slow
+    def test_notify_queue(self):
+        self.autocommit(self.conn)
+        q = extensions.NotifyQueue(10)
+        self.conn.notifies = q
+        self.assert_(self.conn.notifies is q)
+        self.listen('foo')
+        pid = int(self.notify('foo', payload="bar").communicate()[0])
+        time.sleep(0.5)
+        self.conn.poll()
+        self.assertEqual(len(q), 1)
+        self.assertEqual(q.pop(0), Notify(pid, 'foo', 'bar'))
+        self.assertEqual(len(q), 0)
+
+    @slow
+    def test_notify_queue_get(self):
+        self.autocommit(self.conn)
+        self.conn.notifies = q = extensions.NotifyQueue(10)
+        self.listen('foo')
+        self.assertEqual(q.get(timeout=0.1), None)
+
+        proc = self.notify('foo', 1)
+        t0 = time.time()
+        notify = q.get(timeout=5)
+        t1 = time.time()
+        self.assert_(0.99 < t1 - t0 < 4, t1 - t0)
+        pid = int(proc.communicate()[0])
+        self.assertEqual(notify, Notify(pid, 'foo'))
+
+    @slow
+    def test_notify_queue_subclass(self):
+        class MyQueue(extensions.NotifyQueue):
+            def append(self, notify):
+                super().append(Notify(notify.pid, notify.channel, 'baz'))
+
+        self.autocommit(self.conn)
+        self.conn.notifies = q = MyQueue(10)
+        self.listen('foo')
+        pid = int(self.notify('foo', payload="bar").communicate()[0])
+        self.assertEqual(q.get(timeout=5), Notify(pid, 'foo', 'baz'))
+
+    @slow
+    def test_notify_queue_get_closed(self):
+        self.autocommit(self.conn)
+        self.conn.notifies = q = extensions.NotifyQueue(10)
+        self.listen('foo')
+        t = threading.Timer(0.5, self.conn.close)
+        t.start()
+        t0 = time.time()
+        self.assertRaises(psycopg2.InterfaceError, q.get)
+        self.assert_(time.time() - t0 < 3)
+        t.join()
+        self.assertRaises(psycopg2.InterfaceError, q.get)
+
+    def test_notify_queue_drop(self):
+        q = extensions.NotifyQueue(3)
+        self.assertEqual(q.maxsize, 3)
+        self.assertEqual(q.overflow, 'drop')
+        for i in range(5):
+            q.append(Notify(i, 'foo'))
+        self.assertEqual(len(q), 3)
+        self.assertEqual(q.dropped, 2)
+        self.assertEqual([n.pid for n in q], [2, 3, 4])
+        self.assertEqual(q.pop().pid, 4)
+        self.assertEqual(q.pop(0).pid, 2)
+        self.assertEqual(q[0].pid, 3)
+        q.clear()
+        self.assertEqual(len(q), 0)
+        self.assertRaises(IndexError, q.pop)
+
+    def test_notify_queue_raise(self):
+        q = extensions.NotifyQueue(2, overflow='raise')
+        for i in range(5):
+            q.append(Notify(i, 'foo'))
+        self.assertEqual(q.dropped, 3)
+        self.assertRaises(psycopg2.OperationalError, q.pop, 0)
+        self.assertEqual([q.pop(0).pid, q.pop(0).pid], [0, 1])
+
+    def test_notify_queue_bind(self):
+        q = extensions.NotifyQueue(2)
+        self.assertRaises(psycopg2.ProgrammingError, q.get, 0)
+        self.conn.notifies = q
+        conn2 = self.connect()
+        self.assertRaises(ValueError, setattr, conn2, 'notifies', q)
+        self.conn.notifies = []
+        conn2.notifies = q
+        self.assertRaises(ValueError, extensions.NotifyQueue, 0)
+        self.assertRaises(ValueError, extensions.NotifyQueue, 2, 'foo')
+
     def test_notify_init(self):
         n = psycopg2.extensions.Notify(10, 'foo')
         self.assertEqual(10, n.pid)
@@ -0,0 +1,399 @@
+#!/usr/bin/env python
+
+# test_pool.py - unit test for the connection pools
+#
+# Copyright (C) 2020-2021 The Psycopg Team
+#
+# psycopg2 is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published
+# by the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# In addition, as a special exception, the copyright holders give
+# permission to link this program with the OpenSSL library (or with
+# modified versions of OpenSSL that use the same license as OpenSSL),
+# and distribute linked combinations including the two.
+#
+# You must obey the GNU Lesser General Public License in all respects for
+# all of the code used other than OpenSSL.
+#
+# psycopg2 is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+# License for more details.
+
+import time
+import threading
+
+import psycopg2
+import psycopg2.extensions as ext
+from psycopg2.pool import NativeConnectionPool, PoolError
+
+import unittest
+from .testutils import ConnectingTestCase, skip_if_no_superuser, slow
+from .testconfig import dsn
+
+
+class NativeConnectionPoolTests(ConnectingTestCase):
+    def setUp(self):
+        ConnectingTestCase.setUp(self)
+        self._pools = []
+
+    def tearDown(self):
+        for pool in self._pools:
+            if not pool.closed:
+                pool.closeall()
+        ConnectingTestCase.tearDown(self)
+
+    def pool(self, minconn=0, maxconn=2, **kwargs):
+        pool = NativeConnectionPool(minconn, maxconn, dsn, **kwargs)
+        self._pools.append(pool)
+        return pool
+
+    def test_init(self):
+        pool = self.pool(2, 4)
+        self.assertEqual(pool.minconn, 2)
+        self.assertEqual(pool.maxconn, 4)
+        self.assertEqual(pool.size, 2)
+        self.assertEqual(pool.idle, 2)
+        self.assertFalse(pool.closed)
+
+    def test_bad_size(self):
+        self.assertRaises(ValueError, NativeConnectionPool, 3, 2, dsn)
+        self.assertRaises(ValueError, NativeConnectionPool, 0, 0, dsn)
+
+    def test_getconn_putconn(self):
+        pool = self.pool(1, 2)
+        conn = pool.getconn()
+        self.assertIsInstance(conn, ext.connection)
+        self.assertEqual((pool.size, pool.idle), (1, 0))
+        conn2 = pool.getconn()
+        self.assertIsNot(conn2, conn)
+        self.assertEqual((pool.size, pool.idle), (2, 0))
+
+        pool.putconn(conn)
+        pool.putconn(conn2)
+        self.assertEqual((pool.size, pool.idle), (2, 2))
+        self.assertFalse(conn.closed)
+
+        self.assertIs(pool.getconn(), conn2)
+
+    def test_putconn_close(self):
+        pool = self.pool(1, 2)
+        conn = pool.getconn()
+        pool.putconn(conn, close=True)
+        self.assertTrue(conn.closed)
+        self.assertEqual((pool.size, pool.idle), (0, 0))
+
+    def test_putconn_closed_conn(self):
+        pool = self.pool(1, 2)
+        conn = pool.getconn()
+        conn.close()
+        pool.putconn(conn)
+        self.assertEqual((pool.size, pool.idle), (0, 0))
+        self.assertFalse(pool.getconn().closed)
+
+    def test_putconn_unknown(self):
+        pool = self.pool(1, 2)
+        self.assertRaises(PoolError, pool.putconn, self.conn)
+        conn = pool.getconn()
+        pool.putconn(conn)
+        self.assertRaises(PoolError, pool.putconn, conn)
+        self.assertRaises(TypeError, pool.putconn, None)
+
+    def test_key(self):
+        pool = self.pool(0, 2)
+        conn = pool.getconn('a')
+        self.assertIs(pool.getconn('a'), conn)
+        self.assertIsNot(pool.getconn('b'), conn)
+        pool.putconn(conn)
+        self.assertEqual(pool.idle, 1)
+        conn2 = pool.getconn('a')
+        self.assertIs(conn2, conn)
+        pool.putconn(conn2, key='a')
+        self.assertEqual(pool.idle, 1)
+
+    def test_thread_affinity(self):
+        pool = self.pool(0, 2)
+        conn1 = pool.getconn()
+        conn2 = pool.getconn()
+        pool.putconn(conn1)
+        t = threading.Thread(target=pool.putconn, args=(conn2,))
+        t.start()
+        t.join()
+
+        # the connection returned by this thread is preferred to the newest
+        self.assertIs(pool.getconn(), conn1)
+        self.assertIs(pool.getconn(), conn2)
+
+    def test_reset(self):
+        pool = self.pool(0, 1)
+        conn = pool.getconn()
+        conn.cursor().execute("select 1")
+        self.assertEqual(conn.info.transaction_status,
+            ext.TRANSACTION_STATUS_INTRANS)
+        pool.putconn(conn)
+        self.assertEqual(conn.info.transaction_status,
+            ext.TRANSACTION_STATUS_IDLE)
+        self.assertIs(pool.getconn(), conn)
+
+    def test_deferred_reset(self):
+        pool = self.pool(0, 2, deferred_reset=True)
+        conn1 = pool.getconn()
+        conn2 = pool.getconn()
+        pool.putconn(conn2)
+        conn1.cursor().execute("select 1")
+        pool.putconn(conn1)
+        self.assertEqual(conn1.info.transaction_status,
+            ext.TRANSACTION_STATUS_INTRANS)
+
+        # the clean connection is preferred
+        self.assertIs(pool.getconn(), conn2)
+        self.assertIs(pool.getconn(), conn1)
+        self.assertEqual(conn1.info.transaction_status,
+            ext.TRANSACTION_STATUS_IDLE)
+
+    def test_exhausted_timeout(self):
+        pool = self.pool(0, 1, timeout=0.2)
+        pool.getconn()
+        t0 = time.monotonic()
+        self.assertRaises(PoolError, pool.getconn)
+        self.assert_(time.monotonic() - t0 >= 0.2)
+        self.assertRaises(PoolError, pool.getconn, timeout=0)
+
+    def test_wait(self):
+        pool = self.pool(0, 1)
+        conn = pool.getconn()
+        t = threading.Timer(0.1, pool.putconn, args=(conn,))
+        t.start()
+        t0 = time.monotonic()
+        self.assertIs(pool.getconn(timeout=2), conn)
+        self.assert_(time.monotonic() - t0 >= 0.1)
+        t.join()
+
+    def test_wait_doesnt_block_putconn(self):
+        pool = self.pool(0, 2)
+        conn1 = pool.getconn()
+        conn2 = pool.getconn()
+        t = threading.Thread(target=pool.getconn, kwargs={'timeout': 5})
+        t.start()
+        time.sleep(0.1)
+
+        # the waiter may connect or reset a connection in _getconn()
+        getconn = pool._getconn
+
+        def slow_getconn():
+            time.sleep(0.5)
+            return getconn()
+
+        pool._getconn = slow_getconn
+        pool.putconn(conn1)
+        time.sleep(0.1)
+        t0 = time.monotonic()
+        pool.putconn(conn2)
+        self.assert_(time.monotonic() - t0 < 0.3)
+        t.join(2)
+        self.assertFalse(t.is_alive())
+
+    def test_closeall(self):
+        pool = self.pool(1, 2)
+        conn1 = pool.getconn()
+        conn2 = pool.getconn()
+        pool.putconn(conn2)
+        pool.closeall()
+        self.assertTrue(pool.closed)
+        self.assertTrue(conn1.closed)
+        self.assertTrue(conn2.closed)
+        self.assertRaises(PoolError, pool.getconn)
+        self.assertRaises(PoolError, pool.closeall)
+
+        # returning a connection in use is still fine
+        pool.putconn(conn1)
+        self.assertEqual(pool.size, 0)
+
+    def test_closeall_wakes_waiters(self):
+        pool = self.pool(0, 1)
+        pool.getconn()
+        errors = []
+
+        def wait():
+            try:
+                pool.getconn(timeout=10)
+            except PoolError as e:
+                errors.append(e)
+
+        t = threading.Thread(target=wait)
+        t.start()
+        time.sleep(0.1)
+        pool.closeall()
+        t.join(2)
+        self.assertFalse(t.is_alive())
+        self.assertEqual(len(errors), 1)
+
+    def test_bad_times(self):
+        self.assertRaises(ValueError,
+            NativeConnectionPool, 0, 1, dsn, max_lifetime=-1)
+        self.assertRaises(ValueError,
+            NativeConnectionPool, 0, 1, dsn, check_interval=0)
+        self.assertRaises(ValueError,
+            NativeConnectionPool, 0, 1, dsn, max_idle=-1)
+
+    def wait_for(self, f, timeout=2.0):
+        deadline = time.monotonic() + timeout
+        while not f():
+            if time.monotonic() > deadline:
+                self.fail("condition not met in time")
+            time.sleep(0.01)
+
+    @skip_if_no_superuser
+    def test_check_interval(self):
+        pool = self.pool(1, 2, check_interval=0.05)
+        self.assertEqual(pool.check_interval, 0.05)
+        conn = pool.getconn()
+        pid = conn.info.backend_pid
+        pool.putconn(conn)
+
+        self.conn.autocommit = True
+        self.conn.cursor().execute(
+            "select pg_terminate_backend(%s)", (pid,))
+        self.wait_for(lambda: conn.closed)
+
+        conn2 = pool.getconn()
+        self.assertIsNot(conn2, conn)
+        self.assertNotEqual(conn2.info.backend_pid, pid)
+        conn2.cursor().execute("select 1")
+
+    def test_max_lifetime(self):
+        pool = self.pool(1, 2, max_lifetime=0.1)
+        self.assertEqual(pool.max_lifetime, 0.1)
+        conn = pool.getconn()
+        pool.putconn(conn)
+
+        # the connection is replaced in background
+        self.wait_for(lambda: conn.closed)
+        self.wait_for(lambda: pool.idle == 1)
+        self.assertIsNot(pool.getconn(), conn)
+
+    def test_max_lifetime_in_use(self):
+        pool = self.pool(0, 2, max_lifetime=0.1)
+        conn = pool.getconn()
+        time.sleep(0.2)
+        pool.putconn(conn)
+        self.assertTrue(conn.closed)
+        self.assertEqual(pool.size, 0)
+
+    def test_background_reset(self):
+        pool = self.pool(0, 2, background_reset=True)
+        conn = pool.getconn()
+        conn.cursor().execute("select 1")
+        pool.putconn(conn)
+        self.wait_for(lambda: conn.info.transaction_status
+            == ext.TRANSACTION_STATUS_IDLE)
+        self.assertIs(pool.getconn(), conn)
+
+    def test_discard(self):
+        pool = self.pool(0, 1, discard=True)
+        conn = pool.getconn()
+        conn.cursor().execute("select 1")
+        pool.putconn(conn)
+        self.assertEqual(conn.info.transaction_status,
+            ext.TRANSACTION_STATUS_IDLE)
+        self.assertIs(pool.getconn(), conn)
+        conn.cursor().execute("select 1")
+
+    def test_prewarm(self):
+        pool = self.pool(3, 4)
+        self.assertEqual(pool.idle, 3)
+        conns = [pool.getconn() for i in range(3)]
+        for conn in conns:
+            self.assertFalse(conn.async_)
+            self.assertFalse(conn.autocommit)
+            conn.cursor().execute("select 1")
+            self.assertEqual(conn.info.transaction_status,
+                ext.TRANSACTION_STATUS_INTRANS)
+
+    def test_prewarm_serial(self):
+        # the connections can't be opened as async: fall back to one by one
+        pool = self.pool(2, 2, parallel_hosts=False)
+        self.assertEqual(pool.idle, 2)
+        pool.getconn().cursor().execute("select 1")
+
+    def test_max_idle(self):
+        pool = self.pool(1, 3, max_idle=0.1)
+        self.assertEqual(pool.max_idle, 0.1)
+        conns = [pool.getconn() for i in range(3)]
+        for conn in conns:
+            pool.putconn(conn)
+        self.assertEqual(pool.size, 3)
+
+        # the connections above minconn are closed in background
+        self.wait_for(lambda: pool.size == 1)
+        self.assertEqual(pool.idle, 1)
+        self.assertEqual(sum(conn.closed for conn in conns), 2)
+
+    def test_elastic(self):
+        pool = self.pool(0, 4, elastic=True)
+        conns = []
+
+        def work():
+            conns.append(pool.getconn(timeout=5))
+
+        ts = [threading.Thread(target=work) for i in range(3)]
+        for t in ts:
+            t.start()
+        for t in ts:
+            t.join()
+
+        self.assertEqual(len(conns), 3)
+        self.assertEqual(len(set(map(id, conns))), 3)
+        self.assert_(3 <= pool.size <= 4)
+        for conn in conns:
+            conn.cursor().execute("select 1")
+
+    def test_elastic_no_wait(self):
+        # the connection is opened for the next callers
+        pool = self.pool(0, 2, elastic=True)
+        self.assertRaises(PoolError, pool.getconn, timeout=0)
+        self.wait_for(lambda: pool.idle == 1)
+        self.assertEqual(pool.size, 1)
+
+    def test_elastic_connect_error(self):
+        pool = NativeConnectionPool(
+            0, 2, "host=127.0.0.1 port=1 connect_timeout=2", elastic=True)
+        self._pools.append(pool)
+        t0 = time.time()
+        self.assertRaises(psycopg2.OperationalError, pool.getconn, timeout=10)
+        self.assert_(time.time() - t0 < 5)
+        self.assertEqual(pool.size, 0)
+
+    @slow
+    def test_threads(self):
+        pool = self.pool(1, 4)
+        errors = []
+
+        def work():
+            try:
+                for i in range(20):
+                    conn = pool.getconn()
+                    conn.cursor().execute("select 1")
+                    pool.putconn(conn)
+            except Exception as e:
+                errors.append(e)
+
+        ts = [threading.Thread(target=work) for i in range(16)]
+        for t in ts:
+            t.start()
+        for t in ts:
+            t.join()
+
+        self.assertEqual(errors, [])
+        self.assert_(pool.size <= 4)
+        self.assertEqual(pool.size, pool.idle)
+
+
+def test_suite():
+    return unittest.TestLoader().loadTestsFromName(__name__)
+
+
+if __name__ == "__main__":
+    unittest.main()
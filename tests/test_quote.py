@@ -63,6 +63,12 @@ class QuotingTestCase(ConnectingTestCase):
         self.assertEqual(res, data)
         self.assert_(not self.conn.notices)
 
+    def test_string_escape_runs(self):
+        data = "'" * 3 + "\\" * 3 + "x" * 100000 + "'\\" * 1000 + "'"
+        curs = self.conn.cursor()
+        curs.execute("SELECT %s;", (data,))
+        self.assertEqual(curs.fetchone()[0], data)
+
     def test_string_null_terminator(self):
         curs = self.conn.cursor()
         data = 'abcd\x01\x00cdefg'
@@ -92,6 +98,13 @@ class QuotingTestCase(ConnectingTestCase):
         self.assertEqual(res, data)
         self.assert_(not self.conn.notices)
 
+    def test_binary_lengths(self):
+        curs = self.conn.cursor()
+        for n in range(20):
+            data = bytes(range(250, 250 - n, -1))
+            curs.execute("SELECT %s::bytea;", (psycopg2.Binary(data),))
+            self.assertEqual(curs.fetchone()[0].tobytes(), data)
+
     def test_unicode(self):
         curs = self.conn.cursor()
         curs.execute("SHOW server_encoding")
@@ -128,6 +141,42 @@ class QuotingTestCase(ConnectingTestCase):
         self.assert_(not self.conn.notices)
 
 
+    @skip_if_crdb("encoding")
+    def test_win1252(self):
+        self.conn.set_client_encoding('WIN1252')
+        curs = self.conn.cursor()
+        data = bytes(list(range(32, 127)) + list(range(130, 140))
+            + list(range(160, 256))).decode('cp1252')
+
+        # as string
+        curs.execute("SELECT %s::text;", (data,))
+        res = curs.fetchone()[0]
+        self.assertEqual(res, data)
+        self.assert_(not self.conn.notices)
+
+        # chars not in the charmap are still errors
+        self.assertRaises(UnicodeDecodeError,
+            psycopg2.extensions.UNICODE, b'\x81', curs)
+        self.assertRaises(UnicodeEncodeError,
+            curs.execute, "SELECT %s::text;", ("\u2603",))
+
+    @skip_if_crdb("encoding")
+    def test_sql_ascii_custom_codec(self):
+        encs = psycopg2.extensions.encodings
+        old = encs['SQL_ASCII'], encs['SQLASCII']
+        encs['SQL_ASCII'] = encs['SQLASCII'] = 'latin1'
+        try:
+            self.conn.set_client_encoding('SQL_ASCII')
+        finally:
+            encs['SQL_ASCII'], encs['SQLASCII'] = old
+
+        curs = self.conn.cursor()
+        data = bytes(range(160, 256)).decode('latin1')
+        self.assertEqual(curs.mogrify("SELECT %s;", (data,)),
+            b"SELECT '" + data.encode('latin1') + b"';")
+        self.assertEqual(
+            psycopg2.extensions.UNICODE(data.encode('latin1'), curs), data)
+
     @skip_if_crdb("encoding")
     def test_koi8(self):
         self.conn.set_client_encoding('KOI8')
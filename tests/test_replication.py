@@ -23,13 +23,18 @@
 # FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
 # License for more details.
 
+import os
 import time
+import struct
+import threading
+from decimal import Decimal
 from select import select
 
 import psycopg2
 from psycopg2 import sql
 from psycopg2.extras import (
-    PhysicalReplicationConnection, LogicalReplicationConnection, StopReplication)
+    PhysicalReplicationConnection, LogicalReplicationConnection, StopReplication,
+    PgoutputDecoder, UNCHANGED_TOAST)
 
 from . import testconfig
 import unittest
@@ -202,6 +207,104 @@ class ReplicationTest(ReplicationTestCase):
 
         conn.close()
 
+    @skip_before_postgres(9, 4)     # slots require 9.4
+    @skip_repl_if_green
+    def test_feedback_from_thread(self):
+        conn = self.repl_connect(connection_factory=LogicalReplicationConnection)
+        if conn is None:
+            return
+
+        cur = conn.cursor()
+
+        self.create_replication_slot(cur, output_plugin='test_decoding')
+
+        self.make_replication_events()
+
+        cur.start_replication(self.slot)
+
+        sent = []
+
+        def consume(msg):
+            if not sent:
+                # the feedback is left to the consume loop
+                sent.append(cur.feedback_timestamp)
+                t = threading.Thread(target=cur.send_feedback,
+                    kwargs={'flush_lsn': msg.data_start, 'force': True})
+                t.start()
+                t.join()
+                self.assertEqual(cur.feedback_timestamp, sent[0])
+            else:
+                self.assert_(cur.feedback_timestamp > sent[0])
+                raise StopReplication()
+
+        self.assertRaises(StopReplication, cur.consume_stream, consume)
+
+    @skip_before_postgres(9, 4)     # slots require 9.4
+    @skip_repl_if_green
+    def test_consume_stream_batches(self):
+        conn = self.repl_connect(connection_factory=LogicalReplicationConnection)
+        if conn is None:
+            return
+
+        cur = conn.cursor()
+
+        self.create_replication_slot(cur, output_plugin='test_decoding')
+
+        self.make_replication_events()
+
+        self.assertRaises(psycopg2.ProgrammingError,
+            cur.consume_stream_batches, lambda msgs, ready: None)
+
+        cur.start_replication(self.slot)
+
+        rfd, wfd = os.pipe()
+        self.addCleanup(os.close, rfd)
+        self.addCleanup(os.close, wfd)
+
+        batches = []
+
+        def consume(msgs, ready):
+            if ready:
+                self.assertEqual(ready, [rfd])
+                raise StopReplication()
+            self.assert_(0 < len(msgs) <= 2)
+            batches.append(msgs)
+            if any(m.payload.startswith('COMMIT') for m in msgs):
+                os.write(wfd, b'x')
+
+        self.assertRaises(ValueError, cur.consume_stream_batches,
+            consume, fds=[rfd], max_count=0)
+        self.assertRaises(StopReplication, cur.consume_stream_batches,
+            consume, fds=[rfd], max_count=2)
+        self.assert_(batches[0][0].payload.startswith('BEGIN'))
+
+    @skip_before_postgres(9, 4)     # slots require 9.4
+    @skip_repl_if_green
+    def test_zero_copy(self):
+        conn = self.repl_connect(connection_factory=LogicalReplicationConnection)
+        if conn is None:
+            return
+
+        cur = conn.cursor()
+
+        self.create_replication_slot(cur, output_plugin='test_decoding')
+
+        self.make_replication_events()
+
+        self.assertRaises(psycopg2.ProgrammingError,
+            cur.start_replication, self.slot, decode=True, zero_copy=True)
+        cur.start_replication(self.slot, zero_copy=True)
+
+        def consume(msg):
+            self.assert_(isinstance(msg.payload, memoryview))
+            self.assert_(msg.payload.readonly)
+            self.assertEqual(len(msg.payload), msg.data_size)
+            self.assert_(bytes(msg.payload).startswith(b'BEGIN'))
+            msg.payload.release()
+            raise StopReplication()
+
+        self.assertRaises(StopReplication, cur.consume_stream, consume)
+
     @skip_before_postgres(9, 4)     # slots require 9.4
     @skip_repl_if_green
     def test_stop_replication(self):
@@ -268,6 +371,126 @@ class AsyncReplicationTest(ReplicationTestCase):
         self.assertRaises(StopReplication, process_stream)
 
 
+    @skip_before_postgres(9, 4)     # slots require 9.4
+    @skip_repl_if_green
+    def test_read_messages(self):
+        conn = self.repl_connect(
+            connection_factory=LogicalReplicationConnection, async_=1)
+        if conn is None:
+            return
+
+        cur = conn.cursor()
+
+        self.create_replication_slot(cur, output_plugin='test_decoding')
+        self.wait(cur)
+
+        cur.start_replication(self.slot)
+        self.wait(cur)
+
+        self.make_replication_events()
+
+        self.assertRaises(ValueError, cur.read_messages, max_count=0)
+        self.assertRaises(ValueError, cur.read_messages, max_bytes=0)
+
+        msgs = []
+        while len(msgs) < 4:
+            batch = cur.read_messages(max_count=2)
+            self.assert_(isinstance(batch, list))
+            self.assert_(len(batch) <= 2)
+            if not batch:
+                select([cur], [], [])
+            msgs.extend(batch)
+
+        self.assertEqual(
+            [m.data_start for m in msgs], sorted(m.data_start for m in msgs))
+        for m in msgs:
+            self.assert_(m.cursor is cur)
+            self.assertEqual(m.data_size, len(m.payload))
+
+        cur.send_feedback(flush_lsn=msgs[-1].data_start, reply=True)
+
+
+def _pgstr(s):
+    return s.encode() + b'\0'
+
+
+def _pgtuple(*values):
+    rv = struct.pack('!h', len(values))
+    for v in values:
+        if v is None:
+            rv += b'n'
+        elif v is UNCHANGED_TOAST:
+            rv += b'u'
+        else:
+            rv += b't' + struct.pack('!i', len(v)) + v.encode()
+    return rv
+
+
+class PgoutputDecoderTest(ConnectingTestCase):
+    relation = (
+        b'R' + struct.pack('!i', 16384) + _pgstr('public') + _pgstr('tbl')
+        + b'd' + struct.pack('!h', 3)
+        + b'\x01' + _pgstr('id') + struct.pack('!ii', 23, -1)
+        + b'\x00' + _pgstr('data') + struct.pack('!ii', 25, -1)
+        + b'\x00' + _pgstr('num') + struct.pack('!ii', 1700, -1))
+
+    def setUp(self):
+        ConnectingTestCase.setUp(self)
+        self.decoder = PgoutputDecoder(self.conn.cursor())
+
+    def test_begin_commit(self):
+        msg = self.decoder.decode(
+            b'B' + struct.pack('!qqi', 0x1000, 0, 42))
+        self.assertEqual(msg.final_lsn, 0x1000)
+        self.assertEqual(msg.xid, 42)
+
+        msg = self.decoder.decode(
+            b'C' + struct.pack('!bqqq', 0, 0x1000, 0x1010, 0))
+        self.assertEqual(msg.commit_lsn, 0x1000)
+        self.assertEqual(msg.end_lsn, 0x1010)
+        self.assertEqual(msg.commit_time, msg.commit_time.fromtimestamp(
+            946684800))
+
+    def test_relation_insert(self):
+        rel = self.decoder.decode(self.relation)
+        self.assertEqual(rel.oid, 16384)
+        self.assertEqual((rel.namespace, rel.name), ('public', 'tbl'))
+        self.assertEqual([c.name for c in rel.columns], ['id', 'data', 'num'])
+        self.assertEqual([c.key for c in rel.columns], [True, False, False])
+        self.assert_(self.decoder.relations[16384] is rel)
+
+        msg = self.decoder.decode(
+            b'I' + struct.pack('!i', 16384) + b'N'
+            + _pgtuple('1', 'hello', '3.14'))
+        self.assert_(msg.relation is rel)
+        self.assertEqual(msg.new, (1, 'hello', Decimal('3.14')))
+
+    def test_update_delete(self):
+        self.decoder.decode(self.relation)
+        msg = self.decoder.decode(
+            b'U' + struct.pack('!i', 16384)
+            + b'K' + _pgtuple('1', None, None)
+            + b'N' + _pgtuple('2', UNCHANGED_TOAST, None))
+        self.assertEqual(msg.key, (1, None, None))
+        self.assert_(msg.old is None)
+        self.assertEqual(msg.new, (2, UNCHANGED_TOAST, None))
+
+        msg = self.decoder.decode(
+            b'D' + struct.pack('!i', 16384) + b'O' + _pgtuple('2', 'x', '1'))
+        self.assert_(msg.key is None)
+        self.assertEqual(msg.old, (2, 'x', Decimal('1')))
+
+    def test_bad_messages(self):
+        self.assertRaises(psycopg2.OperationalError, self.decoder.decode,
+            b'I' + struct.pack('!i', 16384) + b'N' + _pgtuple('1', 'a', '1'))
+        self.decoder.decode(self.relation)
+        self.assertRaises(psycopg2.OperationalError, self.decoder.decode,
+            b'I' + struct.pack('!i', 16384) + b'N' + _pgtuple('1'))
+        self.assertRaises(psycopg2.OperationalError, self.decoder.decode,
+            self.relation[:20])
+        self.assertRaises(psycopg2.NotSupportedError, self.decoder.decode,
+            b'Z')
+
 def test_suite():
     return unittest.TestLoader().loadTestsFromName(__name__)
 
@@ -29,6 +29,7 @@ from .testutils import ConnectingTestCase, skip_before_postgres, slow
 from .testutils import skip_if_crdb
 
 import psycopg2
+import psycopg2.errors
 from psycopg2.extensions import (
     ISOLATION_LEVEL_SERIALIZABLE, STATUS_BEGIN, STATUS_READY)
 
@@ -94,6 +95,61 @@ class TransactionTests(ConnectingTestCase):
         self.assertEqual(curs.fetchone()[0], 1)
 
 
+    def test_begin_with_query(self):
+        self.assertFalse(self.conn.begin_with_query)
+        self.conn.begin_with_query = True
+        curs = self.conn.cursor()
+        curs.execute('SELECT id FROM table1')
+        self.assertEqual(curs.fetchall(), [(1,)])
+        self.assertEqual(curs.statusmessage, 'SELECT 1')
+        self.assertEqual(self.conn.status, STATUS_BEGIN)
+        self.assertEqual(self.conn.info.transaction_status,
+            psycopg2.extensions.TRANSACTION_STATUS_INTRANS)
+        self.conn.rollback()
+
+        self.assertRaises(psycopg2.errors.UniqueViolation,
+            curs.execute, 'INSERT INTO table1 VALUES (1)')
+        self.assertEqual(self.conn.status, STATUS_BEGIN)
+        self.assertEqual(self.conn.info.transaction_status,
+            psycopg2.extensions.TRANSACTION_STATUS_INERROR)
+        self.conn.rollback()
+
+    def test_begin_with_query_syntax_error(self):
+        # nothing is executed: the state must be the same as sending BEGIN
+        # and the query separately
+        for begin_with_query in (False, True):
+            self.conn.begin_with_query = begin_with_query
+            curs = self.conn.cursor()
+            with self.assertRaises(psycopg2.errors.SyntaxError) as cm:
+                curs.execute('selec 1')
+            self.assertIs(cm.exception.cursor, curs)
+            self.assertEqual(self.conn.status, STATUS_BEGIN)
+            self.assertEqual(self.conn.info.transaction_status,
+                psycopg2.extensions.TRANSACTION_STATUS_INERROR)
+            self.assertRaises(psycopg2.errors.InFailedSqlTransaction,
+                curs.execute, 'SELECT 1')
+            self.conn.rollback()
+
+    def test_begin_with_query_committed_error(self):
+        # the query commits before failing: it must not be executed again
+        self.conn.begin_with_query = True
+        curs = self.conn.cursor()
+        self.assertRaises(psycopg2.errors.DivisionByZero, curs.execute,
+            'INSERT INTO table1 VALUES (2); COMMIT; SELECT 1 / 0')
+        self.assertEqual(self.conn.info.transaction_status,
+            psycopg2.extensions.TRANSACTION_STATUS_IDLE)
+        curs.execute('SELECT count(*) FROM table1 WHERE id = 2')
+        self.assertEqual(curs.fetchone()[0], 1)
+        self.conn.rollback()
+
+    def test_begin_empty_query(self):
+        self.conn.begin_with_query = True
+        curs = self.conn.cursor()
+        self.assertRaises(psycopg2.ProgrammingError,
+            curs.execute, '-- nothing to see here')
+        self.assertEqual(self.conn.status, STATUS_BEGIN)
+        self.conn.rollback()
+
 class DeadlockSerializationTests(ConnectingTestCase):
     """Test deadlock and serialization failure errors."""
 
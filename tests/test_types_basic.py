@@ -408,6 +408,27 @@ class AdaptSubclassTest(unittest.TestCase):
         register_adapter(A, lambda a: AsIs("a"))
         self.assertEqual(b"a", adapt(B()).getquoted())
 
+    @restore_types
+    def test_adapt_subtype_changed(self):
+        class A:
+            pass
+
+        class B(A):
+            pass
+
+        register_adapter(A, lambda a: AsIs("a"))
+        self.assertEqual(b"a", adapt(B()).getquoted())
+
+        # changes to the adapters must be seen after the first adaptation
+        register_adapter(B, lambda b: AsIs("b"))
+        self.assertEqual(b"b", adapt(B()).getquoted())
+
+        del psycopg2.extensions.adapters[B, psycopg2.extensions.ISQLQuote]
+        self.assertEqual(b"a", adapt(B()).getquoted())
+
+        psycopg2.extensions.adapters.clear()
+        self.assertRaises(psycopg2.ProgrammingError, adapt, B())
+
     def test_conform_subclass_precedence(self):
         class foo(tuple):
             def __conform__(self, proto):
@@ -418,6 +439,39 @@ class AdaptSubclassTest(unittest.TestCase):
 
         self.assertEqual(adapt(foo((1, 2, 3))).getquoted(), 'bar')
 
+    def test_conform_getattr(self):
+        class foo:
+            def __conform__(self, proto):
+                return AsIs("foo")
+
+        class proxy:
+            def __init__(self, obj):
+                self.obj = obj
+
+            def __getattr__(self, name):
+                return getattr(self.obj, name)
+
+        # the type is cached after the first adaptation
+        for i in range(2):
+            self.assertEqual(adapt(proxy(foo())).getquoted(), b"foo")
+
+    def test_conform_added_later(self):
+        class foo(int):
+            pass
+
+        # the type is cached after the first adaptation
+        self.assertEqual(adapt(foo(1)).getquoted(), b"1")
+        foo.__conform__ = lambda self, proto: AsIs("foo")
+        self.assertEqual(adapt(foo(1)).getquoted(), b"foo")
+
+        class bar:
+            pass
+
+        obj = bar()
+        self.assertRaises(psycopg2.ProgrammingError, adapt, obj)
+        obj.__conform__ = lambda proto: AsIs("bar")
+        self.assertEqual(adapt(obj).getquoted(), b"bar")
+
 
 @unittest.skipIf(
     platform.system() == 'Windows',